@@ -215,7 +215,7 @@ void c_Code::InitData()
 
         m_pOutput->InitData();
 
-        if (m_pOutput->m_write_after_init)
+        if (m_pOutput->m_write_after_init and m_flag_write_plotfiles)
         {
             m_pOutput->WriteOutput_AfterInit();
         }
@@ -339,6 +339,33 @@ void c_Code::EstimateOfRequiredMemory()
 #endif
 }
 
+void c_Code::Set_StepStride(const int offset, const int stride)
+{
+    /*set by the ensemble driver, see c_Ensemble*/
+    m_step_offset = offset;
+    m_step_stride = stride;
+    amrex::Print() << "##### steps solved by this group: restart_step + "
+                   << m_step_offset << " + k * " << m_step_stride << "\n";
+
+    /*The plotfile and diagnostics writers synchronize on the world
+     *communicator and write through its I/O processor, so they cannot run
+     *on concurrent groups*/
+    if (m_step_stride > 1)
+    {
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+            !use_diagnostics,
+            "use_diagnostics is not supported with ensemble.num_groups > 1.");
+        m_flag_write_plotfiles = false;
+        amrex::Print() << "##### plotfile output is disabled with "
+                          "ensemble.num_groups > 1\n";
+        amrex::Print() << "##### Warning: bias continuation, the Broyden "
+                          "warm start and reset_with_previous_charge_"
+                          "distribution start from step - "
+                       << m_step_stride
+                       << ", the previous step solved by this group\n";
+    }
+}
+
 void c_Code::Cleanup()
 {
 #ifdef USE_TRANSPORT
@@ -367,8 +394,11 @@ void c_Code::Solve_PostProcess_Output()
 #endif
 
     amrex::Real avg_mlmg_solve_time = 0.;
-    for (int step = m_restart_step; step < m_total_steps; ++step)
+    int num_solved_steps = 0;
+    for (int step = m_restart_step + m_step_offset; step < m_total_steps;
+         step += m_step_stride)
     {
+        ++num_solved_steps;
         auto time = set_time(step);
         amrex::Print() << "step: " << std::setw(5) << step << std::setw(7)
                        << "     time: " << std::setw(5) << time << std::setw(15)
@@ -394,14 +424,18 @@ void c_Code::Solve_PostProcess_Output()
         if (use_diagnostics)
             m_pDiagnostics->ComputeAndWriteDiagnostics(step, time);
 
-        if (use_electrostatic) m_pOutput->WriteOutput(step, time);
+        if (use_electrostatic and m_flag_write_plotfiles)
+        {
+            m_pOutput->WriteOutput(step, time);
+        }
     }
 
     if (use_electrostatic)
     {
-        avg_mlmg_solve_time = avg_mlmg_solve_time / m_total_steps;
+        avg_mlmg_solve_time =
+            avg_mlmg_solve_time / amrex::max(num_solved_steps, 1);
         amrex::Print() << "avg_mlmg_solve_time: " << avg_mlmg_solve_time
-                       << " calculated over " << m_total_steps
+                       << " calculated over " << num_solved_steps
                        << " total steps.\n";
     }
 
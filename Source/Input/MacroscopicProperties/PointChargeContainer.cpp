@@ -32,7 +32,7 @@ c_PointChargeContainer::c_PointChargeContainer(
 
 void c_PointChargeContainer::Define_OutputFile()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         auto &rCode = c_Code::GetInstance();
         auto &rOutput = rCode.get_Output();
@@ -54,7 +54,7 @@ void c_PointChargeContainer::Define_OutputFile()
 
 void c_PointChargeContainer::Write_OutputFile()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         auto &rCode = c_Code::GetInstance();
         int step = rCode.get_step();
@@ -235,7 +235,7 @@ void c_PointChargeContainer::Define(
     const amrex::Vector<amrex::Real> &charge_units,
     const amrex::Vector<amrex::Real> &occupations)
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         for (int p = 0; p < particles.size(); ++p)
         {
@@ -324,15 +324,16 @@ void c_PointChargeContainer::Print_Container(bool print_positions)
     int total_particles = TotalNumberOfParticles();
 
     // Get recvcounts and calculate displacements for Gatherv
-    std::vector<int> recvcounts(ParallelDescriptor::NProcs());
-    ParallelDescriptor::Gather(&local_num_particles, 1, recvcounts.data(), 1,
-                               ParallelDescriptor::IOProcessorNumber());
+    std::vector<int> recvcounts(ParallelContext::NProcsSub());
+    MPI_Gather(&local_num_particles, 1, MPI_INT, recvcounts.data(), 1, MPI_INT,
+               ParallelContext::IOProcessorNumberSub(),
+               ParallelContext::CommunicatorSub());
 
-    std::vector<int> displs(ParallelDescriptor::NProcs());
-    if (ParallelDescriptor::IOProcessor())
+    std::vector<int> displs(ParallelContext::NProcsSub());
+    if (ParallelContext::IOProcessorSub())
     {
         displs[0] = 0;
-        for (int i = 1; i < ParallelDescriptor::NProcs(); ++i)
+        for (int i = 1; i < ParallelContext::NProcsSub(); ++i)
         {
             displs[i] = displs[i - 1] + recvcounts[i - 1];
         }
@@ -343,7 +344,7 @@ void c_PointChargeContainer::Print_Container(bool print_positions)
     Vector<amrex::Real> all_charge_units, all_occupations, all_potentials,
         all_pos_x, all_pos_y, all_pos_z;
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         all_particle_ids.resize(total_particles);
         all_charge_units.resize(total_particles);
@@ -361,39 +362,53 @@ void c_PointChargeContainer::Print_Container(bool print_positions)
     }
 
     // Gather data using Gatherv
-    ParallelDescriptor::Gatherv(particle_ids.data(), local_num_particles,
-                                all_particle_ids.data(), recvcounts, displs,
-                                ParallelDescriptor::IOProcessorNumber());
-    ParallelDescriptor::Gatherv(charge_units.data(), local_num_particles,
-                                all_charge_units.data(), recvcounts, displs,
-                                ParallelDescriptor::IOProcessorNumber());
-    ParallelDescriptor::Gatherv(occupations.data(), local_num_particles,
-                                all_occupations.data(), recvcounts, displs,
-                                ParallelDescriptor::IOProcessorNumber());
-    ParallelDescriptor::Gatherv(potentials.data(), local_num_particles,
-                                all_potentials.data(), recvcounts, displs,
-                                ParallelDescriptor::IOProcessorNumber());
+    MPI_Gatherv(particle_ids.data(), local_num_particles, MPI_INT,
+                all_particle_ids.data(),
+                recvcounts.data(), displs.data(), MPI_INT,
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
+    MPI_Gatherv(charge_units.data(), local_num_particles, MPI_DOUBLE,
+                all_charge_units.data(),
+                recvcounts.data(), displs.data(), MPI_DOUBLE,
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
+    MPI_Gatherv(occupations.data(), local_num_particles, MPI_DOUBLE,
+                all_occupations.data(),
+                recvcounts.data(), displs.data(), MPI_DOUBLE,
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
+    MPI_Gatherv(potentials.data(), local_num_particles, MPI_DOUBLE,
+                all_potentials.data(),
+                recvcounts.data(), displs.data(), MPI_DOUBLE,
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
 
     if (print_positions)
     {
-        ParallelDescriptor::Gatherv(pos_x.data(), local_num_particles,
-                                    all_pos_x.data(), recvcounts, displs,
-                                    ParallelDescriptor::IOProcessorNumber());
-
-        ParallelDescriptor::Gatherv(pos_y.data(), local_num_particles,
-                                    all_pos_y.data(), recvcounts, displs,
-                                    ParallelDescriptor::IOProcessorNumber());
+        MPI_Gatherv(pos_x.data(), local_num_particles, MPI_DOUBLE,
+                    all_pos_x.data(),
+                    recvcounts.data(), displs.data(), MPI_DOUBLE,
+                    ParallelContext::IOProcessorNumberSub(),
+                    ParallelContext::CommunicatorSub());
+
+        MPI_Gatherv(pos_y.data(), local_num_particles, MPI_DOUBLE,
+                    all_pos_y.data(),
+                    recvcounts.data(), displs.data(), MPI_DOUBLE,
+                    ParallelContext::IOProcessorNumberSub(),
+                    ParallelContext::CommunicatorSub());
 #if AMREX_SPACEDIM == 3
-        ParallelDescriptor::Gatherv(pos_z.data(), local_num_particles,
-                                    all_pos_z.data(), recvcounts, displs,
-                                    ParallelDescriptor::IOProcessorNumber());
+        MPI_Gatherv(pos_z.data(), local_num_particles, MPI_DOUBLE,
+                    all_pos_z.data(),
+                    recvcounts.data(), displs.data(), MPI_DOUBLE,
+                    ParallelContext::IOProcessorNumberSub(),
+                    ParallelContext::CommunicatorSub());
 #endif
     }
 
     // Printing at root process and computing total charge
     total_charge = 0.;
     total_charge_units = 0;
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         amrex::Print() << "Point Charges: \n";
         int np = all_charge_units.size();
@@ -1223,6 +1223,65 @@ amrex::Real c_MLMGSolver::Solve_PoissonEqn()
 #endif
 }
 
+amrex::Real c_MLMGSolver::Solve_LinearizedPoissonEqn(
+    amrex::MultiFab const &kappa, amrex::MultiFab const &phi_prev)
+{
+    /*With the charge linearized around phi_prev,
+     * rho(phi) = rho - kappa (phi - phi_prev), kappa >= 0,
+     *the Poisson equation becomes
+     * (ascalar alpha + kappa) phi - bscalar div(beta grad phi)
+     *     = rhs + kappa phi_prev,
+     *which is solved with the alpha term of the operator. The operator is
+     *restored afterwards.
+     *kappa enters unscaled, which assumes the convention of the Poisson
+     *solve, bscalar = 1 and rhs = +rho. This is asserted by the caller.*/
+    amrex::Real mlmg_solve_beg_step = amrex::second();
+
+    auto &rCode = c_Code::GetInstance();
+    auto &rGprop = rCode.get_GeometryProperties();
+    int amrlev = 0;
+
+    amrex::MultiFab acoef(alpha->boxArray(), alpha->DistributionMap(), 1, 0);
+    amrex::MultiFab::LinComb(acoef, ascalar, *alpha, 0, 1., kappa, 0, 0, 1,
+                             0);
+
+    amrex::MultiFab rhs_lin(rhs->boxArray(), rhs->DistributionMap(), 1, 0);
+    amrex::MultiFab::Copy(rhs_lin, *rhs, 0, 0, 1, 0);
+    amrex::MultiFab::AddProduct(rhs_lin, kappa, 0, phi_prev, 0, 0, 1, 0);
+
+#ifdef AMREX_USE_EB
+    if (rGprop.is_eb_enabled())
+    {
+        p_mlebabec->setScalars(1., bscalar);
+        p_mlebabec->setACoeffs(amrlev, acoef);
+    }
+#endif
+    if (!rGprop.is_eb_enabled())
+    {
+        p_mlabec->setScalars(1., bscalar);
+        p_mlabec->setACoeffs(amrlev, acoef);
+    }
+
+    pMLMG->solve({soln}, {&rhs_lin}, relative_tolerance, absolute_tolerance);
+
+#ifdef AMREX_USE_EB
+    if (rGprop.is_eb_enabled())
+    {
+        p_mlebabec->setScalars(ascalar, bscalar);
+        p_mlebabec->setACoeffs(amrlev, *alpha);
+    }
+#endif
+    if (!rGprop.is_eb_enabled())
+    {
+        p_mlabec->setScalars(ascalar, bscalar);
+        p_mlabec->setACoeffs(amrlev, *alpha);
+    }
+
+    soln->FillBoundary(rGprop.geom.periodicity());
+
+    return amrex::second() - mlmg_solve_beg_step;
+}
+
 void c_MLMGSolver::Compute_vecField(
     std::array<amrex::MultiFab, AMREX_SPACEDIM> &vecField)
 {
@@ -0,0 +1,289 @@
+#include <cmath>
+
+#include "Transport.H"
+
+using namespace amrex;
+
+#ifdef BROYDEN_PARALLEL
+/*Anderson (Pulay) mixing with a history of Anderson_History differences.
+ *With the residual F_k = n_in_k - n_out_k and the differences
+ * dF_j = F_j - F_(j-1), dn_j = n_in_j - n_in_(j-1),
+ *the coefficients gamma minimize |F_k - sum_j gamma_j dF_j|, i.e. solve the
+ *normal equations with the Gram matrix of the dF_j, and the next input is
+ * n_in_(k+1) = n_in_k - beta F_k - sum_j gamma_j (dn_j - beta dF_j),
+ *with beta = Broyden_fraction. The differences are stored per site in a
+ *ring of Anderson_History slots. Only the row of the Gram matrix of the
+ *new difference changes, so the norms and the 2 x Anderson_History dot
+ *products of an iteration are reduced in one MPI_Allreduce.*/
+void c_TransportSolver::Set_Anderson_Parallel()
+{
+    const int AH = Anderson_History;
+
+#ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
+    h_Anderson_dF_data.resize({0, 0}, {site_size_loc_all_NS, AH},
+                              The_Pinned_Arena());
+    h_Anderson_dn_data.resize({0, 0}, {site_size_loc_all_NS, AH},
+                              The_Pinned_Arena());
+    SetVal_RealTable2D(h_Anderson_dF_data, 0.);
+    SetVal_RealTable2D(h_Anderson_dn_data, 0.);
+#else
+    d_Anderson_dF_data.resize({0, 0}, {site_size_loc_all_NS, AH},
+                              The_Arena());
+    d_Anderson_dn_data.resize({0, 0}, {site_size_loc_all_NS, AH},
+                              The_Arena());
+    d_Anderson_values_vec.resize(2 + 2 * AH);
+    d_Anderson_gamma_vec.resize(AH);
+#endif
+    h_Anderson_values_vec.resize(2 + 2 * AH);
+    Anderson_Gram.resize(AH * AH);
+
+    /*freed here if Set is repeated, else in Free_MPIDerivedDataTypes*/
+    if (Anderson_Reduce != MPI_OP_NULL) MPI_Op_free(&Anderson_Reduce);
+    MPI_Op_create((MPI_User_function *)Anderson_Reduce_Func, true,
+                  &Anderson_Reduce);
+
+    Reset_Anderson_Parallel();
+}
+
+void c_TransportSolver::Reset_Anderson_Parallel()
+{
+    /*the slots are overwritten before they are used again*/
+    Anderson_NumStored = 0;
+    Anderson_NextSlot = 0;
+    for (auto &g : Anderson_Gram) g = 0.;
+}
+
+bool c_TransportSolver::Solve_AndersonCoefficients(
+    amrex::Vector<amrex::Real> &gamma, amrex::Real const *rhs)
+{
+    /*Gaussian elimination with partial pivoting on the small Gram matrix of
+     *the stored slots. A relative Tikhonov shift keeps nearly collinear
+     *differences from blowing up gamma.*/
+    const int AH = Anderson_History;
+    const int n = Anderson_NumStored;
+
+    amrex::Real trace = 0.;
+    for (int i = 0; i < n; ++i) trace += Anderson_Gram[i * AH + i];
+    if (trace <= 0.) return false;
+    const amrex::Real shift = 1.e-12 * trace / n;
+
+    amrex::Vector<amrex::Real> A(n * n);
+    gamma.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < n; ++j) A[i * n + j] = Anderson_Gram[i * AH + j];
+        A[i * n + i] += shift;
+        gamma[i] = rhs[i];
+    }
+
+    for (int c = 0; c < n; ++c)
+    {
+        int p = c;
+        for (int r = c + 1; r < n; ++r)
+        {
+            if (std::abs(A[r * n + c]) > std::abs(A[p * n + c])) p = r;
+        }
+        if (std::abs(A[p * n + c]) <= shift) return false;
+        if (p != c)
+        {
+            for (int j = 0; j < n; ++j) std::swap(A[c * n + j], A[p * n + j]);
+            std::swap(gamma[c], gamma[p]);
+        }
+        for (int r = c + 1; r < n; ++r)
+        {
+            const amrex::Real f = A[r * n + c] / A[c * n + c];
+            for (int j = c; j < n; ++j) A[r * n + j] -= f * A[c * n + j];
+            gamma[r] -= f * gamma[c];
+        }
+    }
+    for (int c = n - 1; c >= 0; --c)
+    {
+        for (int j = c + 1; j < n; ++j) gamma[c] -= A[c * n + j] * gamma[j];
+        gamma[c] /= A[c * n + c];
+    }
+    return true;
+}
+
+void c_TransportSolver::Execute_Anderson_Mixing_Parallel()
+{
+    const int AH = Anderson_History;
+    const bool add_slot = Broyden_Step > 1;
+    const int slot = Anderson_NextSlot;
+    if (add_slot)
+    {
+        Anderson_NextSlot = (Anderson_NextSlot + 1) % AH;
+        Anderson_NumStored = amrex::min(Anderson_NumStored + 1, AH);
+    }
+    const int NS = Anderson_NumStored;
+
+    bool relative = false;
+    switch (map_NormType[Broyden_Norm_Type])
+    {
+        case s_Norm_Type::Absolute:
+            break;
+        case s_Norm_Type::Relative:
+            relative = true;
+            break;
+        default:
+            amrex::Abort("Norm Type " + Broyden_Norm_Type +
+                         " is not yet defined.");
+    }
+
+    auto *h_values = h_Anderson_values_vec.dataPtr();
+    for (auto &v : h_Anderson_values_vec) v = 0.;
+
+    /*Residual, norms, the new difference and its dot products*/
+#ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
+    auto const &n_curr_in = h_n_curr_in_data.table();
+    auto const &n_curr_out = h_n_curr_out_data.table();
+    auto const &n_prev_in = h_n_prev_in_data.table();
+    auto const &F_curr = h_F_curr_data.table();
+    auto const &Norm = h_Norm_data.table();
+    auto const &dF = h_Anderson_dF_data.table();
+    auto const &dn = h_Anderson_dn_data.table();
+
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        amrex::Real Fcurr = n_curr_in(site) - n_curr_out(site);
+        Norm(site) =
+            relative ? fabs(Fcurr / (n_curr_in(site) + n_curr_out(site)))
+                     : fabs(Fcurr);
+        if (add_slot)
+        {
+            dF(site, slot) = Fcurr - F_curr(site);
+            dn(site, slot) = n_curr_in(site) - n_prev_in(site);
+        }
+        F_curr(site) = Fcurr;
+
+        h_values[0] = std::max(h_values[0], Norm(site));
+        h_values[1] += relative ? pow(Norm(site), 2) : pow(Fcurr, 2);
+        for (int j = 0; j < NS; ++j)
+        {
+            if (add_slot) h_values[2 + j] += dF(site, j) * dF(site, slot);
+            h_values[2 + AH + j] += dF(site, j) * Fcurr;
+        }
+    }
+#else
+    auto const &n_curr_in = d_n_curr_in_data.table();
+    auto const &n_curr_out = d_n_curr_out_data.table();
+    auto const &n_prev_in = d_n_prev_in_data.table();
+    auto const &F_curr = d_F_curr_data.table();
+    auto const &Norm = d_Norm_data.table();
+    auto const &dF = d_Anderson_dF_data.table();
+    auto const &dn = d_Anderson_dn_data.table();
+    auto *values = d_Anderson_values_vec.dataPtr();
+
+    amrex::Gpu::copy(amrex::Gpu::hostToDevice, h_Anderson_values_vec.begin(),
+                     h_Anderson_values_vec.end(),
+                     d_Anderson_values_vec.begin());
+
+    amrex::ParallelFor(
+        site_size_loc_all_NS,
+        [=] AMREX_GPU_DEVICE(int site) noexcept
+        {
+            amrex::Real Fcurr = n_curr_in(site) - n_curr_out(site);
+            Norm(site) =
+                relative ? fabs(Fcurr / (n_curr_in(site) + n_curr_out(site)))
+                         : fabs(Fcurr);
+            if (add_slot)
+            {
+                dF(site, slot) = Fcurr - F_curr(site);
+                dn(site, slot) = n_curr_in(site) - n_prev_in(site);
+            }
+            F_curr(site) = Fcurr;
+
+            amrex::Gpu::Atomic::Max(&(values[0]), Norm(site));
+            amrex::HostDevice::Atomic::Add(
+                &(values[1]), relative ? Norm(site) * Norm(site)
+                                       : Fcurr * Fcurr);
+            for (int j = 0; j < NS; ++j)
+            {
+                if (add_slot)
+                {
+                    amrex::HostDevice::Atomic::Add(
+                        &(values[2 + j]), dF(site, j) * dF(site, slot));
+                }
+                amrex::HostDevice::Atomic::Add(&(values[2 + AH + j]),
+                                               dF(site, j) * Fcurr);
+            }
+        });
+    amrex::Gpu::copy(amrex::Gpu::deviceToHost, d_Anderson_values_vec.begin(),
+                     d_Anderson_values_vec.end(),
+                     h_Anderson_values_vec.begin());
+    amrex::Gpu::streamSynchronize();
+#endif
+
+    MPI_Allreduce(MPI_IN_PLACE, h_values, 2 + 2 * AH, MPI_DOUBLE,
+                  Anderson_Reduce, ParallelContext::CommunicatorSub());
+
+    Broyden_Norm = h_values[0];
+    Broyden_NormSum_Curr = sqrt(h_values[1]);
+
+    amrex::Print() << "\n Broyden_NormSum_Curr: " << std::setw(20)
+                   << Broyden_NormSum_Curr << "\n";
+    amrex::Print() << " Broyden_NormSum_Prev: " << std::setw(20)
+                   << Broyden_NormSum_Prev << ",   Difference: "
+                   << (Broyden_NormSum_Curr - Broyden_NormSum_Prev) << "\n";
+    amrex::Print() << " Broyden max norm: " << Broyden_Norm << "\n\n";
+
+    Broyden_NormSum_Prev = Broyden_NormSum_Curr;
+
+    if (add_slot)
+    {
+        for (int j = 0; j < NS; ++j)
+        {
+            Anderson_Gram[slot * AH + j] = h_values[2 + j];
+            Anderson_Gram[j * AH + slot] = h_values[2 + j];
+        }
+    }
+
+    /*gamma = 0, i.e. linear mixing, in the first iteration or if the Gram
+     *matrix is singular*/
+    amrex::Vector<amrex::Real> gamma(AH, 0.);
+    if (NS > 0 and !Solve_AndersonCoefficients(gamma, &h_values[2 + AH]))
+    {
+        amrex::Print() << "Anderson Gram matrix is singular, restarting "
+                          "the history.\n";
+        Reset_Anderson_Parallel();
+        gamma.assign(AH, 0.);
+    }
+    gamma.resize(AH, 0.);
+    const int NG = Anderson_NumStored;
+
+    /*Store current n in previous n, predict next n and store it in current n*/
+    const amrex::Real BF = Broyden_fraction;
+#ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        amrex::Real sum = 0.;
+        for (int j = 0; j < NG; ++j)
+        {
+            sum += gamma[j] * (dn(site, j) - BF * dF(site, j));
+        }
+        n_prev_in(site) = n_curr_in(site);
+        n_curr_in(site) = n_prev_in(site) - BF * F_curr(site) - sum;
+    }
+#else
+    amrex::Gpu::copy(amrex::Gpu::hostToDevice, gamma.begin(), gamma.end(),
+                     d_Anderson_gamma_vec.begin());
+    auto const *d_gamma = d_Anderson_gamma_vec.dataPtr();
+
+    amrex::ParallelFor(site_size_loc_all_NS,
+                       [=] AMREX_GPU_DEVICE(int site) noexcept
+                       {
+                           amrex::Real sum = 0.;
+                           for (int j = 0; j < NG; ++j)
+                           {
+                               sum += d_gamma[j] *
+                                      (dn(site, j) - BF * dF(site, j));
+                           }
+                           n_prev_in(site) = n_curr_in(site);
+                           n_curr_in(site) =
+                               n_prev_in(site) - BF * F_curr(site) - sum;
+                       });
+    amrex::Gpu::streamSynchronize();
+#endif
+
+    Broyden_Step += 1;
+}
+#endif
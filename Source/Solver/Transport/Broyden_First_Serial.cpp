@@ -5,7 +5,7 @@ using namespace amrex;
 #ifndef BROYDEN_PARALLEL
 void c_TransportSolver::Execute_Broyden_First_Algorithm()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         amrex::Print() << "\nBroydenStep: " << Broyden_Step
                        << ",  fraction: " << Broyden_fraction
@@ -165,7 +165,7 @@ void c_TransportSolver::Execute_Broyden_First_Algorithm()
     }
 
     MPI_Bcast(&Broyden_Norm, 1, MPI_DOUBLE,
-              ParallelDescriptor::IOProcessorNumber(),
-              ParallelDescriptor::Communicator());
+              ParallelContext::IOProcessorNumberSub(),
+              ParallelContext::CommunicatorSub());
 }
 #endif
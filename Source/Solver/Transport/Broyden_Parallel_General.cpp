@@ -1,4 +1,5 @@
 #include <limits>
+#include <utility>
 
 #include "Transport.H"
 
@@ -8,7 +9,9 @@ enum class s_Algorithm_Type : int
 {
     broyden_first,
     broyden_second,
-    simple_mixing
+    simple_mixing,
+    anderson,
+    newton_krylov
 };
 
 #ifdef BROYDEN_PARALLEL
@@ -36,8 +39,10 @@ void c_TransportSolver::Define_MPI_Vector_Type_and_MPI_Vector_Sum()
 
 void c_TransportSolver::Free_MPIDerivedDataTypes()
 {
-    MPI_Type_free(&MPI_Vector_Type);
-    MPI_Op_free(&Vector_Add);
+    /*only the types of the selected algorithm are created*/
+    if (MPI_Vector_Type != MPI_DATATYPE_NULL) MPI_Type_free(&MPI_Vector_Type);
+    if (Vector_Add != MPI_OP_NULL) MPI_Op_free(&Vector_Add);
+    if (Anderson_Reduce != MPI_OP_NULL) MPI_Op_free(&Anderson_Reduce);
 }
 
 void c_TransportSolver::Define_Broyden_Partition()
@@ -52,23 +57,28 @@ void c_TransportSolver::Define_Broyden_Partition()
      */
 
     num_field_sites_all_NS = 0;
-    total_proc = amrex::ParallelDescriptor::NProcs();
-    my_rank = amrex::ParallelDescriptor::MyProc();
+    total_proc = amrex::ParallelContext::NProcsSub();
+    my_rank = amrex::ParallelContext::MyProcSub();
 
     // MPI_recv_count.resize(total_proc);
     // MPI_recv_disp.resize(total_proc);
     // num_procs_with_sites=total_proc;
 
-    site_size_loc_cumulative.resize(vp_CNT.size() + 1);
+    site_size_loc_cumulative.resize(vp_NS.size() + 1);
     site_size_loc_cumulative[0] = 0;
 
-    for (int c = 0; c < vp_CNT.size(); ++c)
+    for (int c = 0; c < vp_NS.size(); ++c)
     {
-        vp_CNT[c]->set_site_size_loc_offset(site_size_loc_cumulative[c]);
-        site_size_loc_cumulative[c + 1] =
-            site_size_loc_cumulative[c] + vp_CNT[c]->MPI_recv_count[my_rank];
+        std::visit(
+            [&](auto &NS)
+            {
+                NS->set_site_size_loc_offset(site_size_loc_cumulative[c]);
+                site_size_loc_cumulative[c + 1] =
+                    site_size_loc_cumulative[c] + NS->MPI_recv_count[my_rank];
+            },
+            vp_NS[c]);
     }
-    site_size_loc_all_NS = site_size_loc_cumulative[vp_CNT.size()];
+    site_size_loc_all_NS = site_size_loc_cumulative[vp_NS.size()];
 
     // if (ParallelDescriptor::IOProcessor())
     //{
@@ -87,6 +97,7 @@ void c_TransportSolver::Set_Broyden_Parallel()
     Define_Broyden_Partition();
 
     Broyden_Step = 1;
+    Broyden_NumCarriedColumns = 0;
     Broyden_Norm = 1.;
     Broyden_Scalar = 1.;
     Broyden_NormSum_Curr = 1.e10;
@@ -99,18 +110,23 @@ void c_TransportSolver::Set_Broyden_Parallel()
     auto const &h_n_curr_in = h_n_curr_in_data.table();
 
     /*Need generalization for multiple CNTs*/
-    for (int c = 0; c < vp_CNT.size(); ++c)
+    for (int c = 0; c < vp_NS.size(); ++c)
     {
-        int NS_offset = site_size_loc_cumulative[c];
-        vp_CNT[c]->Fetch_InputLocalCharge_FromNanostructure(
-            h_n_curr_in_data, NS_offset, vp_CNT[c]->MPI_recv_disp[my_rank],
-            vp_CNT[c]->MPI_recv_count[my_rank]);
-
-        // amrex::Print() << "Fetching h_n_curr_in for NS_id: " <<
-        // vp_CNT[c]->NS_Id << "\n"; for(int i=NS_offset; i< NS_offset +
-        // vp_CNT[c]->MPI_recv_count[my_rank]; ++i) {
-        //     amrex::Print() << i << " " << h_n_curr_in(i) << "\n";
-        // }
+        std::visit(
+            [&](auto &NS)
+            {
+                int NS_offset = site_size_loc_cumulative[c];
+                NS->Fetch_InputLocalCharge_FromNanostructure(
+                    h_n_curr_in_data, NS_offset, NS->MPI_recv_disp[my_rank],
+                    NS->MPI_recv_count[my_rank]);
+
+                // amrex::Print() << "Fetching h_n_curr_in for NS_id: " <<
+                // NS->NS_Id << "\n"; for(int i=NS_offset; i< NS_offset +
+                // NS->MPI_recv_count[my_rank]; ++i) {
+                //     amrex::Print() << i << " " << h_n_curr_in(i) << "\n";
+                // }
+            },
+            vp_NS[c]);
     }
 
 #ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
@@ -224,7 +240,6 @@ void c_TransportSolver::Set_Broyden_Parallel()
             auto const &Wmat = d_Wmat_data.table();
 
             const int BTM = Broyden_Threshold_MaxStep;
-            const int SSL = site_size_loc_all_NS;
             amrex::ParallelFor(site_size_loc_all_NS,
                                [=] AMREX_GPU_DEVICE(int site) noexcept
                                {
@@ -234,12 +249,10 @@ void c_TransportSolver::Set_Broyden_Parallel()
                                        Wmat(iter, site) = 0.;
                                    }
                                    sum_vector(site) = 0.;
-                                   for (int iter = site; iter < BTM;
-                                        iter += SSL)
-                                   {
-                                       intermed_vector(iter) = 0.;
-                                   }
                                });
+            amrex::ParallelFor(BTM,
+                               [=] AMREX_GPU_DEVICE(int iter) noexcept
+                               { intermed_vector(iter) = 0.; });
             amrex::Gpu::streamSynchronize();
 #endif
 
@@ -253,6 +266,16 @@ void c_TransportSolver::Set_Broyden_Parallel()
                 "use broyden_second algorithm.");
             break;
         }
+        case s_Algorithm_Type::anderson:
+        {
+            Set_Anderson_Parallel();
+            break;
+        }
+        case s_Algorithm_Type::newton_krylov:
+        {
+            Set_NewtonKrylov_Parallel();
+            break;
+        }
         default:
         {
             amrex::Abort("In Set_Broyden: selfconsistency_algorithm, " +
@@ -320,10 +343,22 @@ void c_TransportSolver::Reset_Broyden_Parallel()
         }
         case s_Algorithm_Type::broyden_second:
         {
+            Carry_BroydenHistoryToNextStep();
+            const int NCC = Broyden_NumCarriedColumns;
 #ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
             SetVal_RealTable1D(h_sum_vector_data, 0.);
-            SetVal_RealTable2D(h_VmatTran_data, 0.);
-            SetVal_RealTable2D(h_Wmat_data, 0.);
+
+            auto const &VmatTran = h_VmatTran_data.table();
+            auto const &Wmat = h_Wmat_data.table();
+            for (int site = 0; site < site_size_loc_all_NS; ++site)
+            {
+                for (int iter = 0; iter < Broyden_Threshold_MaxStep; ++iter)
+                {
+                    if (iter > 0 and iter <= NCC) continue;
+                    VmatTran(site, iter) = 0.;
+                    Wmat(iter, site) = 0.;
+                }
+            }
 #else
             auto const &sum_vector = d_sum_vector_data.table();
             auto const &intermed_vector = d_intermed_vector_data.table();
@@ -332,22 +367,20 @@ void c_TransportSolver::Reset_Broyden_Parallel()
             auto const &Wmat = d_Wmat_data.table();
 
             const int BTM = Broyden_Threshold_MaxStep;
-            const int SSL = site_size_loc_all_NS;
             amrex::ParallelFor(site_size_loc_all_NS,
                                [=] AMREX_GPU_DEVICE(int site) noexcept
                                {
                                    for (int iter = 0; iter < BTM; ++iter)
                                    {
+                                       if (iter > 0 and iter <= NCC) continue;
                                        VmatTran(site, iter) = 0.;
                                        Wmat(iter, site) = 0.;
                                    }
                                    sum_vector(site) = 0.;
-                                   for (int iter = site; iter < BTM;
-                                        iter += SSL)
-                                   {
-                                       intermed_vector(iter) = 0.;
-                                   }
                                });
+            amrex::ParallelFor(BTM,
+                               [=] AMREX_GPU_DEVICE(int iter) noexcept
+                               { intermed_vector(iter) = 0.; });
             amrex::Gpu::streamSynchronize();
 #endif
 
@@ -359,6 +392,16 @@ void c_TransportSolver::Reset_Broyden_Parallel()
         {
             break;
         }
+        case s_Algorithm_Type::anderson:
+        {
+            Reset_Anderson_Parallel();
+            break;
+        }
+        case s_Algorithm_Type::newton_krylov:
+        {
+            Reset_NewtonKrylov_Parallel();
+            break;
+        }
         default:
         {
             amrex::Abort("In Reset_Broyden: selfconsistency_algorithm, " +
@@ -381,4 +424,99 @@ void c_TransportSolver::Reset_Broyden_Parallel()
     amrex::Print() << " Broyden_NormSum_Curr: " << Broyden_NormSum_Curr << "\n";
     amrex::Print() << " Broyden_NormSum_Prev: " << Broyden_NormSum_Prev << "\n";
 }
+
+void c_TransportSolver::Carry_BroydenHistoryToNextStep()
+{
+    /*The inverse Jacobian of the modified second Broyden method is
+     * -Broyden_fraction*I + sum_k Wmat(k,:) VmatTran(:,k)^T,
+     *with columns k = 1, ..., m. Neighbouring bias points have nearly the
+     *same Jacobian, so the newest Broyden_warm_start_columns columns are
+     *moved to k = 1, ..., NCC and the next step starts from this low-rank
+     *approximation instead of relearning it. Wmat is scaled by
+     *Broyden_warm_start_decay, such that older updates fade out over the
+     *steps. The caller zeroes the remaining columns.*/
+    /*the last iteration, Broyden_Step - 1, added column
+     *Broyden_Step - 2 + Broyden_NumCarriedColumns, see
+     *Execute_Broyden_Modified_Second_Algorithm_Parallel*/
+    const int num_valid =
+        Broyden_NumCarriedColumns + amrex::max(Broyden_Step - 2, 0);
+    const int num_slots = Broyden_Threshold_MaxStep - 1;
+    const int num_stored = amrex::min(num_valid, num_slots);
+    const int NCC = amrex::min(num_stored, Broyden_WarmStart_MaxColumns);
+    const int shift = num_stored - NCC;
+    const amrex::Real decay = Broyden_WarmStart_Decay;
+
+    /*With Broyden_history_window, column k is in slot (k - 1) % num_slots
+     *+ 1 and the slots are rotated left by num_valid % num_slots, such that
+     *the oldest stored column is in slot 1.*/
+    const int rot = (num_valid > num_slots) ? num_valid % num_slots : 0;
+
+    Broyden_NumCarriedColumns = NCC;
+    if (NCC == 0) return;
+
+    amrex::Print() << "Carrying " << NCC << " of " << num_stored
+                   << " Broyden updates to the next bias step, decay: "
+                   << decay << "\n";
+
+#ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
+    auto const &VmatTran = h_VmatTran_data.table();
+    auto const &Wmat = h_Wmat_data.table();
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        /*rotation of slots 1, ..., num_slots by three reversals*/
+        auto reverse = [&](int lo, int hi)
+        {
+            for (; lo < hi; ++lo, --hi)
+            {
+                std::swap(VmatTran(site, lo), VmatTran(site, hi));
+                std::swap(Wmat(lo, site), Wmat(hi, site));
+            }
+        };
+        if (rot > 0)
+        {
+            reverse(1, rot);
+            reverse(rot + 1, num_slots);
+            reverse(1, num_slots);
+        }
+        for (int k = 1; k <= NCC; ++k)
+        {
+            VmatTran(site, k) = VmatTran(site, k + shift);
+            Wmat(k, site) = decay * Wmat(k + shift, site);
+        }
+    }
+#else
+    auto const &VmatTran = d_VmatTran_data.table();
+    auto const &Wmat = d_Wmat_data.table();
+    amrex::ParallelFor(
+        site_size_loc_all_NS,
+        [=] AMREX_GPU_DEVICE(int site) noexcept
+        {
+            /*rotation of slots 1, ..., num_slots by three reversals*/
+            auto reverse = [&](int lo, int hi)
+            {
+                for (; lo < hi; ++lo, --hi)
+                {
+                    amrex::Real tmp = VmatTran(site, lo);
+                    VmatTran(site, lo) = VmatTran(site, hi);
+                    VmatTran(site, hi) = tmp;
+                    tmp = Wmat(lo, site);
+                    Wmat(lo, site) = Wmat(hi, site);
+                    Wmat(hi, site) = tmp;
+                }
+            };
+            if (rot > 0)
+            {
+                reverse(1, rot);
+                reverse(rot + 1, num_slots);
+                reverse(1, num_slots);
+            }
+            for (int k = 1; k <= NCC; ++k)
+            {
+                VmatTran(site, k) = VmatTran(site, k + shift);
+                Wmat(k, site) = decay * Wmat(k + shift, site);
+            }
+        });
+    amrex::Gpu::streamSynchronize();
+#endif
+}
 #endif
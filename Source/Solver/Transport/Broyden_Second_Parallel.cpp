@@ -78,10 +78,10 @@ void c_TransportSolver::
         }
     }
     MPI_Allreduce(MPI_IN_PLACE, &Broyden_Norm, 1, MPI_DOUBLE, MPI_MAX,
-                  ParallelDescriptor::Communicator());
+                  ParallelContext::CommunicatorSub());
 
     MPI_Allreduce(MPI_IN_PLACE, &Broyden_NormSum_Curr, 1, MPI_DOUBLE, MPI_SUM,
-                  ParallelDescriptor::Communicator());
+                  ParallelContext::CommunicatorSub());
     Broyden_NormSum_Curr = sqrt(Broyden_NormSum_Curr);
 
     /*Evaluate denom = delta_F_curr^T * delta_F_curr */
@@ -95,7 +95,7 @@ void c_TransportSolver::
     }
 
     MPI_Allreduce(MPI_IN_PLACE, &Broyden_Denom, 1, MPI_DOUBLE, MPI_SUM,
-                  ParallelDescriptor::Communicator());
+                  ParallelContext::CommunicatorSub());
 
     // amrex::Print() << "n_curr_in, n_prev_in: " << n_curr_in(0) << " " <<
     // n_prev_in(0) << "\n";
@@ -109,55 +109,75 @@ void c_TransportSolver::
 
     Broyden_NormSum_Prev = Broyden_NormSum_Curr;
 
-    int m = Broyden_Step - 1;
+    /*m: column of this iteration, after the columns carried over from the
+     *previous bias step, see Reset_Broyden_Parallel. Column m is stored in
+     *slot (m - 1) % num_slots + 1, i.e. once all slots are used, the
+     *newest update replaces the oldest one, see Broyden_history_window.*/
+    int m = Broyden_Step - 1 + Broyden_NumCarriedColumns;
+    const int num_slots = Broyden_Threshold_MaxStep - 1;
+    const int num_used = amrex::min(m, num_slots);
     if (m > 0)
     {
-        /*First, evaluate W*(V^T*deltaF), i.e. Wmat*(VmatTran*delta_F_curr)*/
-        /*Use intermed_vector to temporarily store vector
-         * (VmatTran*delta_F_curr)*/
-        for (int iter = 1; iter <= m - 1; ++iter)
+        const int slot = (m - 1) % num_slots + 1;
+        if (Broyden_Step > 1)
         {
-            amrex::Real sum = 0.;
+            const int num_old = amrex::min(m - 1, num_slots);
+            /*drop the update held by the slot of column m*/
             for (int site = 0; site < site_size_loc_all_NS; ++site)
             {
-                sum += VmatTran(site, iter) * delta_F_curr(site);
+                VmatTran(site, slot) = 0.;
+                Wmat(slot, site) = 0.;
             }
-            intermed_vector(iter) = sum;
-        }
-        /*Allreduce intermed_vector for complete matrix-vector multiplication*/
-        MPI_Allreduce(MPI_IN_PLACE, &intermed_vector(0),
-                      Broyden_Threshold_MaxStep, MPI_Vector_Type, Vector_Add,
-                      ParallelDescriptor::Communicator());
 
-        /*Use sum_vector to temporarily store Wmat*intermed_vector */
+            /*First, evaluate W*(V^T*deltaF),
+             *i.e. Wmat*(VmatTran*delta_F_curr)*/
+            /*Use intermed_vector to temporarily store vector
+             * (VmatTran*delta_F_curr)*/
+            for (int iter = 1; iter <= num_old; ++iter)
+            {
+                amrex::Real sum = 0.;
+                for (int site = 0; site < site_size_loc_all_NS; ++site)
+                {
+                    sum += VmatTran(site, iter) * delta_F_curr(site);
+                }
+                intermed_vector(iter) = sum;
+            }
+            /*Allreduce intermed_vector for complete matrix-vector
+             *multiplication*/
+            MPI_Allreduce(MPI_IN_PLACE, &intermed_vector(0),
+                          Broyden_Threshold_MaxStep, MPI_Vector_Type,
+                          Vector_Add, ParallelContext::CommunicatorSub());
 
-        for (int site = 0; site < site_size_loc_all_NS; ++site)
-        {
-            amrex::Real sum = 0.;
-            for (int iter = 1; iter <= m - 1; ++iter)
+            /*Use sum_vector to temporarily store Wmat*intermed_vector */
+
+            for (int site = 0; site < site_size_loc_all_NS; ++site)
             {
-                sum += Wmat(iter, site) * intermed_vector(iter);
+                amrex::Real sum = 0.;
+                for (int iter = 1; iter <= num_old; ++iter)
+                {
+                    sum += Wmat(iter, site) * intermed_vector(iter);
+                }
+                sum_vector(site) = sum;
             }
-            sum_vector(site) = sum;
-        }
 
-        /*Evaluate Wmat and VmatTran at iteration m*/
-        for (int site = 0; site < site_size_loc_all_NS; ++site)
-        {
-            amrex::Real delta_n = n_curr_in(site) - n_prev_in(site);
+            /*Evaluate Wmat and VmatTran at iteration m*/
+            for (int site = 0; site < site_size_loc_all_NS; ++site)
+            {
+                amrex::Real delta_n = n_curr_in(site) - n_prev_in(site);
 
-            VmatTran(site, m) = delta_F_curr(site) / Broyden_Denom;
+                VmatTran(site, slot) = delta_F_curr(site) / Broyden_Denom;
 
-            /*Access to (m,site) will be slower*/
-            Wmat(m, site) = -Broyden_fraction * delta_F_curr(site) + delta_n -
-                            sum_vector(site);
+                /*Access to (m,site) will be slower*/
+                Wmat(slot, site) = -Broyden_fraction * delta_F_curr(site) +
+                                delta_n - sum_vector(site);
+            }
         }
 
         /*Next, evaluate W*(V^T*F_curr), i.e. Wmat*(VmatTran*F_curr)*/
         /*Reuse intermed_vector to temporarily store vector (VmatTran*F_curr)*/
 
         SetVal_RealTable1D(h_intermed_vector_data, 0.);
-        for (int iter = 1; iter <= m; ++iter)
+        for (int iter = 1; iter <= num_used; ++iter)
         {
             amrex::Real sum = 0.;
             for (int site = 0; site < site_size_loc_all_NS; ++site)
@@ -170,7 +190,7 @@ void c_TransportSolver::
         /*Allreduce intermed_vector for complete matrix-vector multiplication*/
         MPI_Allreduce(MPI_IN_PLACE, &intermed_vector(0),
                       Broyden_Threshold_MaxStep, MPI_Vector_Type, Vector_Add,
-                      ParallelDescriptor::Communicator());
+                      ParallelContext::CommunicatorSub());
 
         // if (ParallelDescriptor::IOProcessor())
         //{
@@ -188,7 +208,7 @@ void c_TransportSolver::
         for (int site = 0; site < site_size_loc_all_NS; ++site)
         {
             amrex::Real sum = 0.;
-            for (int iter = 1; iter <= m; ++iter)
+            for (int iter = 1; iter <= num_used; ++iter)
             {
                 sum += Wmat(iter, site) * intermed_vector(iter);
             }
@@ -234,6 +254,12 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
 
     auto *Intermed_values = d_Intermed_values_vec.dataPtr();
 
+    /*cleared over its full length, also on processes without field sites,
+     *which still contribute it to the MPI_Allreduce below*/
+    amrex::ParallelFor(Broyden_Threshold_MaxStep,
+                       [=] AMREX_GPU_DEVICE(int iter) noexcept
+                       { intermed_vector(iter) = 0.; });
+
     for (auto &v : h_Intermed_values_vec) v = 0.;
     amrex::Gpu::copy(amrex::Gpu::hostToDevice, h_Intermed_values_vec.begin(),
                      h_Intermed_values_vec.end(),
@@ -244,18 +270,12 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
     {
         case s_Norm_Type::Absolute:
         {
-            const int BTM = Broyden_Threshold_MaxStep;
-            const int SSL = site_size_loc_all_NS;
             amrex::ParallelFor(
                 site_size_loc_all_NS,
                 [=] AMREX_GPU_DEVICE(int site) noexcept
                 {
                     Norm(site) = 0.;
                     sum_vector(site) = 0.;
-                    for (int iter = site; iter < BTM; iter += SSL)
-                    {
-                        intermed_vector(iter) = 0.;
-                    }
 
                     amrex::Real Fcurr = n_curr_in(site) - n_curr_out(site);
                     Norm(site) = fabs(Fcurr);
@@ -276,18 +296,12 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
         }
         case s_Norm_Type::Relative:
         {
-            const int BTM = Broyden_Threshold_MaxStep;
-            const int SSL = site_size_loc_all_NS;
             amrex::ParallelFor(
                 site_size_loc_all_NS,
                 [=] AMREX_GPU_DEVICE(int site) noexcept
                 {
                     Norm(site) = 0.;
                     sum_vector(site) = 0.;
-                    for (int iter = site; iter < BTM; iter += SSL)
-                    {
-                        intermed_vector(iter) = 0.;
-                    }
 
                     amrex::Real Fcurr = n_curr_in(site) - n_curr_out(site);
                     Norm(site) =
@@ -323,14 +337,14 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
     amrex::Real Broyden_Denom = h_Intermed_values[2];
 
     MPI_Allreduce(MPI_IN_PLACE, &Broyden_Norm, 1, MPI_DOUBLE, MPI_MAX,
-                  ParallelDescriptor::Communicator());
+                  ParallelContext::CommunicatorSub());
 
     MPI_Allreduce(MPI_IN_PLACE, &Broyden_NormSum_Curr, 1, MPI_DOUBLE, MPI_SUM,
-                  ParallelDescriptor::Communicator());
+                  ParallelContext::CommunicatorSub());
     Broyden_NormSum_Curr = sqrt(Broyden_NormSum_Curr);
 
     MPI_Allreduce(MPI_IN_PLACE, &Broyden_Denom, 1, MPI_DOUBLE, MPI_SUM,
-                  ParallelDescriptor::Communicator());
+                  ParallelContext::CommunicatorSub());
 
     amrex::Print() << "\n Broyden_NormSum_Curr: " << std::setw(20)
                    << Broyden_NormSum_Curr << "\n";
@@ -345,66 +359,83 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
     /*Swap L2 norms*/
     Broyden_NormSum_Prev = Broyden_NormSum_Curr;
 
-    int m = Broyden_Step - 1;
+    /*m: column of this iteration, after the columns carried over from the
+     *previous bias step, see Reset_Broyden_Parallel. Column m is stored in
+     *slot (m - 1) % num_slots + 1, i.e. once all slots are used, the
+     *newest update replaces the oldest one, see Broyden_history_window.*/
+    int m = Broyden_Step - 1 + Broyden_NumCarriedColumns;
+    const int num_slots = Broyden_Threshold_MaxStep - 1;
+    const int num_used = amrex::min(m, num_slots);
     if (m > 0)
     {
-        /*First, evaluate W*(V^T*deltaF), i.e. Wmat*(VmatTran*delta_F_curr)*/
-        /*Use intermed_vector to temporarily store vector
-         * (VmatTran*delta_F_curr)*/
-
-        amrex::ParallelFor(site_size_loc_all_NS,
-                           [=] AMREX_GPU_DEVICE(int site) noexcept
-                           {
-                               for (int iter = 1; iter <= m - 1; ++iter)
-                               {
-                                   amrex::Real val = VmatTran(site, iter) *
-                                                     delta_F_curr(site);
-                                   amrex::HostDevice::Atomic::Add(
-                                       &(intermed_vector(iter)), val);
-                               }
-                           });
-        h_intermed_vector_data.copy(
-            d_intermed_vector_data); /*from device to host*/
-        amrex::Gpu::streamSynchronize();
-
-        /*Allreduce intermed_vector for complete matrix-vector multiplication*/
-        MPI_Allreduce(MPI_IN_PLACE, &h_intermed_vector(0),
-                      Broyden_Threshold_MaxStep, MPI_Vector_Type, Vector_Add,
-                      ParallelDescriptor::Communicator());
+        const int slot = (m - 1) % num_slots + 1;
+        if (Broyden_Step > 1)
+        {
+            const int num_old = amrex::min(m - 1, num_slots);
+            /*First, evaluate W*(V^T*deltaF),
+             *i.e. Wmat*(VmatTran*delta_F_curr)*/
+            /*Use intermed_vector to temporarily store vector
+             * (VmatTran*delta_F_curr)*/
 
-        d_intermed_vector_data.copy(
-            h_intermed_vector_data); /*from host to device*/
-        amrex::Gpu::streamSynchronize();
+            amrex::ParallelFor(
+                site_size_loc_all_NS,
+                [=] AMREX_GPU_DEVICE(int site) noexcept
+                {
+                    /*drop the update held by the slot of column m*/
+                    VmatTran(site, slot) = 0.;
+                    Wmat(slot, site) = 0.;
 
-        const amrex::Real BF = Broyden_fraction;
-        const amrex::Real Denom = Broyden_Denom;
-        amrex::ParallelFor(site_size_loc_all_NS,
-                           [=] AMREX_GPU_DEVICE(int site) noexcept
-                           {
-                               /*Use sum_vector to temporarily store
-                                * Wmat*intermed_vector */
-                               amrex::Real sum = 0.;
-                               for (int iter = 1; iter <= m - 1; ++iter)
-                               {
-                                   sum +=
-                                       Wmat(iter, site) * intermed_vector(iter);
-                               }
-                               sum_vector(site) = sum;
+                    for (int iter = 1; iter <= num_old; ++iter)
+                    {
+                        amrex::Real val =
+                            VmatTran(site, iter) * delta_F_curr(site);
+                        amrex::HostDevice::Atomic::Add(&(intermed_vector(iter)),
+                                                       val);
+                    }
+                });
+            h_intermed_vector_data.copy(
+                d_intermed_vector_data); /*from device to host*/
+            amrex::Gpu::streamSynchronize();
+
+            /*Allreduce intermed_vector for complete matrix-vector
+             *multiplication*/
+            MPI_Allreduce(MPI_IN_PLACE, &h_intermed_vector(0),
+                          Broyden_Threshold_MaxStep, MPI_Vector_Type,
+                          Vector_Add, ParallelContext::CommunicatorSub());
+
+            d_intermed_vector_data.copy(
+                h_intermed_vector_data); /*from host to device*/
+            amrex::Gpu::streamSynchronize();
+
+            const amrex::Real BF = Broyden_fraction;
+            const amrex::Real Denom = Broyden_Denom;
+            amrex::ParallelFor(
+                site_size_loc_all_NS,
+                [=] AMREX_GPU_DEVICE(int site) noexcept
+                {
+                    /*Use sum_vector to temporarily store
+                     * Wmat*intermed_vector */
+                    amrex::Real sum = 0.;
+                    for (int iter = 1; iter <= num_old; ++iter)
+                    {
+                        sum += Wmat(iter, site) * intermed_vector(iter);
+                    }
+                    sum_vector(site) = sum;
 
-                               /*Evaluate Wmat and VmatTran at iteration m*/
-                               amrex::Real delta_n =
-                                   n_curr_in(site) - n_prev_in(site);
+                    /*Evaluate Wmat and VmatTran at iteration m*/
+                    amrex::Real delta_n = n_curr_in(site) - n_prev_in(site);
 
-                               VmatTran(site, m) = delta_F_curr(site) / Denom;
+                    VmatTran(site, slot) = delta_F_curr(site) / Denom;
 
-                               /*Access to (m,site) will be slower*/
-                               Wmat(m, site) = -BF * delta_F_curr(site) +
-                                               delta_n - sum_vector(site);
-                           });
-        SetVal_RealTable1D(h_intermed_vector_data, 0.);
-        d_intermed_vector_data.copy(
-            h_intermed_vector_data); /*from host to device*/
-        amrex::Gpu::streamSynchronize();
+                    /*Access to (m,site) will be slower*/
+                    Wmat(slot, site) =
+                        -BF * delta_F_curr(site) + delta_n - sum_vector(site);
+                });
+            SetVal_RealTable1D(h_intermed_vector_data, 0.);
+            d_intermed_vector_data.copy(
+                h_intermed_vector_data); /*from host to device*/
+            amrex::Gpu::streamSynchronize();
+        }
 
         /*Next, evaluate W*(V^T*F_curr), i.e. Wmat*(VmatTran*F_curr)*/
         /*Reuse intermed_vector to temporarily store vector (VmatTran*F_curr)*/
@@ -412,7 +443,7 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
         amrex::ParallelFor(site_size_loc_all_NS,
                            [=] AMREX_GPU_DEVICE(int site) noexcept
                            {
-                               for (int iter = 1; iter <= m; ++iter)
+                               for (int iter = 1; iter <= num_used; ++iter)
                                {
                                    amrex::Real val =
                                        VmatTran(site, iter) * F_curr(site);
@@ -436,7 +467,7 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
         /*Allreduce intermed_vector for complete matrix-vector multiplication*/
         MPI_Allreduce(MPI_IN_PLACE, &h_intermed_vector(0),
                       Broyden_Threshold_MaxStep, MPI_Vector_Type, Vector_Add,
-                      ParallelDescriptor::Communicator());
+                      ParallelContext::CommunicatorSub());
 
         d_intermed_vector_data.copy(
             h_intermed_vector_data); /*from host to device*/
@@ -457,7 +488,7 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
                            [=] AMREX_GPU_DEVICE(int site) noexcept
                            {
                                amrex::Real sum = 0.;
-                               for (int iter = 1; iter <= m; ++iter)
+                               for (int iter = 1; iter <= num_used; ++iter)
                                {
                                    sum +=
                                        Wmat(iter, site) * intermed_vector(iter);
@@ -470,7 +501,7 @@ void c_TransportSolver::Execute_Broyden_Modified_Second_Algorithm_Parallel()
     /*Store current n in previous n, predict next n and store it in current n*/
     const amrex::Real BS = Broyden_Scalar;
     const amrex::Real BF = Broyden_fraction;
-    const int my_rank = amrex::ParallelDescriptor::MyProc();
+    const int my_rank = amrex::ParallelContext::MyProcSub();
     amrex::ParallelFor(site_size_loc_all_NS,
                        [=] AMREX_GPU_DEVICE(int site) noexcept
                        {
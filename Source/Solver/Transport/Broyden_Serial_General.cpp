@@ -8,15 +8,20 @@ using namespace amrex;
 void c_TransportSolver::Set_Broyden()
 {
     num_field_sites_all_NS = 0;
-    for (int c = 0; c < vp_CNT.size(); ++c)
+    for (auto &NS_var : vp_NS)
     {
-        num_field_sites_all_NS += vp_CNT[c]->num_field_sites;
+        std::visit(
+            [&](auto &NS)
+            {
+                num_field_sites_all_NS += NS->num_field_sites;
+            },
+            NS_var);
     }
     amrex::Print() << "Number of field_sites at all nanostructures, "
                       "num_field_sites_all_NS: "
                    << num_field_sites_all_NS << "\n";
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         Broyden_Step = 1;
         Broyden_Norm = 1.;
@@ -53,9 +58,14 @@ void c_TransportSolver::Set_Broyden()
         SetVal_RealTable1D(h_delta_n_curr_data, 0.);
 
         /*Need generalization for multiple CNTs*/
-        for (int c = 0; c < vp_CNT.size(); ++c)
+        for (auto &NS_var : vp_NS)
         {
-            h_n_curr_in_data.copy(vp_CNT[c]->h_n_curr_in_data);
+            std::visit(
+                [&](auto &NS)
+                {
+                    h_n_curr_in_data.copy(NS->h_n_curr_in_data);
+                },
+                NS_var);
         }
         h_n_start_in_data.copy(h_n_curr_in_data);
 
@@ -144,7 +154,7 @@ void c_TransportSolver::Reset_Broyden()
                        << NS_initial_deposit_value << "\n";
     }
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         amrex::Print() << "\n\n\n\n**********************************Resetting "
                           "Broyden**********************************\n";
@@ -298,7 +308,7 @@ void c_TransportSolver::Reset_Broyden()
 
 void c_TransportSolver::Deallocate_Broyden_Serial()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         h_n_curr_in_data.clear();
         h_n_prev_in_data.clear();
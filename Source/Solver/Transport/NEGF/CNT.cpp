@@ -7,10 +7,18 @@
 #include <cmath>
 
 #include "../../Utils/CodeUtils/CodeUtil.H"
+#include "../../Utils/SelectWarpXUtils/TextMsg.H"
+#include "Matrix_Block_Util.H"
 
-amrex::Array<int, 2> c_CNT::type_id = {17, 0};
+#define INSTANTIATE_CNT(N) template class c_CNT<N>;
+CNT_FOR_EACH_NUM_MODES(INSTANTIATE_CNT)
+#undef INSTANTIATE_CNT
 
-void c_CNT::Read_NanotubeParameters(amrex::ParmParse &pp_ns)
+template <int N>
+amrex::Array<int, 2> c_CNT<N>::type_id = {17, 0};
+
+template <int N>
+void c_CNT<N>::Read_NanotubeParameters(amrex::ParmParse &pp_ns)
 {
     queryWithParser(pp_ns, "acc", acc);
     queryWithParser(pp_ns, "gamma", gamma);
@@ -20,7 +28,8 @@ void c_CNT::Read_NanotubeParameters(amrex::ParmParse &pp_ns)
     if (typeID_isDefined) type_id = vecToArr_Templated<int, 2>(vec_type_id);
 }
 
-void c_CNT::Set_NanotubeParameters()
+template <int N>
+void c_CNT<N>::Set_NanotubeParameters()
 {
     R_cnt = acc *
             sqrt(3. * (pow(type_id[0], 2) + pow(type_id[1], 2) +
@@ -40,10 +49,11 @@ void c_CNT::Set_NanotubeParameters()
     }
 }
 
-void c_CNT::Read_MaterialSpecificNanostructureProperties()
+template <int N>
+void c_CNT<N>::Read_MaterialSpecificNanostructureProperties()
 {
     amrex::ParmParse pp_ns_default("CNT_default");
-    amrex::ParmParse pp_ns(name);
+    amrex::ParmParse pp_ns(this->name);
     amrex::ParmParse *pp = &pp_ns_default;
 
     amrex::Print() << "##### Reading ParmParse CNT_Default\n";
@@ -52,31 +62,41 @@ void c_CNT::Read_MaterialSpecificNanostructureProperties()
         if (i == 1)
         {
             pp = &pp_ns;
-            amrex::Print() << "##### Reading ParmParse: " << name << "\n";
+            amrex::Print() << "##### Reading ParmParse: " << this->name << "\n";
         }
         Read_NanotubeParameters(*pp);
     }
 }
 
-void c_CNT::Set_MaterialSpecificParameters()
+template <int N>
+void c_CNT<N>::Set_MaterialSpecificParameters()
 {
     Set_NanotubeParameters();
     Define_SortedModeVector();
+
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        int(mode_vec.size()) >= N,
+        "num_modes = " + std::to_string(N) + " exceeds the " +
+            std::to_string(mode_vec.size()) +
+            " distinct modes of this nanotube.");
 }
 
-void c_CNT::Set_BlockDegeneracyVector(amrex::Vector<int> &vec)
+template <int N>
+void c_CNT<N>::Set_BlockDegeneracyVector(amrex::Vector<int> &vec)
 {
-    vec.resize(NUM_MODES);
-    for (int m = 0; m < NUM_MODES; ++m)
+    vec.resize(N);
+    for (int m = 0; m < N; ++m)
     {
         vec[m] = mode_degen_vec[m];
     }
 }
 
-void c_CNT::Print_NanotubeParameters()
+template <int N>
+void c_CNT<N>::Print_NanotubeParameters()
 {
     amrex::Print() << "##### Properties Specific to CNT: \n";
     amrex::Print() << "##### acc: " << acc << "\n";
+    amrex::Print() << "##### num_modes: " << N << "\n";
     amrex::Print() << "##### type_id: ";
     for (int i = 0; i < 2; ++i) amrex::Print() << type_id[i] << "  ";
     amrex::Print() << "\n";
@@ -88,17 +108,22 @@ void c_CNT::Print_NanotubeParameters()
     amrex::Print() << "#####* atoms_per_ring: " << atoms_per_ring << "\n";
 }
 
-void c_CNT::Print_MaterialSpecificReadData() { Print_NanotubeParameters(); }
+template <int N>
+void c_CNT<N>::Print_MaterialSpecificReadData()
+{
+    Print_NanotubeParameters();
+}
 
-s_Position3D c_CNT::get_AtomPosition_ZigZag_CNT(int ring_id, int atom_id)
+template <int N>
+s_Position3D c_CNT<N>::get_AtomPosition_ZigZag_CNT(int ring_id, int atom_id)
 {
     amrex::Real theta = 0;
-    amrex::Real m = static_cast<amrex::Real>(num_atoms_per_field_site);
+    amrex::Real m = static_cast<amrex::Real>(this->num_atoms_per_field_site);
 
     s_Position3D center_offset;
 
     center_offset.dir[0] = 0.;
-    center_offset.dir[1] = -(num_unitcells / 2.) * 3. * acc - acc / 2.;
+    center_offset.dir[1] = -(this->num_unitcells / 2.) * 3. * acc - acc / 2.;
     center_offset.dir[2] = 0.;
 
     s_Position3D pos;
@@ -131,13 +156,14 @@ s_Position3D c_CNT::get_AtomPosition_ZigZag_CNT(int ring_id, int atom_id)
     return pos;
 }
 
-void c_CNT::Generate_AtomLocations(amrex::Vector<s_Position3D> &pos)
+template <int N>
+void c_CNT<N>::Generate_AtomLocations(amrex::Vector<s_Position3D> &pos)
 {
-    int m = num_atoms_per_field_site;
+    int m = this->num_atoms_per_field_site;
     int counter = 0;
-    for (int i = 0; i < num_field_sites; ++i)
+    for (int i = 0; i < this->num_field_sites; ++i)
     {
-        for (int j = 0; j < num_atoms_per_field_site; ++j)
+        for (int j = 0; j < this->num_atoms_per_field_site; ++j)
         {
             pos[i * m + j] = get_AtomPosition_ZigZag_CNT(i, j);
             counter += 1;
@@ -149,10 +175,11 @@ void c_CNT::Generate_AtomLocations(amrex::Vector<s_Position3D> &pos)
             //                                  "\n";
         }
     }
-    c_NEGF_Common<BlkType>::Generate_AtomLocations(pos);
+    Base::Generate_AtomLocations(pos);
 }
 
-amrex::Real c_CNT::Get_Bandgap_Of_Mode(int p)
+template <int N>
+amrex::Real c_CNT<N>::Get_Bandgap_Of_Mode(int p)
 {
     int m = type_id[0];
     int n = type_id[1];
@@ -224,7 +251,8 @@ void quickSort(amrex::Vector<amrex::Real> &vec, amrex::Vector<int> &mode_vec,
     }
 }
 
-void c_CNT::Define_SortedModeVector()
+template <int N>
+void c_CNT<N>::Define_SortedModeVector()
 {
     amrex::Vector<amrex::Real> Eg_vec;
     Eg_vec.resize(atoms_per_ring);
@@ -285,32 +313,35 @@ void c_CNT::Define_SortedModeVector()
     mode_index_vec.clear();
 }
 
-ComplexType c_CNT::get_beta(int J)
+template <int N>
+ComplexType c_CNT<N>::get_beta(int J)
 {
     ComplexType arg(0., -MathConst::pi * J / type_id[0]);
     return 2. * gamma * cos(-1 * arg.imag());  // * exp(arg);
 }
 
-void c_CNT::Define_MPI_BlkType()
+template <int N>
+void c_CNT<N>::Define_MPI_BlkType()
 {
-    MPI_Type_vector(1, NUM_MODES, NUM_MODES, MPI_DOUBLE_COMPLEX, &MPI_BlkType);
-    MPI_Type_commit(&MPI_BlkType);
+    MPI_Type_vector(1, N, N, MPI_DOUBLE_COMPLEX, &this->MPI_BlkType);
+    MPI_Type_commit(&this->MPI_BlkType);
 }
 
-void c_CNT::Construct_Hamiltonian()
+template <int N>
+void c_CNT<N>::Construct_Hamiltonian()
 {
     /*Here we define -H0 where H0 is Hamiltonian of flat bands*/
 
-    auto const &h_minusHa = h_minusHa_loc_data.table();
-    auto const &h_Hb = h_Hb_loc_data.table();
-    auto const &h_Hc = h_Hc_loc_data.table();
+    auto const &h_minusHa = this->h_minusHa_loc_data.table();
+    auto const &h_Hb = this->h_Hb_loc_data.table();
+    auto const &h_Hc = this->h_Hc_loc_data.table();
 
-    for (std::size_t i = 0; i < blkCol_size_loc; ++i)
+    for (std::size_t i = 0; i < this->blkCol_size_loc; ++i)
     {
         h_minusHa(i) = 0.;
     }
 
-    for (int j = 0; j < NUM_MODES; ++j)
+    for (int j = 0; j < N; ++j)
     {
         int J = mode_vec[j];
         beta.block[j] = get_beta(J);
@@ -318,9 +349,9 @@ void c_CNT::Construct_Hamiltonian()
     // amrex::Print() << "\n Printing beta: "<< "\n";
     // amrex::Print() << beta << "\n";
 
-    for (std::size_t i = 0; i < offDiag_repeatBlkSize; ++i)
+    for (std::size_t i = 0; i < this->offDiag_repeatBlkSize; ++i)
     {
-        if (i % offDiag_repeatBlkSize == 0)
+        if (i % this->offDiag_repeatBlkSize == 0)
         {
             h_Hb(i) = -1 * beta; /*negative sign because (E[I] - [H]) will have
                                     negative B and C*/
@@ -334,30 +365,31 @@ void c_CNT::Construct_Hamiltonian()
     }
 }
 
-void c_CNT::Define_ContactInfo()
+template <int N>
+void c_CNT<N>::Define_ContactInfo()
 {
     /*define arrays depending on Hsize_glo*/
-    global_contact_index[0] = 0;
-    global_contact_index[1] = Hsize_glo - 1;
-    contact_transmission_index[0] = Hsize_glo - 1;
-    contact_transmission_index[1] = 0;
+    this->global_contact_index[0] = 0;
+    this->global_contact_index[1] = this->Hsize_glo - 1;
+    this->contact_transmission_index[0] = this->Hsize_glo - 1;
+    this->contact_transmission_index[1] = 0;
 
     /*define tau*/
-    auto const &h_tau = h_tau_glo_data.table();
+    auto const &h_tau = this->h_tau_glo_data.table();
     for (std::size_t c = 0; c < NUM_CONTACTS; ++c)
     {
         h_tau(c) = gamma;
     }
 }
 
-AMREX_GPU_HOST_DEVICE
-void c_CNT::Compute_SurfaceGreensFunction(MatrixBlock<BlkType> &gr,
-                                          const ComplexType EmU)
+template <int N>
+AMREX_GPU_HOST_DEVICE void c_CNT<N>::Compute_SurfaceGreensFunction(
+    MatrixBlock<BlkType> &gr, const ComplexType EmU)
 {
     auto EmU_sq = pow(EmU, 2.);
     auto gamma_sq = pow(gamma, 2.);
 
-    for (int i = 0; i < NUM_MODES; ++i)
+    for (int i = 0; i < N; ++i)
     {
         auto Factor = EmU_sq + gamma_sq - pow(beta.block[i], 2);
 
@@ -381,3 +413,23 @@ void c_CNT::Compute_SurfaceGreensFunction(MatrixBlock<BlkType> &gr,
         // amrex::Print() << "Value: " << (Factor+Sqrt)/Denom << "\n";
     }
 }
+
+template <int N>
+void c_CNT<N>::Condense_Lead(s_CondensedLead<BlkType> &lead,
+                             const ComplexType EmU)
+{
+    /*The lead alternates beta and gamma bonds between the rings. Decimating
+     *every second ring leaves a chain of rings coupled through beta*g*gamma
+     *with g = 1/EmU, the GF of the decimated ring.*/
+    ComplexType one(1., 0.);
+    ComplexType g = one / EmU;
+    auto gamma_sq = pow(gamma, 2.);
+
+    for (int i = 0; i < N; ++i)
+    {
+        lead.Alpha_s.block[i] = EmU - pow(beta.block[i], 2) * g;
+        lead.Alpha_b.block[i] = lead.Alpha_s.block[i] - gamma_sq * g;
+        lead.c.block[i] = -1. * beta.block[i] * gamma * g;
+        lead.b.block[i] = lead.c.block[i];
+    }
+}
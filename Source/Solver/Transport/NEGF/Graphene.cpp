@@ -7,5 +7,285 @@
 #include <cmath>
 
 #include "../../Utils/CodeUtils/CodeUtil.H"
+#include "../../Utils/SelectWarpXUtils/TextMsg.H"
+#include "Matrix_Block_Util.H"
 
-amrex::Array<int, 2> c_Graphene::type_id;
+#define INSTANTIATE_GRAPHENE(W) template class c_Graphene<W>;
+GRAPHENE_FOR_EACH_WIDTH(INSTANTIATE_GRAPHENE)
+#undef INSTANTIATE_GRAPHENE
+
+template <int W>
+void c_Graphene<W>::Read_RibbonParameters(amrex::ParmParse &pp_ns)
+{
+    queryWithParser(pp_ns, "acc", acc);
+    queryWithParser(pp_ns, "gamma", gamma);
+    queryWithParser(pp_ns, "edge_correction", edge_correction);
+    queryWithParser(pp_ns, "num_dimer_lines", num_dimer_lines);
+}
+
+template <int W>
+void c_Graphene<W>::Set_RibbonParameters()
+{
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        num_dimer_lines == 2 * W,
+        "num_dimer_lines = " + std::to_string(num_dimer_lines) +
+            " does not match the block size " + std::to_string(W) +
+            " of this ribbon.");
+
+    amrex::Real gamma_edge = gamma * (1. + edge_correction);
+
+    for (int k = 0; k < slices_per_unitcell; ++k)
+    {
+        H_bond[k] = 0.;
+    }
+    for (int j = 0; j < W; ++j)
+    {
+        H_bond[0].block[j][j] = gamma;
+        if (j > 0) H_bond[0].block[j][j - 1] = gamma;
+
+        H_bond[1].block[j][j] = (j == W - 1) ? gamma_edge : gamma;
+
+        H_bond[2].block[j][j] = gamma;
+        if (j < W - 1) H_bond[2].block[j][j + 1] = gamma;
+
+        H_bond[3].block[j][j] = (j == 0) ? gamma_edge : gamma;
+    }
+}
+
+template <int W>
+void c_Graphene<W>::Read_MaterialSpecificNanostructureProperties()
+{
+    amrex::ParmParse pp_ns_default("Graphene_default");
+    amrex::ParmParse pp_ns(this->name);
+    amrex::ParmParse *pp = &pp_ns_default;
+
+    amrex::Print() << "##### Reading ParmParse Graphene_Default\n";
+    for (int i = 0; i < 2; ++i)
+    {
+        if (i == 1)
+        {
+            pp = &pp_ns;
+            amrex::Print() << "##### Reading ParmParse: " << this->name << "\n";
+        }
+        Read_RibbonParameters(*pp);
+    }
+}
+
+template <int W>
+void c_Graphene<W>::Set_MaterialSpecificParameters()
+{
+    Set_RibbonParameters();
+}
+
+template <int W>
+void c_Graphene<W>::Set_BlockDegeneracyVector(amrex::Vector<int> &vec)
+{
+    vec.resize(W);
+    for (int m = 0; m < W; ++m)
+    {
+        vec[m] = 1;
+    }
+}
+
+template <int W>
+void c_Graphene<W>::Print_RibbonParameters()
+{
+    amrex::Print() << "##### Properties Specific to Graphene: \n";
+    amrex::Print() << "##### acc: " << acc << "\n";
+    amrex::Print() << "##### gamma: " << gamma << "\n";
+    amrex::Print() << "##### edge_correction: " << edge_correction << "\n";
+    amrex::Print() << "##### num_dimer_lines: " << num_dimer_lines << "\n";
+    amrex::Print() << "#####* atoms_per_slice: " << W << "\n";
+    amrex::Print() << "#####* slices_per_unitcell: " << slices_per_unitcell
+                   << "\n";
+    amrex::Print() << "#####* W_gnr / (nm): "
+                   << (num_dimer_lines - 1) * sqrt(3.) / 2. * acc / 1.e-9
+                   << "\n";
+}
+
+template <int W>
+void c_Graphene<W>::Print_MaterialSpecificReadData()
+{
+    Print_RibbonParameters();
+}
+
+template <int W>
+s_Position3D c_Graphene<W>::get_AtomPosition_Armchair_GNR(int slice_id,
+                                                          int atom_id)
+{
+    /*dimer lines are sqrt(3)*acc/2 apart across the width*/
+    amrex::Real a_x = sqrt(3.) * acc;
+
+    s_Position3D center_offset;
+
+    center_offset.dir[0] = -(num_dimer_lines - 1) * a_x / 4.;
+    center_offset.dir[1] = -(this->num_unitcells / 2.) * 3. * acc - acc / 2.;
+    center_offset.dir[2] = 0.;
+
+    s_Position3D pos;
+
+    int unit_cell_id = slice_id / slices_per_unitcell;
+    amrex::Real unit_cell_offset = 3 * acc * unit_cell_id;
+
+    if (slice_id % slices_per_unitcell == 0)
+        pos.dir[1] = acc + unit_cell_offset;
+    if (slice_id % slices_per_unitcell == 1)
+        pos.dir[1] = 1.5 * acc + unit_cell_offset;
+    if (slice_id % slices_per_unitcell == 2)
+        pos.dir[1] = 2.5 * acc + unit_cell_offset;
+    if (slice_id % slices_per_unitcell == 3)
+        pos.dir[1] = 3 * acc + unit_cell_offset;
+
+    if (slice_id % 4 == 0 or slice_id % 4 == 3)
+    {
+        pos.dir[0] = atom_id * a_x;
+    }
+    else
+    {
+        pos.dir[0] = (atom_id + 0.5) * a_x;
+    }
+
+    pos.dir[0] += center_offset.dir[0];
+    pos.dir[1] += center_offset.dir[1];
+    pos.dir[2] = center_offset.dir[2];
+
+    return pos;
+}
+
+template <int W>
+void c_Graphene<W>::Generate_AtomLocations(amrex::Vector<s_Position3D> &pos)
+{
+    for (int i = 0; i < this->num_field_sites; ++i)
+    {
+        for (int j = 0; j < W; ++j)
+        {
+            pos[i * W + j] = get_AtomPosition_Armchair_GNR(i, j);
+        }
+    }
+    Base::Generate_AtomLocations(pos);
+}
+
+template <int W>
+void c_Graphene<W>::Define_MPI_BlkType()
+{
+    MPI_Type_vector(1, W * W, W * W, MPI_DOUBLE_COMPLEX, &this->MPI_BlkType);
+    MPI_Type_commit(&this->MPI_BlkType);
+}
+
+template <int W>
+void c_Graphene<W>::Construct_Hamiltonian()
+{
+    /*-H0 of the slices is zero, there are no bonds within a slice.
+     *Hb and Hc are the blocks of (E[I] - [H]) below and above the diagonal,
+     *i.e. the negative hopping blocks.*/
+    auto const &h_minusHa = this->h_minusHa_loc_data.table();
+    auto const &h_Hb = this->h_Hb_loc_data.table();
+    auto const &h_Hc = this->h_Hc_loc_data.table();
+
+    for (std::size_t i = 0; i < this->blkCol_size_loc; ++i)
+    {
+        h_minusHa(i) = 0.;
+    }
+
+    for (std::size_t i = 0; i < this->offDiag_repeatBlkSize; ++i)
+    {
+        h_Hc(i) = -1 * H_bond[i];
+        h_Hb(i) = -1 * H_bond[i].Tran();
+    }
+}
+
+template <int W>
+void c_Graphene<W>::Define_ContactInfo()
+{
+    /*define arrays depending on Hsize_glo*/
+    this->global_contact_index[0] = 0;
+    this->global_contact_index[1] = this->Hsize_glo - 1;
+    this->contact_transmission_index[0] = this->Hsize_glo - 1;
+    this->contact_transmission_index[1] = 0;
+
+    /*Both contacts couple through the straight bonds from slice 3 to 0.
+     *The ribbon is symmetric under y -> -y, which maps the left lead onto
+     *the right one with the atom order unchanged, so that both leads have
+     *the surface GF of Compute_SurfaceGreensFunction.*/
+    auto const &h_tau = this->h_tau_glo_data.table();
+    for (std::size_t c = 0; c < NUM_CONTACTS; ++c)
+    {
+        h_tau(c) = H_bond[slices_per_unitcell - 1];
+    }
+}
+
+template <int W>
+AMREX_GPU_HOST_DEVICE void c_Graphene<W>::Condense_Ribbon(
+    s_CondensedLead<BlkType> &lead, const ComplexType EmU) const
+{
+    /*Condenses a semi-infinite ribbon starting with a slice of type 0.
+     *The slices 1, 2 and 3 of a unit cell are decimated one at a time,
+     *leaving a chain of the type-0 slices with the blocks
+     * Alpha_s = EmU - Sigma_R (surface slice),
+     * Alpha_b = EmU - Sigma_R - Sigma_L (bulk slice),
+     * c, b: coupling to and from the next type-0 slice.*/
+    ComplexType one(1., 0.);
+
+    MatrixBlock<BlkType> Hc[slices_per_unitcell];
+    MatrixBlock<BlkType> Hb[slices_per_unitcell];
+    for (int k = 0; k < slices_per_unitcell; ++k)
+    {
+        Hc[k] = -1 * H_bond[k];
+        Hb[k] = -1 * H_bond[k].Tran();
+    }
+
+    /*A_mm: slice to be decimated, A_0m and A_m0: its coupling to slice 0*/
+    MatrixBlock<BlkType> A_mm, A_0m, A_m0;
+    MatrixBlock<BlkType> Sigma_R, Sigma_L;
+    A_mm = EmU;
+    A_0m = Hc[0];
+    A_m0 = Hb[0];
+    Sigma_R = 0.;
+
+    for (int k = 1; k < slices_per_unitcell; ++k)
+    {
+        MatrixBlock<BlkType> G_mm = one / A_mm;
+        MatrixBlock<BlkType> G_Hc = G_mm * Hc[k];
+        MatrixBlock<BlkType> Hb_G = Hb[k] * G_mm;
+
+        Sigma_R = Sigma_R + A_0m * G_mm * A_m0;
+
+        if (k < slices_per_unitcell - 1)
+        {
+            A_mm = EmU - Hb[k] * G_Hc;
+            A_0m = -1 * (A_0m * G_Hc);
+            A_m0 = -1 * (Hb_G * A_m0);
+        }
+        else
+        {
+            /*slice k+1 is slice 0 of the next unit cell*/
+            Sigma_L = Hb[k] * G_Hc;
+            lead.c = -1 * (A_0m * G_Hc);
+            lead.b = -1 * (Hb_G * A_m0);
+        }
+    }
+
+    lead.Alpha_s = EmU - Sigma_R;
+    lead.Alpha_b = lead.Alpha_s - Sigma_L;
+}
+
+template <int W>
+void c_Graphene<W>::Condense_Lead(s_CondensedLead<BlkType> &lead,
+                                  const ComplexType EmU)
+{
+    Condense_Ribbon(lead, EmU);
+}
+
+template <int W>
+AMREX_GPU_HOST_DEVICE void c_Graphene<W>::Compute_SurfaceGreensFunction(
+    MatrixBlock<BlkType> &gr, const ComplexType EmU)
+{
+    /*The condensed chain is decimated with the Lopez Sancho-Rubio scheme,
+     *such that the cost is O(W^3 log(1/Im(E))) per energy.*/
+    s_CondensedLead<BlkType> lead;
+    Condense_Ribbon(lead, EmU);
+
+    int max_iter = Decimation_IterationCap(
+        lead, EmU, this->surface_GF_max_iter, this->surface_GF_tol);
+    Compute_SurfaceGF_Decimation(gr, lead, max_iter, this->surface_GF_tol);
+}
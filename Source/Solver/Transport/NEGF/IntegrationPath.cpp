@@ -36,6 +36,7 @@ void c_IntegrationPath::Reset()
     weight_vec.clear();
     mul_factor_vec.clear();
     E_vec.clear();
+    weight_gauss_vec.clear();
 }
 
 void c_IntegrationPath::Define_GaussLegendrePoints(const ComplexType min,
@@ -166,3 +167,57 @@ void c_IntegrationPath::Define_RegularPoints(ComplexType min, ComplexType max,
         mul_factor_vec[i] = 1.;
     }
 }
+
+void c_IntegrationPath::Define_GaussKronrodPoints(const ComplexType min,
+                                                  const ComplexType max)
+{
+    /*15-point Kronrod rule with the embedded 7-point Gauss rule on a line.
+     *The difference of the two estimates is used as the error estimate of
+     *the interval. Nodes and weights are those of QUADPACK's qk15.*/
+    constexpr int num_half = 8;
+    const amrex::Real xgk[num_half] = {
+        0.991455371120812639206854697526329,
+        0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926,
+        0.741531185599394439863864773280788,
+        0.586087235467691130294144845693013,
+        0.405845151377397166906606412076961,
+        0.207784955007898467600689403773245,
+        0.000000000000000000000000000000000};
+    const amrex::Real wgk[num_half] = {
+        0.022935322010529224963732008058970,
+        0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518,
+        0.140653259715525918745189590510238,
+        0.169004726639267902826583426598550,
+        0.190350578064785409913256402421014,
+        0.204432940075298892414161999234649,
+        0.209482141084727828012999174891714};
+    /*Gauss weights at the odd entries of xgk*/
+    const amrex::Real wg[num_half] = {0., 0.129484966168869693270611432679082,
+                                      0., 0.279705391489276667901467771423780,
+                                      0., 0.381830050505118944950369775488975,
+                                      0., 0.417959183673469387755102040816327};
+
+    Reset();
+    E_min = min;
+    E_max = max;
+    num_pts = 2 * num_half - 1;
+
+    E_vec.resize(num_pts);
+    mul_factor_vec.resize(num_pts);
+    weight_vec.resize(num_pts);
+    weight_gauss_vec.resize(num_pts);
+
+    for (int i = 0; i < num_pts; ++i)
+    {
+        /*nodes are ordered from min to max*/
+        int j = (i < num_half) ? i : num_pts - 1 - i;
+        amrex::Real x = (i < num_half) ? -xgk[j] : xgk[j];
+
+        E_vec[i] = (max - min) * 0.5 * x + (max + min) * 0.5;
+        mul_factor_vec[i] = (max - min) * 0.5;
+        weight_vec[i] = wgk[j];
+        weight_gauss_vec[i] = wg[j];
+    }
+}
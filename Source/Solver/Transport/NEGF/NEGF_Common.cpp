@@ -1,14 +1,26 @@
 #include "NEGF_Common.H"
 
+#include <AMReX_OpenMP.H>
+
+#include <algorithm>
+#include <cmath>
+
 #include "../../Utils/CodeUtils/CodeUtil.H"
+#include "../../Utils/CodeUtils/Ensemble.H"
 #include "../../Utils/SelectWarpXUtils/TextMsg.H"
 #include "../../Utils/SelectWarpXUtils/WarpXConst.H"
 #include "../../Utils/SelectWarpXUtils/WarpXUtil.H"
 #include "Matrix_Block_Util.H"
 
 /*Explicit specializations*/
-template class c_NEGF_Common<ComplexType[NUM_MODES]>;             // of c_CNT
-template class c_NEGF_Common<ComplexType[NUM_MODES][NUM_MODES]>;  // c_Graphene
+#define INSTANTIATE_NEGF_COMMON_CNT(N) \
+    template class c_NEGF_Common<ComplexType[N]>; /*of c_CNT<N>*/
+CNT_FOR_EACH_NUM_MODES(INSTANTIATE_NEGF_COMMON_CNT)
+#undef INSTANTIATE_NEGF_COMMON_CNT
+#define INSTANTIATE_NEGF_COMMON_GRAPHENE(W) \
+    template class c_NEGF_Common<ComplexType[W][W]>; /*of c_Graphene<W>*/
+GRAPHENE_FOR_EACH_WIDTH(INSTANTIATE_NEGF_COMMON_GRAPHENE)
+#undef INSTANTIATE_NEGF_COMMON_GRAPHENE
 
 const std::map<std::string, AngleType> map_strToAngleType = {
     {"d", AngleType::Degrees},
@@ -32,8 +44,36 @@ void c_NEGF_Common<T>::Set_KeyParams(const std::string &name_str,
     NS_field_sites_offset = field_sites_offset;
     initial_charge = initial_deposit_value;
 
-    num_proc = amrex::ParallelDescriptor::NProcs();
-    my_rank = amrex::ParallelDescriptor::MyProc();
+    num_proc = amrex::ParallelContext::NProcsSub();
+    my_rank = amrex::ParallelContext::MyProcSub();
+
+    /*all processes solve this nanostructure unless Set_ProcessRange is
+     *called*/
+    NS_Comm = amrex::ParallelContext::CommunicatorSub();
+    NS_rank_begin = 0;
+    num_proc_NS = num_proc;
+    NS_rank = my_rank;
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Set_ProcessRange(const int rank_begin, const int nproc)
+{
+    /*Must be called by all processes, before Initialize_NEGF.*/
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        rank_begin >= 0 and nproc > 0 and rank_begin + nproc <= num_proc,
+        "Invalid process range for nanostructure " + name);
+
+    NS_rank_begin = rank_begin;
+    num_proc_NS = nproc;
+
+    bool is_member = my_rank >= rank_begin and my_rank < rank_begin + nproc;
+    NS_rank = is_member ? my_rank - rank_begin : -1;
+
+    MPI_Comm_split(ParallelContext::CommunicatorSub(),
+                   is_member ? 0 : MPI_UNDEFINED, my_rank, &NS_Comm);
+
+    amrex::Print() << "#####* " << name << " solved on processes "
+                   << rank_begin << " to " << rank_begin + nproc - 1 << "\n";
 }
 
 template <typename T>
@@ -46,11 +86,13 @@ void c_NEGF_Common<T>::Define_FoldersAndFiles(
     step_filename_prefix_str = step_foldername_str + "/step";
     /*eg. output/negf/cnt/step */
 
-    if (ParallelDescriptor::IOProcessor())
+    current_filename_str =
+        c_Ensemble::Get_GroupFilename(step_foldername_str + "/I.dat");
+    /*written by the root of NS_Comm, see Write_Current*/
+
+    if (ParallelContext::IOProcessorSub())
     {
         CreateDirectory(step_foldername_str);
-
-        current_filename_str = step_foldername_str + "/I.dat";
     }
 
     Define_FileHeaderForCurrent();
@@ -59,7 +101,7 @@ void c_NEGF_Common<T>::Define_FoldersAndFiles(
 template <typename T>
 void c_NEGF_Common<T>::Define_FileHeaderForCurrent()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         outfile_I.open(current_filename_str.c_str(), std::ios::app);
         outfile_I << "'step', 'Vds' , 'Vgs', ";
@@ -133,7 +175,7 @@ void c_NEGF_Common<T>::Set_IterationFilenameString(const int iter)
 template <typename T>
 void c_NEGF_Common<T>::Define_MPISendCountAndDisp()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         MPI_send_count.resize(num_proc);
         MPI_send_disp.resize(num_proc);
@@ -142,12 +184,12 @@ void c_NEGF_Common<T>::Define_MPISendCountAndDisp()
         std::fill(MPI_send_disp.begin(), MPI_send_disp.end(), 0);
     }
     MPI_Gather(&(site_id_offset), 1, MPI_INT, MPI_send_disp.data(), 1, MPI_INT,
-               ParallelDescriptor::IOProcessorNumber(),
-               ParallelDescriptor::Communicator());
+               ParallelContext::IOProcessorNumberSub(),
+               ParallelContext::CommunicatorSub());
 
     MPI_Gather(&(num_local_field_sites), 1, MPI_INT, MPI_send_count.data(), 1,
-               MPI_INT, ParallelDescriptor::IOProcessorNumber(),
-               ParallelDescriptor::Communicator());
+               MPI_INT, ParallelContext::IOProcessorNumberSub(),
+               ParallelContext::CommunicatorSub());
 
     // if(ParallelDescriptor::IOProcessor())
     //{
@@ -173,14 +215,15 @@ void c_NEGF_Common<T>::Initialize_ChargeAtFieldSites()
         h_n_curr_in_glo_data.resize({0}, {num_field_sites}, The_Pinned_Arena());
         auto const &h_n_curr_in_glo = h_n_curr_in_glo_data.table();
 
-        if (ParallelDescriptor::IOProcessor()) /*&*/
+        if (ParallelContext::IOProcessorSub()) /*&*/
         {
             Read_Table1D(num_field_sites, h_n_curr_in_glo_data,
                          charge_distribution_filename);
         }
 
         ParallelDescriptor::Bcast(&h_n_curr_in_glo(0), Hsize_glo,
-                                  ParallelDescriptor::IOProcessorNumber());
+                                  ParallelContext::IOProcessorNumberSub(),
+                                  ParallelContext::CommunicatorSub());
 
         // h_n_curr_in_glo exists temporarily until Broyden's algorithm is
         // initialized with the input charge in Set_Broyden_Parallel. It is
@@ -191,8 +234,8 @@ void c_NEGF_Common<T>::Initialize_ChargeAtFieldSites()
         MPI_Scatterv(&h_n_curr_in_glo(0), MPI_send_count.data(),
                      MPI_send_disp.data(), MPI_DOUBLE, &h_n_curr_in_loc(0),
                      num_local_field_sites, MPI_DOUBLE,
-                     ParallelDescriptor::IOProcessorNumber(),
-                     ParallelDescriptor::Communicator());
+                     ParallelContext::IOProcessorNumberSub(),
+                     ParallelContext::CommunicatorSub());
 
         // if(ParallelDescriptor::IOProcessor())  /*&*/
         //{
@@ -499,6 +542,10 @@ void c_NEGF_Common<T>::Read_AdaptiveIntegrationParams(amrex::ParmParse &pp_ns)
         pp_ns.query("integrand_correction_interval",
                     integrand_correction_interval);
 
+        queryWithParser(pp_ns, "noneq_prescan_pts", noneq_prescan_pts);
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(noneq_prescan_pts > 2,
+                                         "noneq_prescan_pts must be > 2.");
+
         auto flag_kT_window_around_singularity =
             queryArrWithParser(pp_ns, "kT_window_around_singularity",
                                kT_window_around_singularity, 0, 2);
@@ -593,6 +640,157 @@ template <typename T>
 void c_NEGF_Common<T>::Read_RecursiveOptimizationParams(amrex::ParmParse &pp_ns)
 {
     queryWithParser(pp_ns, "num_recursive_parts", num_recursive_parts);
+    pp_ns.query("flag_replicate_diagonal", flag_replicate_diagonal);
+    pp_ns.query("flag_parallel_recursion", flag_parallel_recursion);
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        !flag_parallel_recursion or std::rank_v<T> == 1,
+        "flag_parallel_recursion requires commuting, i.e. diagonal, blocks "
+        "and is not supported for dense blocks, see NEGF_Common.H.");
+    queryWithParser(pp_ns, "energy_batch_size", energy_batch_size);
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(energy_batch_size > 0,
+                                     "energy_batch_size must be positive.");
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        !(flag_parallel_recursion and energy_batch_size > 1),
+        "energy_batch_size > 1 runs the recursion over all columns for each "
+        "energy and cannot be combined with flag_parallel_recursion.");
+#if defined(COMPUTE_GREENS_FUNCTION_OFFDIAG_ELEMS) || \
+    defined(COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS)
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        energy_batch_size == 1,
+        "energy_batch_size > 1 is not supported when off-diagonal elements "
+        "of G or A are computed.");
+#endif
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Read_EnergyParallelizationParams(amrex::ParmParse &pp_ns)
+{
+    queryWithParser(pp_ns, "num_energy_groups", num_energy_groups);
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Read_CurrentParams(amrex::ParmParse &pp_ns)
+{
+    pp_ns.query("flag_fuse_current_with_charge",
+                flag_fuse_current_with_charge);
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        !(flag_fuse_current_with_charge and energy_batch_size > 1),
+        "flag_fuse_current_with_charge requires energy_batch_size = 1.");
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Read_AdaptiveQuadratureParams(amrex::ParmParse &pp_ns)
+{
+    pp_ns.query("flag_noneq_adaptive_quadrature",
+                flag_noneq_adaptive_quadrature);
+    if (flag_noneq_adaptive_quadrature)
+    {
+        queryWithParser(pp_ns, "noneq_adaptive_tolerance",
+                        noneq_adaptive_tolerance);
+        queryWithParser(pp_ns, "noneq_adaptive_initial_intervals",
+                        noneq_adaptive_initial_intervals);
+        queryWithParser(pp_ns, "noneq_adaptive_max_rounds",
+                        noneq_adaptive_max_rounds);
+        queryWithParser(pp_ns, "noneq_adaptive_max_intervals",
+                        noneq_adaptive_max_intervals);
+        queryWithParser(pp_ns, "noneq_adaptive_coarsen_fraction",
+                        noneq_adaptive_coarsen_fraction);
+
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+            noneq_adaptive_tolerance > 0.,
+            "noneq_adaptive_tolerance must be > 0.");
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+            noneq_adaptive_initial_intervals > 0 and
+                noneq_adaptive_max_rounds > 0 and
+                noneq_adaptive_max_intervals >=
+                    noneq_adaptive_initial_intervals,
+            "noneq_adaptive_initial_intervals and noneq_adaptive_max_rounds "
+            "must be > 0, and noneq_adaptive_max_intervals must not be less "
+            "than noneq_adaptive_initial_intervals.");
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+            noneq_adaptive_coarsen_fraction >= 0. and
+                noneq_adaptive_coarsen_fraction < 1.,
+            "noneq_adaptive_coarsen_fraction must be in [0, 1).");
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+            energy_batch_size == 1 and !flag_fuse_current_with_charge and
+                !flag_adaptive_integration_limits,
+            "flag_noneq_adaptive_quadrature cannot be combined with "
+            "energy_batch_size > 1, flag_fuse_current_with_charge or "
+            "flag_adaptive_integration_limits.");
+    }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Read_PoleExpansionParams(amrex::ParmParse &pp_ns)
+{
+    pp_ns.query("flag_eq_pole_expansion", flag_eq_pole_expansion);
+    if (flag_eq_pole_expansion)
+    {
+        queryWithParser(pp_ns, "num_eq_poles", num_eq_poles);
+        queryWithParser(pp_ns, "eq_pole_expansion_tolerance",
+                        eq_pole_expansion_tolerance);
+
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(num_eq_poles > 0,
+                                         "num_eq_poles must be > 0.");
+        WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+            energy_batch_size == 1,
+            "flag_eq_pole_expansion requires energy_batch_size = 1.");
+    }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Read_SurfaceGFParams(amrex::ParmParse &pp_ns)
+{
+    std::string method_str;
+    if (pp_ns.query("surface_GF_method", method_str))
+    {
+        if (method_str == "material" or method_str == "Material" or
+            method_str == "MATERIAL")
+        {
+            surface_GF_method = s_SurfaceGF_Method::Material;
+        }
+        else if (method_str == "eigenfunction" or
+                 method_str == "Eigenfunction" or
+                 method_str == "EIGENFUNCTION")
+        {
+            surface_GF_method = s_SurfaceGF_Method::Eigenfunction;
+        }
+        else if (method_str == "decimation" or method_str == "Decimation" or
+                 method_str == "DECIMATION")
+        {
+            surface_GF_method = s_SurfaceGF_Method::Decimation;
+        }
+        else
+        {
+            amrex::Abort("surface_GF_method '" + method_str +
+                         "' is not supported. Use material, eigenfunction "
+                         "or decimation.");
+        }
+    }
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        surface_GF_method != s_SurfaceGF_Method::Eigenfunction or
+            std::rank_v<T> == 1,
+        "surface_GF_method = eigenfunction requires diagonal blocks. Use "
+        "decimation for dense blocks.");
+
+    queryWithParser(pp_ns, "surface_GF_max_iter", surface_GF_max_iter);
+    queryWithParser(pp_ns, "surface_GF_tol", surface_GF_tol);
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        surface_GF_max_iter > 0 and surface_GF_tol > 0.,
+        "surface_GF_max_iter and surface_GF_tol must be > 0.");
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Read_ContactSelfEnergyCacheParams(
+    amrex::ParmParse &pp_ns)
+{
+    pp_ns.query("flag_cache_contact_self_energy",
+                flag_cache_contact_self_energy);
+    queryWithParser(pp_ns, "contact_self_energy_cache_size",
+                    contact_self_energy_cache_size);
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        contact_self_energy_cache_size > 0,
+        "contact_self_energy_cache_size must be > 0.");
 }
 
 template <typename T>
@@ -644,6 +842,12 @@ void c_NEGF_Common<T>::Read_CommonData(amrex::ParmParse &pp)
     Read_WritingRelatedFlags(pp);
     Read_AtomLocationAndChargeDistributionFilename(pp);
     Read_RecursiveOptimizationParams(pp);
+    Read_EnergyParallelizationParams(pp);
+    Read_CurrentParams(pp);
+    Read_AdaptiveQuadratureParams(pp);
+    Read_PoleExpansionParams(pp);
+    Read_SurfaceGFParams(pp);
+    Read_ContactSelfEnergyCacheParams(pp);
 }
 
 template <typename T>
@@ -680,6 +884,7 @@ void c_NEGF_Common<T>::Set_MaterialParameters()
     primary_transport_dir = Set_PrimaryTransportDir();
     average_field_flag = Set_AverageFieldFlag();
     offDiag_repeatBlkSize = get_offDiag_repeatBlkSize();
+    Hsize_glo = get_Hsize();
 
     if (average_field_flag) num_atoms_to_avg_over = Compute_NumAtomsToAvgOver();
 
@@ -736,6 +941,12 @@ void c_NEGF_Common<T>::Print_ReadData()
     Print_WritingRelatedFlags();
     Print_AtomLocationAndChargeDistributionFilename();
     Print_RecursiveOptimizationParams();
+    Print_EnergyParallelizationParams();
+    Print_CurrentParams();
+    Print_AdaptiveQuadratureParams();
+    Print_PoleExpansionParams();
+    Print_SurfaceGFParams();
+    Print_ContactSelfEnergyCacheParams();
 
     Print_MaterialSpecificReadData();
 }
@@ -932,6 +1143,8 @@ void c_NEGF_Common<T>::Print_AdaptiveIntegrationParams()
     {
         amrex::Print() << "##### integrand_correction_interval: "
                        << integrand_correction_interval << "\n";
+        amrex::Print() << "##### noneq_prescan_pts: " << noneq_prescan_pts
+                       << "\n";
         amrex::Print() << "##### kT_window_around_singularity: "
                        << "\n";
         for (int i = 0; i < 2; ++i)
@@ -982,6 +1195,82 @@ void c_NEGF_Common<T>::Print_RecursiveOptimizationParams()
 {
     amrex::Print() << "##### num_recursive_parts: " << num_recursive_parts
                    << "\n";
+    amrex::Print() << "##### flag_replicate_diagonal: "
+                   << flag_replicate_diagonal << "\n";
+    amrex::Print() << "##### flag_parallel_recursion: "
+                   << flag_parallel_recursion << "\n";
+    amrex::Print() << "##### energy_batch_size: " << energy_batch_size
+                   << "\n";
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Print_EnergyParallelizationParams()
+{
+    amrex::Print() << "##### num_energy_groups: " << num_energy_groups << "\n";
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Print_CurrentParams()
+{
+    amrex::Print() << "##### flag_fuse_current_with_charge: "
+                   << flag_fuse_current_with_charge << "\n";
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Print_AdaptiveQuadratureParams()
+{
+    amrex::Print() << "##### flag_noneq_adaptive_quadrature: "
+                   << flag_noneq_adaptive_quadrature << "\n";
+    if (flag_noneq_adaptive_quadrature)
+    {
+        amrex::Print() << "##### noneq_adaptive_tolerance: "
+                       << noneq_adaptive_tolerance << "\n";
+        amrex::Print() << "##### noneq_adaptive_initial_intervals: "
+                       << noneq_adaptive_initial_intervals << "\n";
+        amrex::Print() << "##### noneq_adaptive_max_rounds: "
+                       << noneq_adaptive_max_rounds << "\n";
+        amrex::Print() << "##### noneq_adaptive_max_intervals: "
+                       << noneq_adaptive_max_intervals << "\n";
+        amrex::Print() << "##### noneq_adaptive_coarsen_fraction: "
+                       << noneq_adaptive_coarsen_fraction << "\n";
+    }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Print_PoleExpansionParams()
+{
+    amrex::Print() << "##### flag_eq_pole_expansion: "
+                   << flag_eq_pole_expansion << "\n";
+    if (flag_eq_pole_expansion)
+    {
+        amrex::Print() << "##### num_eq_poles: " << num_eq_poles << "\n";
+        amrex::Print() << "##### eq_pole_expansion_tolerance: "
+                       << eq_pole_expansion_tolerance << "\n";
+    }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Print_SurfaceGFParams()
+{
+    std::string method_str = "material";
+    if (surface_GF_method == s_SurfaceGF_Method::Eigenfunction)
+        method_str = "eigenfunction";
+    if (surface_GF_method == s_SurfaceGF_Method::Decimation)
+        method_str = "decimation";
+    amrex::Print() << "##### surface_GF_method: " << method_str << "\n";
+    amrex::Print() << "##### surface_GF_max_iter: " << surface_GF_max_iter
+                   << "\n";
+    amrex::Print() << "##### surface_GF_tol: " << surface_GF_tol << "\n";
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Print_ContactSelfEnergyCacheParams()
+{
+    amrex::Print() << "##### flag_cache_contact_self_energy: "
+                   << flag_cache_contact_self_energy << "\n";
+    if (flag_cache_contact_self_energy)
+        amrex::Print() << "##### contact_self_energy_cache_size: "
+                       << contact_self_energy_cache_size << "\n";
 }
 
 template <typename T>
@@ -1000,7 +1289,7 @@ void c_NEGF_Common<T>::Define_GPUVectorOfAvgIndices()
 template <typename T>
 void c_NEGF_Common<T>::Set_Arrays_OfSize_NumFieldSites()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         h_PTD_glo_vec.resize(num_field_sites);
     }
@@ -1101,16 +1390,56 @@ void c_NEGF_Common<T>::Define_PotentialProfile()
     }
 }
 
+template <typename T>
+void c_NEGF_Common<T>::Define_EnergyGroupCommunicators()
+{
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        num_energy_groups > 0 and num_proc_NS % num_energy_groups == 0,
+        "num_energy_groups must be a positive divisor of the number of "
+        "processes of nanostructure " +
+            name + ", " + std::to_string(num_proc_NS) + ".");
+
+    num_proc_per_energy_group = num_proc_NS / num_energy_groups;
+
+    if (!is_NS_member())
+    {
+        /*outside of the process grid, no block columns*/
+        energy_group_id = num_energy_groups;
+        blkCol_rank = num_proc_per_energy_group;
+        return;
+    }
+    energy_group_id = NS_rank / num_proc_per_energy_group;
+    blkCol_rank = NS_rank % num_proc_per_energy_group;
+
+    /*ranks of the same energy group share the block columns of H*/
+    MPI_Comm_split(NS_Comm, energy_group_id, blkCol_rank, &BlkCol_Comm);
+
+    /*ranks owning the same block columns reduce over the energy groups*/
+    MPI_Comm_split(NS_Comm, blkCol_rank, energy_group_id, &Energy_Comm);
+
+    if (flag_parallel_recursion)
+    {
+        MPI_Comm_split(BlkCol_Comm, 0,
+                       num_proc_per_energy_group - 1 - blkCol_rank,
+                       &BlkCol_Reverse_Comm);
+    }
+
+    amrex::Print() << "#####* process grid (energy groups x procs per group): "
+                   << num_energy_groups << " x " << num_proc_per_energy_group
+                   << "\n";
+}
+
 template <typename T>
 void c_NEGF_Common<T>::Define_MatrixPartition()
 {
-    Hsize_glo = get_Hsize();
     amrex::Print() << "\nHsize_glo: " << Hsize_glo << "\n";
     Hsize_recur_part = ceil(Hsize_glo / num_recursive_parts);
     amrex::Print()
         << "#####* Hsize_recur_part = ceil(Hsize_glo/num_recursive_parts): "
         << Hsize_recur_part << "\n";
 
+    Define_EnergyGroupCommunicators();
+
     bool flag_fixed_blk_size = false;
     const int THRESHOLD_BLKCOL_SIZE = 40000; /*matrix size*/
 
@@ -1120,8 +1449,8 @@ void c_NEGF_Common<T>::Define_MatrixPartition()
     {
         amrex::Print() << "max_blkCol_perProc is computed at run-time\n";
 
-        max_blkCol_perProc =
-            ceil(static_cast<amrex::Real>(Hsize_glo) / num_proc);
+        max_blkCol_perProc = ceil(static_cast<amrex::Real>(Hsize_glo) /
+                                  num_proc_per_energy_group);
         if (max_blkCol_perProc > THRESHOLD_BLKCOL_SIZE)
         {
             max_blkCol_perProc = THRESHOLD_BLKCOL_SIZE;
@@ -1137,21 +1466,20 @@ void c_NEGF_Common<T>::Define_MatrixPartition()
                    << num_proc_with_blkCol << "\n";
     /*if num_proc_with_blk >= num_proc, assert.*/
 
-    vec_cumu_blkCol_size.resize(num_proc_with_blkCol + 1);
+    vec_cumu_blkCol_size.resize(num_proc_per_energy_group + 1);
     vec_cumu_blkCol_size[0] = 0;
-    for (int p = 1; p < num_proc_with_blkCol; ++p)
+    for (int p = 1; p <= num_proc_per_energy_group; ++p)
     {
-        vec_cumu_blkCol_size[p] =
-            vec_cumu_blkCol_size[p - 1] + max_blkCol_perProc;
+        vec_cumu_blkCol_size[p] = std::min(
+            vec_cumu_blkCol_size[p - 1] + max_blkCol_perProc, Hsize_glo);
         /*All proc except the last one contains max_blkCol_perProc number of
-         * column blks.*/
+         * column blks. Procs beyond num_proc_with_blkCol contain none.*/
     }
-    vec_cumu_blkCol_size[num_proc_with_blkCol] = Hsize_glo;
 
     blkCol_size_loc = 0;
-    if (my_rank < num_proc_with_blkCol)
+    if (blkCol_rank < num_proc_with_blkCol)
     {
-        int blk_gid = my_rank;
+        int blk_gid = blkCol_rank;
         blkCol_size_loc =
             vec_cumu_blkCol_size[blk_gid + 1] - vec_cumu_blkCol_size[blk_gid];
 
@@ -1163,16 +1491,31 @@ void c_NEGF_Common<T>::Define_MatrixPartition()
         }
     }
 
+    /*counts within an energy group, used for gathering Alpha over columns*/
+    MPI_blkCol_recv_count.resize(num_proc_per_energy_group);
+    MPI_blkCol_recv_disp.resize(num_proc_per_energy_group);
+
+    for (int p = 0; p < num_proc_per_energy_group; ++p)
+    {
+        MPI_blkCol_recv_count[p] =
+            vec_cumu_blkCol_size[p + 1] - vec_cumu_blkCol_size[p];
+        MPI_blkCol_recv_disp[p] = vec_cumu_blkCol_size[p];
+    }
+
+    /*Global counts: field sites are owned by the processes of energy group 0
+     *of this nanostructure only, so that the self-consistency algorithm and
+     *the output routines see each site exactly once.
+     *Global rank p is rank p - NS_rank_begin of NS_Comm.*/
     MPI_recv_count.resize(num_proc);
     MPI_recv_disp.resize(num_proc);
 
     for (int p = 0; p < num_proc; ++p)
     {
-        if (p < num_proc_with_blkCol)
+        int q = p - NS_rank_begin;
+        if (q >= 0 and q < num_proc_per_energy_group)
         {
-            MPI_recv_count[p] =
-                vec_cumu_blkCol_size[p + 1] - vec_cumu_blkCol_size[p];
-            MPI_recv_disp[p] = vec_cumu_blkCol_size[p];
+            MPI_recv_count[p] = MPI_blkCol_recv_count[q];
+            MPI_recv_disp[p] = MPI_blkCol_recv_disp[q];
         }
         else
         {
@@ -1185,6 +1528,50 @@ void c_NEGF_Common<T>::Define_MatrixPartition()
     }
 
     Define_MPI_BlkType();
+
+    if (flag_parallel_recursion) Define_MPI_RecursionScanTypes();
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Define_MPI_RecursionScanTypes()
+{
+    MPI_Type_contiguous(4, MPI_BlkType, &MPI_MobiusType);
+    MPI_Type_commit(&MPI_MobiusType);
+
+    /*Neither operation is commutative in general, as the order of the ranks
+     *sets the order in which the maps and blocks are applied.*/
+    MPI_Op_create((MPI_User_function *)Mobius_Compose_Func, false,
+                  &Mobius_Compose);
+    MPI_Op_create((MPI_User_function *)Block_Product_Func, false,
+                  &Block_Product);
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Free_MPI_RecursionScanTypes()
+{
+    if (MPI_MobiusType != MPI_DATATYPE_NULL) MPI_Type_free(&MPI_MobiusType);
+    if (Mobius_Compose != MPI_OP_NULL) MPI_Op_free(&Mobius_Compose);
+    if (Block_Product != MPI_OP_NULL) MPI_Op_free(&Block_Product);
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Cleanup()
+{
+    Free_MPI_RecursionScanTypes();
+
+    if (BlkCol_Comm != MPI_COMM_NULL) MPI_Comm_free(&BlkCol_Comm);
+    if (Energy_Comm != MPI_COMM_NULL) MPI_Comm_free(&Energy_Comm);
+    if (BlkCol_Reverse_Comm != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&BlkCol_Reverse_Comm);
+    }
+    /*NS_Comm is split off only in Set_ProcessRange, else it is the
+     *communicator of amrex::ParallelContext*/
+    if (NS_Comm != MPI_COMM_NULL and
+        NS_Comm != amrex::ParallelContext::CommunicatorSub())
+    {
+        MPI_Comm_free(&NS_Comm);
+    }
 }
 
 template <typename T>
@@ -1203,18 +1590,21 @@ void c_NEGF_Common<T>::Initialize_NEGF_Params(
     Set_MaterialParameters();
 
     Print_ReadData();
-
-    Define_MatrixPartition();
 }
 
 template <typename T>
 void c_NEGF_Common<T>::Initialize_NEGF(const std::string common_foldername_str,
                                        const bool _use_electrostatic)
 {
+    /*the partition depends on the process range of Set_ProcessRange*/
+    Define_MatrixPartition();
+
     Allocate_Arrays();
 
     Construct_Hamiltonian();
 
+    if (is_NS_member()) Replicate_DiagonalBlocks();
+
     Define_ContactInfo();
 
     amrex::Print() << "#####* Initially defining energy limits:\n";
@@ -1228,12 +1618,16 @@ void c_NEGF_Common<T>::Initialize_NEGF(const std::string common_foldername_str,
 
         std::string dos_dir = step_foldername_str + "/DOS_flatband";
 
-        if (ParallelDescriptor::IOProcessor()) CreateDirectory(dos_dir);
+        /*created by the I/O process, which need not solve this
+         *nanostructure*/
+        CreateDirectory(dos_dir);
+        ParallelDescriptor::Barrier(
+            ParallelContext::CommunicatorSub());
 
-        Compute_DensityOfStates(dos_dir, flag_write_LDOS);
+        if (is_NS_member()) Compute_DensityOfStates(dos_dir, flag_write_LDOS);
     }
 
-    Compute_Rho0();
+    if (is_NS_member()) Compute_Rho0();
 
     if (!_use_electrostatic)
     {
@@ -1244,6 +1638,8 @@ void c_NEGF_Common<T>::Initialize_NEGF(const std::string common_foldername_str,
 template <typename T>
 void c_NEGF_Common<T>::Solve_NEGF(RealTable1D &n_curr_out_data, const int iter)
 {
+    flag_fused_current_ready = false;
+
     Add_PotentialToHamiltonian();
 
     if (flag_adaptive_integration_limits and
@@ -1257,11 +1653,16 @@ void c_NEGF_Common<T>::Solve_NEGF(RealTable1D &n_curr_out_data, const int iter)
     {
         flag_correct_integration_limits = false;
     }
+    /*the integrand is sampled in the pass preceding a correction, such that
+     *the correction does not need a pass of its own*/
+    flag_sample_integrand = flag_adaptive_integration_limits and
+                            (iter + 1) % integrand_correction_interval == 0;
 
     if (flag_EC_potential_updated)
     {
         Update_ContactElectrochemicalPotential();
         Define_EnergyLimits();
+        flag_integrand_peak_valid = false;
     }
     if (flag_EC_potential_updated or flag_correct_integration_limits)
     {
@@ -1269,7 +1670,20 @@ void c_NEGF_Common<T>::Solve_NEGF(RealTable1D &n_curr_out_data, const int iter)
         flag_EC_potential_updated = false;
     }
 
+    num_unconverged_surface_GF = 0;
+
     Compute_InducedCharge(n_curr_out_data);
+
+    /*processes of an energy group share the energy points, hence max*/
+    MPI_Allreduce(MPI_IN_PLACE, &num_unconverged_surface_GF, 1, MPI_INT,
+                  MPI_MAX, NS_Comm);
+    if (num_unconverged_surface_GF > 0)
+    {
+        amrex::Print() << " Warning: surface GF decimation not converged "
+                          "within surface_GF_max_iter at "
+                       << num_unconverged_surface_GF
+                       << " energy points of a process.\n";
+    }
 }
 
 template <typename T>
@@ -1278,7 +1692,7 @@ void c_NEGF_Common<T>::Write_Data(const std::string filename_prefix,
                                   const RealTable1D &Norm_data)
 {
     Write_PotentialAtSites(filename_prefix);
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         Write_InducedCharge(filename_prefix, n_curr_out_data);
         Write_ChargeNorm(filename_prefix, Norm_data);
@@ -1304,6 +1718,12 @@ void c_NEGF_Common<T>::Allocate_ArraysForHamiltonian()
     h_minusHa_loc_data.resize({0}, {blkCol_size_loc}, The_Pinned_Arena());
     SetVal_Table1D(h_minusHa_loc_data, zero);
 
+    if (flag_replicate_diagonal)
+    {
+        h_minusHa_glo_data.resize({0}, {Hsize_glo}, The_Pinned_Arena());
+        SetVal_Table1D(h_minusHa_glo_data, zero);
+    }
+
     h_Hb_loc_data.resize({0}, {offDiag_repeatBlkSize}, The_Pinned_Arena());
     SetVal_Table1D(h_Hb_loc_data, zero);
 
@@ -1318,6 +1738,18 @@ void c_NEGF_Common<T>::Allocate_ArraysForLeadSpecificQuantities()
 
     h_tau_glo_data.resize({0}, {NUM_CONTACTS}, The_Pinned_Arena());
     SetVal_Table1D(h_tau_glo_data, zero);
+
+    if (flag_cache_contact_self_energy)
+    {
+        const int cache_size = contact_self_energy_cache_size;
+        p_Sigma_cache = std::make_unique<s_SelfEnergyCache>();
+        p_Sigma_cache->h_data.resize({0, 0}, {NUM_CONTACTS, cache_size},
+                                     The_Pinned_Arena());
+#ifdef AMREX_USE_GPU
+        p_Sigma_cache->d_data.resize({0, 0}, {NUM_CONTACTS, cache_size},
+                                     The_Arena());
+#endif
+    }
 }
 
 template <typename T>
@@ -1467,114 +1899,569 @@ void c_NEGF_Common<T>::Add_PotentialToHamiltonian()
         h_minusHa(c) =
             -1 * h_U_loc(c); /*Note: Ha = H0a (=0) + U, so -Ha = -U */
     }
+
+    Replicate_DiagonalBlocks();
 }
 
 template <typename T>
-void c_NEGF_Common<T>::Update_ContactElectrochemicalPotential()
+void c_NEGF_Common<T>::Replicate_DiagonalBlocks()
 {
-    // amrex::Print() <<  "Updated contact electrochemical potential: \n";
-    for (int c = 0; c < NUM_CONTACTS; ++c)
-    {
-        mu_contact[c] = Contact_Electrochemical_Potential[c];
-        // amrex::Print() << "  contact, mu: " <<  c << " " << mu_contact[c] <<
-        // "\n";
-    }
-    // std::cout << " proc, mu_contact, U_contact: " << my_rank << "; "
-    //                                     << mu_contact[0] << " " <<
-    //                                     mu_contact[1] << "; "
-    //                                     << U_contact[0] << " "  <<
-    //                                     U_contact[1] << "\n";
-    // MPI_Barrier(ParallelDescriptor::Communicator());
+    /*The diagonal blocks change only with the potential, i.e. once per
+     *self-consistent iteration. Replicating them here allows every process to
+     *assemble Alpha_glo locally at each energy point without communication.*/
+    if (!flag_replicate_diagonal) return;
+
+    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
+    auto const &h_minusHa_glo = h_minusHa_glo_data.table();
+
+    MPI_Allgatherv(&h_minusHa_loc(0), blkCol_size_loc, MPI_BlkType,
+                   &h_minusHa_glo(0), MPI_blkCol_recv_count.data(),
+                   MPI_blkCol_recv_disp.data(), MPI_BlkType, BlkCol_Comm);
 }
 
 template <typename T>
-void c_NEGF_Common<T>::Define_EnergyLimits()
+void c_NEGF_Common<T>::Assemble_Alpha_glo(const ComplexType E)
 {
-    for (int c = 0; c < NUM_CONTACTS; ++c)
-    {
-        kT_contact[c] = PhysConst::kb_eVperK *
-                        Contact_Temperature[c]; /*set Temp in the input*/
-    }
-
-    mu_min = mu_contact[0];
-    mu_max = mu_contact[0];
-    kT_min = kT_contact[0];
-    kT_max = kT_contact[0];
-
-    flag_noneq_exists = false;
+    /*Requires h_Alpha_loc and h_Sigma_contact at energy E.*/
+    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
 
-    for (int c = 1; c < NUM_CONTACTS; ++c)
+    if (flag_replicate_diagonal)
     {
-        if (mu_min > mu_contact[c])
-        {
-            mu_min = mu_contact[c];
-        }
-        if (mu_max < mu_contact[c])
-        {
-            mu_max = mu_contact[c];
-        }
-        if (kT_min > kT_contact[c])
+        auto const &h_minusHa_glo = h_minusHa_glo_data.const_table();
+        auto const &h_Sigma_contact = h_Sigma_contact_data.const_table();
+
+        for (int n = 0; n < Hsize_glo; ++n)
         {
-            kT_min = kT_contact[c];
+            h_Alpha_glo(n) = E + h_minusHa_glo(n);
         }
-        if (kT_max < kT_contact[c])
+        for (int c = 0; c < NUM_CONTACTS; ++c)
         {
-            kT_max = kT_contact[c];
+            int n_glo = global_contact_index[c];
+            h_Alpha_glo(n_glo) = h_Alpha_glo(n_glo) - h_Sigma_contact(c);
         }
     }
-    if (fabs(mu_min - mu_max) > 1e-8) flag_noneq_exists = true;
-    if (fabs(kT_min - kT_max) > 0.01) flag_noneq_exists = true;
-
-    // flag_noneq_exists = true;
-    // ComplexType val(0.,1e-8);
-    // E_zPlus = val;
-    E_contour_left = E_valence_min + E_zPlus; /*set in the input*/
-    E_rightmost = mu_max + Fermi_tail_factor_upper * kT_max + E_zPlus;
-
-    int num_poles = int((E_pole_max - MathConst::pi * kT_max) /
-                            (2. * MathConst::pi * kT_max) +
-                        1);
-
-    if (flag_noneq_exists)
+    else
     {
-        amrex::Print() << "\n Nonequilibrium exists!\n";
-        E_contour_right = mu_min - Fermi_tail_factor_lower * kT_max + E_zPlus;
-        num_enclosed_poles = 0;
+        auto const &h_Alpha_loc = h_Alpha_loc_data.table();
 
-        ComplexType val2(E_contour_right.real(),
-                         2 * num_poles * MathConst::pi * kT_max);
-        E_zeta = val2;
+        /*MPI_Allgather*/
+        MPI_Allgatherv(&h_Alpha_loc(0), blkCol_size_loc, MPI_BlkType,
+                       &h_Alpha_glo(0), MPI_blkCol_recv_count.data(),
+                       MPI_blkCol_recv_disp.data(), MPI_BlkType, BlkCol_Comm);
+    }
+}
 
-        ComplexType val3(E_contour_right.real() - 14 * kT_max, E_zeta.imag());
-        E_eta = val3;
+template <typename T>
+void c_NEGF_Common<T>::Compute_RecursiveBlocks(const ComplexType E)
+{
+    /*Requires h_Alpha_loc, including the contact self-energies, at energy E.
+     *Computes X and Y at the local columns and at the contacts, Alpha at the
+     *contacts, and Xtil, Ytil needed for the contact propagators and the
+     *off-diagonal elements of G and A.*/
+    if (flag_parallel_recursion)
+    {
+        Compute_RecursiveBlocks_Scan();
     }
     else
     {
-        amrex::Print() << "\n Nonequilibrium doesn't exist!\n";
-        E_contour_right = E_rightmost;
-        num_enclosed_poles = num_poles;
-        E_poles_vec.resize(num_enclosed_poles);
-
-        for (int p = 0; p < num_enclosed_poles; ++p)
-        {
-            ComplexType pole(mu_min, MathConst::pi * kT_max * (2 * p + 1));
-            E_poles_vec[p] = pole;
-        }
-        ComplexType val2(E_contour_right.real(),
-                         2 * num_poles * MathConst::pi * kT_max);
-        E_zeta = val2;
-        amrex::Real Fermi_tail_factor_max =
-            std::max(Fermi_tail_factor_lower, Fermi_tail_factor_upper);
-        ComplexType val3(mu_min - Fermi_tail_factor_max * kT_max,
-                         E_zeta.imag());
-        E_eta = val3;
+        Compute_RecursiveBlocks_Serial(E);
     }
+#ifdef AMREX_USE_GPU
+    d_Alpha_contact_data.copy(h_Alpha_contact_data);
+    d_X_contact_data.copy(h_X_contact_data);
+    d_Y_contact_data.copy(h_Y_contact_data);
+#endif
+}
 
-    amrex::Print() << " U_contact: ";
-    for (int c = 0; c < NUM_CONTACTS; ++c)
-    {
-        amrex::Print() << U_contact[c] << " ";
-    }
+template <typename T>
+void c_NEGF_Common<T>::Compute_RecursiveBlocks_Serial(const ComplexType E)
+{
+    auto const &h_Hb_loc = h_Hb_loc_data.table();
+    auto const &h_Hc_loc = h_Hc_loc_data.table();
+    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
+    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
+    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
+    auto const &h_X_glo = h_X_glo_data.table();
+    auto const &h_Y_glo = h_Y_glo_data.table();
+    auto const &h_Alpha_contact = h_Alpha_contact_data.table();
+    auto const &h_X_contact = h_X_contact_data.table();
+    auto const &h_Y_contact = h_Y_contact_data.table();
+#ifdef AMREX_USE_GPU
+    auto const &d_Xtil_glo = d_Xtil_glo_data.table();
+    auto const &d_Ytil_glo = d_Ytil_glo_data.table();
+    auto const &d_X_loc = d_X_loc_data.table();
+    auto const &d_Y_loc = d_Y_loc_data.table();
+#else
+    auto const &h_X_loc = h_X_loc_data.table();
+    auto const &h_Y_loc = h_Y_loc_data.table();
+#endif
+
+    Assemble_Alpha_glo(E);
+
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        int n_glo = global_contact_index[c];
+        h_Alpha_contact(c) = h_Alpha_glo(n_glo);
+    }
+
+    h_Y_glo(0) = 0;
+    h_X_glo(Hsize_glo - 1) = 0;
+    for (int section = 0; section < num_recursive_parts; ++section)
+    {
+        for (int n = std::max(1, Hsize_recur_part * section);
+             n < std::min(Hsize_recur_part * (section + 1), Hsize_glo); ++n)
+        {
+            int p = (n - 1) % offDiag_repeatBlkSize;
+            RGF_ForwardStep(h_Hb_loc(p), h_Hc_loc(p), h_Alpha_glo(n - 1),
+                            h_Y_glo(n - 1), h_Ytil_glo(n), h_Y_glo(n));
+        }
+        for (int n = std::min(Hsize_glo - 2,
+                              Hsize_recur_part *
+                                  (num_recursive_parts - section));
+             n >= Hsize_recur_part * (num_recursive_parts - section - 1);
+             n--)
+        {
+            int p = n % offDiag_repeatBlkSize;
+            RGF_BackwardStep(h_Hb_loc(p), h_Hc_loc(p), h_Alpha_glo(n + 1),
+                             h_X_glo(n + 1), h_Xtil_glo(n), h_X_glo(n));
+        }
+
+#ifdef AMREX_USE_GPU
+        int Ytil_begin = section * Hsize_recur_part;
+        int Ytil_end =
+            std::min(Hsize_recur_part * (section + 1), Hsize_glo);
+
+        amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
+                              h_Ytil_glo.p + Ytil_begin,
+                              h_Ytil_glo.p + Ytil_end,
+                              d_Ytil_glo.p + Ytil_begin);
+
+        int Xtil_begin =
+            Hsize_recur_part * (num_recursive_parts - section - 1);
+        int Xtil_end =
+            std::min(Hsize_glo,
+                     Hsize_recur_part * (num_recursive_parts - section));
+
+        amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
+                              h_Xtil_glo.p + Xtil_begin,
+                              h_Xtil_glo.p + Xtil_end,
+                              d_Xtil_glo.p + Xtil_begin);
+#endif
+    }
+
+#ifdef AMREX_USE_GPU
+    int X_begin = vec_cumu_blkCol_size[blkCol_rank];
+    int X_end = X_begin + blkCol_size_loc;
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_X_glo.p + X_begin,
+                          h_X_glo.p + X_end, d_X_loc.p);
+
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Y_glo.p + X_begin,
+                          h_Y_glo.p + X_end, d_Y_loc.p);
+#else
+    for (int c = 0; c < blkCol_size_loc; ++c)
+    {
+        int n = c + vec_cumu_blkCol_size[blkCol_rank];
+        h_Y_loc(c) = h_Y_glo(n);
+        h_X_loc(c) = h_X_glo(n);
+    }
+#endif
+
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        int n = global_contact_index[c];
+        h_Y_contact(c) = h_Y_glo(n);
+        h_X_contact(c) = h_X_glo(n);
+    }
+}
+
+template <typename T>
+s_MobiusMap<T> c_NEGF_Common<T>::Compose_MobiusMaps(s_MobiusMap<T> outer,
+                                                    s_MobiusMap<T> inner)
+{
+    /*outer(inner(y)), normalized such that d = 1.
+     *The element-wise normalization holds for diagonal blocks only, see
+     *flag_parallel_recursion in NEGF_Common.H.*/
+    s_MobiusMap<T> M;
+    M.a = outer.a * inner.a + outer.b * inner.c;
+    M.b = outer.a * inner.b + outer.b * inner.d;
+    M.c = outer.c * inner.a + outer.d * inner.c;
+    M.d = outer.c * inner.b + outer.d * inner.d;
+
+    MatrixBlock<T> norm = M.d;
+    M.a = M.a / norm;
+    M.b = M.b / norm;
+    M.c = M.c / norm;
+    M.d = M.d / norm;
+
+    return M;
+}
+
+template <typename T>
+MatrixBlock<T> c_NEGF_Common<T>::Apply_MobiusMap(s_MobiusMap<T> M,
+                                                 MatrixBlock<T> y)
+{
+    MatrixBlock<T> numerator = M.a * y + M.b;
+    MatrixBlock<T> denominator = M.c * y + M.d;
+    return numerator / denominator;
+}
+
+template <typename T>
+s_MobiusMap<T> c_NEGF_Common<T>::Identity_MobiusMap()
+{
+    s_MobiusMap<T> M;
+    M.a = 1.;
+    M.b = 0.;
+    M.c = 0.;
+    M.d = 1.;
+    return M;
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Compute_RecursiveBlocks_Scan()
+{
+    /*Each step of the forward and backward recursions,
+     *  Y(n) = Hb Hc / (Alpha(n-1) - Y(n-1)),
+     *  X(n) = Hc Hb / (Alpha(n+1) - X(n+1)),
+     *is a Moebius map, and a chain of such maps composes associatively
+     *into a single map. Each process composes the maps of its own block
+     *columns (split in chunks over threads), an exclusive scan over
+     *BlkCol_Comm (BlkCol_Reverse_Comm for X) then gives the value of Y and X
+     *entering the local columns, and the recursion is completed locally.
+     *The cost per energy is O(Hsize/P + log P) instead of O(Hsize).
+     *Note: blocks are assumed to commute, as in the element-wise algebra of
+     *MatrixBlock. Xtil and Ytil are known only at the local columns, unless
+     *off-diagonal elements of G or A are requested.*/
+    auto const &h_Hb_loc = h_Hb_loc_data.table();
+    auto const &h_Hc_loc = h_Hc_loc_data.table();
+    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
+    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
+    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
+    auto const &h_X_loc = h_X_loc_data.table();
+    auto const &h_Y_loc = h_Y_loc_data.table();
+    auto const &h_Alpha_contact = h_Alpha_contact_data.table();
+    auto const &h_X_contact = h_X_contact_data.table();
+    auto const &h_Y_contact = h_Y_contact_data.table();
+
+    const int col_begin = vec_cumu_blkCol_size[blkCol_rank];
+    const int col_end = col_begin + blkCol_size_loc;
+    const int R = offDiag_repeatBlkSize;
+
+    /*Alpha of the neighbouring columns owned by the adjacent processes*/
+    const int left_rank = (blkCol_size_loc > 0 and col_begin > 0)
+                              ? blkCol_rank - 1
+                              : MPI_PROC_NULL;
+    const int right_rank = (blkCol_size_loc > 0 and col_end < Hsize_glo)
+                               ? blkCol_rank + 1
+                               : MPI_PROC_NULL;
+    MatrixBlock<T> Alpha_first, Alpha_last, Alpha_left, Alpha_right;
+    Alpha_first = 0.;
+    Alpha_last = 0.;
+    Alpha_left = 0.;
+    Alpha_right = 0.;
+    if (blkCol_size_loc > 0)
+    {
+        Alpha_first = h_Alpha_loc(0);
+        Alpha_last = h_Alpha_loc(blkCol_size_loc - 1);
+    }
+    MPI_Sendrecv(&Alpha_last, 1, MPI_BlkType, right_rank, 0, &Alpha_left, 1,
+                 MPI_BlkType, left_rank, 0, BlkCol_Comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(&Alpha_first, 1, MPI_BlkType, left_rank, 1, &Alpha_right, 1,
+                 MPI_BlkType, right_rank, 1, BlkCol_Comm, MPI_STATUS_IGNORE);
+
+    auto get_Alpha = [&](int n)
+    {
+        if (n < col_begin) return Alpha_left;
+        if (n >= col_end) return Alpha_right;
+        return MatrixBlock<T>(h_Alpha_loc(n - col_begin));
+    };
+
+    /*map of step n of the forward (Y) and backward (X) recursion*/
+    auto Y_step = [&](int n)
+    {
+        int p = (n - 1) % R;
+        s_MobiusMap<T> M;
+        M.a = 0.;
+        M.b = MatrixBlock<T>(h_Hb_loc(p)) * h_Hc_loc(p);
+        M.c = -1.;
+        M.d = get_Alpha(n - 1);
+        return M;
+    };
+    auto X_step = [&](int n)
+    {
+        int p = n % R;
+        s_MobiusMap<T> M;
+        M.a = 0.;
+        M.b = MatrixBlock<T>(h_Hc_loc(p)) * h_Hb_loc(p);
+        M.c = -1.;
+        M.d = get_Alpha(n + 1);
+        return M;
+    };
+
+    /*Y(n) is computed for n in [Y_begin, col_end), X(n) for n in
+     *[col_begin, X_end), with Y(0) = X(Hsize_glo-1) = 0.*/
+    const int Y_begin = std::max(1, col_begin);
+    const int X_end = std::min(col_end, Hsize_glo - 1);
+    const int num_Y_steps = std::max(0, col_end - Y_begin);
+    const int num_X_steps = std::max(0, X_end - col_begin);
+
+    const int num_chunks = std::max(
+        1, std::min(amrex::OpenMP::get_max_threads(), num_Y_steps));
+    auto chunk_begin = [&](int chunk, int first, int num_steps)
+    { return first + (chunk * num_steps) / num_chunks; };
+
+    amrex::Vector<s_MobiusMap<T>> Y_chunk_map(num_chunks);
+    amrex::Vector<s_MobiusMap<T>> X_chunk_map(num_chunks);
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel for
+#endif
+    for (int chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        s_MobiusMap<T> M = Identity_MobiusMap();
+        for (int n = chunk_begin(chunk, Y_begin, num_Y_steps);
+             n < chunk_begin(chunk + 1, Y_begin, num_Y_steps); ++n)
+        {
+            M = Compose_MobiusMaps(Y_step(n), M);
+        }
+        Y_chunk_map[chunk] = M;
+
+        /*chunks of the backward recursion are walked from the right*/
+        M = Identity_MobiusMap();
+        for (int n = chunk_begin(chunk + 1, col_begin, num_X_steps) - 1;
+             n >= chunk_begin(chunk, col_begin, num_X_steps); --n)
+        {
+            M = Compose_MobiusMaps(X_step(n), M);
+        }
+        X_chunk_map[chunk] = M;
+    }
+
+    s_MobiusMap<T> scan_map[2];
+    scan_map[0] = Identity_MobiusMap();
+    scan_map[1] = Identity_MobiusMap();
+    for (int chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        scan_map[0] = Compose_MobiusMaps(Y_chunk_map[chunk], scan_map[0]);
+        scan_map[1] = Compose_MobiusMaps(X_chunk_map[num_chunks - 1 - chunk],
+                                         scan_map[1]);
+    }
+
+    s_MobiusMap<T> prefix_map[2];
+    prefix_map[0] = Identity_MobiusMap();
+    prefix_map[1] = Identity_MobiusMap();
+    MPI_Exscan(&scan_map[0], &prefix_map[0], 1, MPI_MobiusType,
+               Mobius_Compose, BlkCol_Comm);
+    MPI_Exscan(&scan_map[1], &prefix_map[1], 1, MPI_MobiusType,
+               Mobius_Compose, BlkCol_Reverse_Comm);
+    /*result of the exclusive scan is undefined on the first rank*/
+    if (blkCol_rank == 0) prefix_map[0] = Identity_MobiusMap();
+    if (blkCol_rank == num_proc_per_energy_group - 1)
+    {
+        prefix_map[1] = Identity_MobiusMap();
+    }
+
+    /*values entering each chunk: Y(Y_begin-1) and X(X_end)*/
+    MatrixBlock<T> zero_blk;
+    zero_blk = 0.;
+    amrex::Vector<MatrixBlock<T>> Y_entry(num_chunks);
+    amrex::Vector<MatrixBlock<T>> X_entry(num_chunks);
+    Y_entry[0] = Apply_MobiusMap(prefix_map[0], zero_blk);
+    X_entry[num_chunks - 1] = Apply_MobiusMap(prefix_map[1], zero_blk);
+    for (int chunk = 1; chunk < num_chunks; ++chunk)
+    {
+        Y_entry[chunk] =
+            Apply_MobiusMap(Y_chunk_map[chunk - 1], Y_entry[chunk - 1]);
+        int rchunk = num_chunks - 1 - chunk;
+        X_entry[rchunk] =
+            Apply_MobiusMap(X_chunk_map[rchunk + 1], X_entry[rchunk + 1]);
+    }
+
+    if (col_begin == 0 and blkCol_size_loc > 0) h_Y_loc(0) = 0.;
+    if (col_end == Hsize_glo and blkCol_size_loc > 0)
+    {
+        h_X_loc(blkCol_size_loc - 1) = 0.;
+    }
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel for
+#endif
+    for (int chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        MatrixBlock<T> Y_prev = Y_entry[chunk];
+        for (int n = chunk_begin(chunk, Y_begin, num_Y_steps);
+             n < chunk_begin(chunk + 1, Y_begin, num_Y_steps); ++n)
+        {
+            int p = (n - 1) % R;
+            RGF_ForwardStep(h_Hb_loc(p), h_Hc_loc(p), get_Alpha(n - 1), Y_prev,
+                            h_Ytil_glo(n), Y_prev);
+            h_Y_loc(n - col_begin) = Y_prev;
+        }
+
+        MatrixBlock<T> X_next = X_entry[chunk];
+        for (int n = chunk_begin(chunk + 1, col_begin, num_X_steps) - 1;
+             n >= chunk_begin(chunk, col_begin, num_X_steps); --n)
+        {
+            int p = n % R;
+            RGF_BackwardStep(h_Hb_loc(p), h_Hc_loc(p), get_Alpha(n + 1), X_next,
+                             h_Xtil_glo(n), X_next);
+            h_X_loc(n - col_begin) = X_next;
+        }
+    }
+
+    /*Alpha, X and Y at the contacts, contributed by the owning process*/
+    const int num_blk_elems = sizeof(MatrixBlock<T>) / sizeof(ComplexType);
+    BlkTable1D h_contact_buffer_data({0}, {3 * NUM_CONTACTS},
+                                     The_Pinned_Arena());
+    auto const &h_contact_buffer = h_contact_buffer_data.table();
+    for (int i = 0; i < 3 * NUM_CONTACTS; ++i)
+    {
+        h_contact_buffer(i) = 0.;
+    }
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        int n_glo = global_contact_index[c];
+        if (n_glo >= col_begin and n_glo < col_end)
+        {
+            h_contact_buffer(c) = h_Alpha_loc(n_glo - col_begin);
+            h_contact_buffer(c + NUM_CONTACTS) = h_X_loc(n_glo - col_begin);
+            h_contact_buffer(c + 2 * NUM_CONTACTS) = h_Y_loc(n_glo - col_begin);
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &(h_contact_buffer(0)),
+                  3 * NUM_CONTACTS * num_blk_elems, MPI_DOUBLE_COMPLEX,
+                  MPI_SUM, BlkCol_Comm);
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        h_Alpha_contact(c) = h_contact_buffer(c);
+        h_X_contact(c) = h_contact_buffer(c + NUM_CONTACTS);
+        h_Y_contact(c) = h_contact_buffer(c + 2 * NUM_CONTACTS);
+    }
+
+#if defined(COMPUTE_GREENS_FUNCTION_OFFDIAG_ELEMS) || \
+    defined(COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS)
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_BlkType, &h_Xtil_glo(0),
+                   MPI_blkCol_recv_count.data(), MPI_blkCol_recv_disp.data(),
+                   MPI_BlkType, BlkCol_Comm);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_BlkType, &h_Ytil_glo(0),
+                   MPI_blkCol_recv_count.data(), MPI_blkCol_recv_disp.data(),
+                   MPI_BlkType, BlkCol_Comm);
+#ifdef AMREX_USE_GPU
+    d_Xtil_glo_data.copy(h_Xtil_glo_data);
+    d_Ytil_glo_data.copy(h_Ytil_glo_data);
+#endif
+#endif
+
+#ifdef AMREX_USE_GPU
+    d_X_loc_data.copy(h_X_loc_data);
+    d_Y_loc_data.copy(h_Y_loc_data);
+#endif
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Update_ContactElectrochemicalPotential()
+{
+    // amrex::Print() <<  "Updated contact electrochemical potential: \n";
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        mu_contact[c] = Contact_Electrochemical_Potential[c];
+        // amrex::Print() << "  contact, mu: " <<  c << " " << mu_contact[c] <<
+        // "\n";
+    }
+    // std::cout << " proc, mu_contact, U_contact: " << my_rank << "; "
+    //                                     << mu_contact[0] << " " <<
+    //                                     mu_contact[1] << "; "
+    //                                     << U_contact[0] << " "  <<
+    //                                     U_contact[1] << "\n";
+    // MPI_Barrier(ParallelDescriptor::Communicator());
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Define_EnergyLimits()
+{
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        kT_contact[c] = PhysConst::kb_eVperK *
+                        Contact_Temperature[c]; /*set Temp in the input*/
+    }
+
+    mu_min = mu_contact[0];
+    mu_max = mu_contact[0];
+    kT_min = kT_contact[0];
+    kT_max = kT_contact[0];
+
+    flag_noneq_exists = false;
+
+    for (int c = 1; c < NUM_CONTACTS; ++c)
+    {
+        if (mu_min > mu_contact[c])
+        {
+            mu_min = mu_contact[c];
+        }
+        if (mu_max < mu_contact[c])
+        {
+            mu_max = mu_contact[c];
+        }
+        if (kT_min > kT_contact[c])
+        {
+            kT_min = kT_contact[c];
+        }
+        if (kT_max < kT_contact[c])
+        {
+            kT_max = kT_contact[c];
+        }
+    }
+    if (fabs(mu_min - mu_max) > 1e-8) flag_noneq_exists = true;
+    if (fabs(kT_min - kT_max) > 0.01) flag_noneq_exists = true;
+
+    // flag_noneq_exists = true;
+    // ComplexType val(0.,1e-8);
+    // E_zPlus = val;
+    E_contour_left = E_valence_min + E_zPlus; /*set in the input*/
+    E_rightmost = mu_max + Fermi_tail_factor_upper * kT_max + E_zPlus;
+
+    int num_poles = int((E_pole_max - MathConst::pi * kT_max) /
+                            (2. * MathConst::pi * kT_max) +
+                        1);
+
+    if (flag_noneq_exists)
+    {
+        amrex::Print() << "\n Nonequilibrium exists!\n";
+        E_contour_right = mu_min - Fermi_tail_factor_lower * kT_max + E_zPlus;
+        num_enclosed_poles = 0;
+
+        ComplexType val2(E_contour_right.real(),
+                         2 * num_poles * MathConst::pi * kT_max);
+        E_zeta = val2;
+
+        ComplexType val3(E_contour_right.real() - 14 * kT_max, E_zeta.imag());
+        E_eta = val3;
+    }
+    else
+    {
+        amrex::Print() << "\n Nonequilibrium doesn't exist!\n";
+        E_contour_right = E_rightmost;
+        num_enclosed_poles = num_poles;
+        E_poles_vec.resize(num_enclosed_poles);
+
+        for (int p = 0; p < num_enclosed_poles; ++p)
+        {
+            ComplexType pole(mu_min, MathConst::pi * kT_max * (2 * p + 1));
+            E_poles_vec[p] = pole;
+        }
+        ComplexType val2(E_contour_right.real(),
+                         2 * num_poles * MathConst::pi * kT_max);
+        E_zeta = val2;
+        amrex::Real Fermi_tail_factor_max =
+            std::max(Fermi_tail_factor_lower, Fermi_tail_factor_upper);
+        ComplexType val3(mu_min - Fermi_tail_factor_max * kT_max,
+                         E_zeta.imag());
+        E_eta = val3;
+    }
+
+    amrex::Print() << " U_contact: ";
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        amrex::Print() << U_contact[c] << " ";
+    }
     amrex::Print() << "\n";
     amrex::Print() << " E_f: " << E_f << "\n";
     amrex::Print() << " mu_min/max: " << mu_min << " " << mu_max << "\n";
@@ -1588,6 +2475,49 @@ void c_NEGF_Common<T>::Define_EnergyLimits()
                    << ", pikT: " << MathConst::pi * kT_max << "\n";
     amrex::Print() << " E_zeta: " << E_zeta << "\n";
     amrex::Print() << " E_eta: " << E_eta << "\n";
+
+    if (flag_eq_pole_expansion) Define_PoleExpansion();
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Define_PoleExpansion()
+{
+    /*Poles and residues of the expansion of f(E - mu_min, kT_min), see
+     *Quadrature::Fermi_PoleExpansion. The error of the truncated expansion is
+     *checked over the energy range from E_contour_left to E_rightmost, and
+     *the number of poles is increased until it is below
+     *eq_pole_expansion_tolerance.*/
+    const amrex::Real x_min = (E_contour_left.real() - mu_min) / kT_min;
+    const amrex::Real x_max = (E_rightmost.real() - mu_min) / kT_min;
+    const amrex::Real dx = 0.25;
+    const int max_eq_poles = 4096;
+
+    amrex::Real max_error = 0.;
+    while (true)
+    {
+        Quadrature::Fermi_PoleExpansion(eq_pole_vec, eq_residue_vec,
+                                        num_eq_poles);
+        max_error = 0.;
+        for (amrex::Real x = x_min; x <= x_max; x += dx)
+        {
+            ComplexType f(0.5, 0.);
+            for (int p = 0; p < num_eq_poles; ++p)
+            {
+                ComplexType iz(0., eq_pole_vec[p]);
+                f -= eq_residue_vec[p] * (1. / (x - iz) + 1. / (x + iz));
+            }
+            amrex::Real f_exact = 1. / (exp(x) + 1.);
+            max_error = std::max(max_error, fabs(f.real() - f_exact));
+        }
+        if (max_error <= eq_pole_expansion_tolerance or
+            num_eq_poles >= max_eq_poles)
+            break;
+
+        num_eq_poles = std::min(max_eq_poles, (3 * num_eq_poles + 1) / 2);
+    }
+    amrex::Print() << " Pole expansion of the Fermi function, poles: "
+                   << num_eq_poles << ", max. error for (E-mu_min)/kT_min in ["
+                   << x_min << ", " << x_max << "]: " << max_error << "\n";
 }
 
 template <typename T>
@@ -2009,7 +2939,13 @@ void c_NEGF_Common<T>::Update_IntegrationPaths()
         Generate_NonEq_Paths();
         if (flag_correct_integration_limits)
         {
-            Compute_RhoNonEq();
+            /*E_at_max_noneq_integrand is taken from the last pass that
+             *sampled the integrand at the present contact potentials, or
+             *else from a coarse pre-scan*/
+            if (!flag_integrand_peak_valid)
+            {
+                Locate_NonEq_IntegrandPeak_Coarse();
+            }
             Find_NonEq_Percent_Intercuts_Adaptively();
             Generate_NonEq_Paths();
         }
@@ -2054,10 +2990,374 @@ void c_NEGF_Common<T>::Update_IntegrationPaths()
 }
 
 template <typename T>
-void c_NEGF_Common<T>::Allocate_TemporaryArraysForGFComputation()
+void c_NEGF_Common<T>::Compute_ContactPropagators()
 {
-    ComplexType zero(0., 0.);
-    h_Alpha_loc_data.resize({0}, {blkCol_size_loc}, The_Pinned_Arena());
+    /*Propagators from contact k to the local columns n, computed as a running
+     *(prefix) product of the recursion blocks:
+     * G_nk = -Xtil(n-1) G_(n-1)k for n > k,
+     * G_nk = -Ytil(n+1) G_(n+1)k for n < k,
+     * G_kk = [Alpha_k - X_k - Y_k]^-1.
+     *The product is walked once per energy up to the far end of the local
+     *columns, i.e., the cost is linear in Hsize instead of the quadratic cost
+     *of walking from the contact to every column separately.
+     *With flag_parallel_recursion, Xtil and Ytil are known only at the local
+     *columns. The part of the product over the columns of the other
+     *processes is then obtained with an exclusive scan of the per-process
+     *products, so that only the local columns are walked.*/
+    auto const &h_Xtil_glo = h_Xtil_glo_data.const_table();
+    auto const &h_Ytil_glo = h_Ytil_glo_data.const_table();
+    auto const &h_Alpha_contact = h_Alpha_contact_data.const_table();
+    auto const &h_X_contact = h_X_contact_data.const_table();
+    auto const &h_Y_contact = h_Y_contact_data.const_table();
+    auto const &h_G_contact = h_G_contact_loc_data.table();
+
+    const int col_begin = vec_cumu_blkCol_size[blkCol_rank];
+    const int col_end = col_begin + blkCol_size_loc;
+
+    if (flag_parallel_recursion)
+    {
+        /*index [k] for propagation to the right of contact k,
+         *[NUM_CONTACTS + k] for propagation to the left*/
+        MatrixBlock<T> proc_product[2 * NUM_CONTACTS];
+        MatrixBlock<T> prefix_product[2 * NUM_CONTACTS];
+
+        for (int k = 0; k < NUM_CONTACTS; ++k)
+        {
+            int k_glo = global_contact_index[k];
+            proc_product[k] = 1.;
+            proc_product[NUM_CONTACTS + k] = 1.;
+            prefix_product[k] = 1.;
+            prefix_product[NUM_CONTACTS + k] = 1.;
+
+            for (int m = std::max(col_begin, k_glo); m < col_end; ++m)
+            {
+                proc_product[k] = RGF_PropagatorStep(h_Xtil_glo(m),
+                                                     proc_product[k]);
+            }
+            for (int m = std::min(col_end - 1, k_glo); m >= col_begin; m--)
+            {
+                proc_product[NUM_CONTACTS + k] = RGF_PropagatorStep(
+                    h_Ytil_glo(m), proc_product[NUM_CONTACTS + k]);
+            }
+        }
+        MPI_Exscan(&proc_product[0], &prefix_product[0], NUM_CONTACTS,
+                   MPI_BlkType, Block_Product, BlkCol_Comm);
+        MPI_Exscan(&proc_product[NUM_CONTACTS], &prefix_product[NUM_CONTACTS],
+                   NUM_CONTACTS, MPI_BlkType, Block_Product,
+                   BlkCol_Reverse_Comm);
+
+        for (int k = 0; k < NUM_CONTACTS; ++k)
+        {
+            /*result of the exclusive scan is undefined on the first rank*/
+            if (blkCol_rank == 0) prefix_product[k] = 1.;
+            if (blkCol_rank == num_proc_per_energy_group - 1)
+            {
+                prefix_product[NUM_CONTACTS + k] = 1.;
+            }
+
+            int k_glo = global_contact_index[k];
+            MatrixBlock<T> G_contact_kk = RGF_DiagonalBlock(
+                h_Alpha_contact(k), h_X_contact(k), h_Y_contact(k));
+
+            /*temp is G at the first local column to the right of contact k*/
+            int m_begin = std::max(col_begin, k_glo);
+            MatrixBlock<T> temp = prefix_product[k] * G_contact_kk;
+            if (m_begin < col_end) h_G_contact(m_begin - col_begin, k) = temp;
+            for (int m = m_begin; m < col_end - 1; ++m)
+            {
+                temp = RGF_PropagatorStep(h_Xtil_glo(m), temp);
+                h_G_contact(m + 1 - col_begin, k) = temp;
+            }
+
+            /*temp is G at the last local column to the left of contact k*/
+            int m_end = std::min(col_end - 1, k_glo);
+            temp = prefix_product[NUM_CONTACTS + k] * G_contact_kk;
+            if (m_end >= col_begin) h_G_contact(m_end - col_begin, k) = temp;
+            for (int m = m_end; m > col_begin; m--)
+            {
+                temp = RGF_PropagatorStep(h_Ytil_glo(m), temp);
+                h_G_contact(m - 1 - col_begin, k) = temp;
+            }
+        }
+    }
+    else
+    {
+        for (int k = 0; k < NUM_CONTACTS; ++k)
+        {
+            int k_glo = global_contact_index[k];
+            MatrixBlock<T> G_contact_kk = RGF_DiagonalBlock(
+                h_Alpha_contact(k), h_X_contact(k), h_Y_contact(k));
+
+            if (k_glo >= col_begin and k_glo < col_end)
+            {
+                h_G_contact(k_glo - col_begin, k) = G_contact_kk;
+            }
+
+            MatrixBlock<T> temp = G_contact_kk;
+            for (int m = k_glo; m < col_end - 1; ++m)
+            {
+                temp = RGF_PropagatorStep(h_Xtil_glo(m), temp);
+                if (m + 1 >= col_begin)
+                {
+                    h_G_contact(m + 1 - col_begin, k) = temp;
+                }
+            }
+
+            temp = G_contact_kk;
+            for (int m = k_glo; m > col_begin; m--)
+            {
+                temp = RGF_PropagatorStep(h_Ytil_glo(m), temp);
+                if (m - 1 < col_end) h_G_contact(m - 1 - col_begin, k) = temp;
+            }
+        }
+    }
+#ifdef AMREX_USE_GPU
+    d_G_contact_loc_data.copy(h_G_contact_loc_data);
+#endif
+}
+
+template <typename T>
+amrex::Vector<s_EnergyPoint> c_NEGF_Common<T>::Get_EnergyPoints(
+    const amrex::Vector<c_IntegrationPath> &paths,
+    const bool distribute_over_groups) const
+{
+    amrex::Vector<s_EnergyPoint> energy_pts;
+    int e_prev = 0;
+    for (int p = 0; p < paths.size(); ++p)
+    {
+        for (int e = 0; e < paths[p].num_pts; ++e)
+        {
+            int e_glo = e + e_prev;
+            if (distribute_over_groups and !is_energy_pt_of_this_group(e_glo))
+                continue;
+
+            s_EnergyPoint pt;
+            pt.E = paths[p].E_vec[e];
+            pt.weight = paths[p].weight_vec[e] * paths[p].mul_factor_vec[e];
+            pt.e_glo = e_glo;
+            energy_pts.push_back(pt);
+        }
+        e_prev += paths[p].num_pts;
+    }
+    return energy_pts;
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Prepare_EnergyPoint(const ComplexType E,
+                                           const bool need_contact_propagators)
+{
+    /*Assembles Alpha, Sigma and the Fermi functions of the contacts at E and
+     *computes the recursive blocks and, if needed, the contact propagators.
+     *Requires the temporary arrays for GF computation.*/
+    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
+    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
+    auto const &h_Sigma_contact = h_Sigma_contact_data.table();
+    auto const &h_Fermi_contact = h_Fermi_contact_data.table();
+
+    for (int n = 0; n < blkCol_size_loc; ++n)
+    {
+        h_Alpha_loc(n) = E + h_minusHa_loc(n);
+        /*+ because h_minusHa is defined previously as -(H0+U)*/
+    }
+
+    int cache_id = Get_ContactSelfEnergy(E);
+
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        int n_glo = global_contact_index[c];
+
+        if (n_glo >= vec_cumu_blkCol_size[blkCol_rank] &&
+            n_glo < vec_cumu_blkCol_size[blkCol_rank + 1])
+        {
+            int n = n_glo - vec_cumu_blkCol_size[blkCol_rank];
+            h_Alpha_loc(n) = h_Alpha_loc(n) - h_Sigma_contact(c);
+        }
+        h_Fermi_contact(c) = FermiFunction(E - mu_contact[c], kT_contact[c]);
+    }
+#ifdef AMREX_USE_GPU
+    if (cache_id >= 0)
+    {
+        /*the cached self-energies are already on the device*/
+        auto const &Sigma_cache = p_Sigma_cache->d_data.const_table();
+        auto const &Sigma_contact = d_Sigma_contact_data.table();
+        amrex::Gpu::copyAsync(amrex::Gpu::deviceToDevice,
+                              &Sigma_cache(0, cache_id),
+                              &Sigma_cache(0, cache_id) + NUM_CONTACTS,
+                              Sigma_contact.p);
+    }
+    else
+    {
+        d_Sigma_contact_data.copy(h_Sigma_contact_data);
+    }
+    d_Fermi_contact_data.copy(h_Fermi_contact_data);
+    d_Alpha_loc_data.copy(h_Alpha_loc_data);
+#endif
+
+    Compute_RecursiveBlocks(E);
+
+    if (need_contact_propagators) Compute_ContactPropagators();
+#ifdef AMREX_USE_GPU
+    amrex::Gpu::streamSynchronize();
+#endif
+}
+
+template <typename T>
+template <typename... Observables>
+void c_NEGF_Common<T>::Run_RGF_EnergyLoop(
+    const amrex::Vector<s_EnergyPoint> &energy_pts,
+    const std::function<void(const s_EnergyPoint &)> &post_energy_fn,
+    Observables... observables)
+{
+    /*The recursion is done once per energy point and the diagonal blocks of
+     *the GF (and the spectral function, if any observable needs it) are
+     *built once per column and shared by all observables.
+     *GR_loc and A_loc are filled only when off-diagonal elements are
+     *requested. Requires the temporary arrays for GF computation.*/
+    constexpr bool need_spectral_function =
+        (Observables::need_spectral_function || ...);
+
+#ifdef AMREX_USE_GPU
+    auto const &GR_loc = d_GR_loc_data.table();
+    auto const &A_loc = d_A_loc_data.table();
+    /*constant references*/
+    auto const &Alpha = d_Alpha_loc_data.const_table();
+    auto const &Xtil_glo = d_Xtil_glo_data.const_table();
+    auto const &Ytil_glo = d_Ytil_glo_data.const_table();
+    auto const &X = d_X_loc_data.const_table();
+    auto const &Y = d_Y_loc_data.const_table();
+
+    auto const &Alpha_contact = d_Alpha_contact_data.const_table();
+    auto const &X_contact = d_X_contact_data.const_table();
+    auto const &Y_contact = d_Y_contact_data.const_table();
+    auto const &G_contact = d_G_contact_loc_data.const_table();
+    auto const &Sigma_contact = d_Sigma_contact_data.const_table();
+    auto const &Fermi_contact = d_Fermi_contact_data.const_table();
+#else
+    auto const &GR_loc = h_GR_loc_data.table();
+    auto const &A_loc = h_A_loc_data.table();
+    /*constant references*/
+    auto const &Alpha = h_Alpha_loc_data.const_table();
+    auto const &Xtil_glo = h_Xtil_glo_data.const_table();
+    auto const &Ytil_glo = h_Ytil_glo_data.const_table();
+    auto const &X = h_X_loc_data.const_table();
+    auto const &Y = h_Y_loc_data.const_table();
+
+    auto const &Alpha_contact = h_Alpha_contact_data.const_table();
+    auto const &X_contact = h_X_contact_data.const_table();
+    auto const &Y_contact = h_Y_contact_data.const_table();
+    auto const &G_contact = h_G_contact_loc_data.const_table();
+    auto const &Sigma_contact = h_Sigma_contact_data.const_table();
+    auto const &Fermi_contact = h_Fermi_contact_data.const_table();
+#endif
+
+    /*following is for lambda capture*/
+    int cumulative_columns = vec_cumu_blkCol_size[blkCol_rank];
+    int Hsize = Hsize_glo;
+    auto &GC_ID = global_contact_index;
+    auto &CT_ID = contact_transmission_index;
+    auto observables_tuple = amrex::makeTuple(observables...);
+
+    for (const auto &pt : energy_pts)
+    {
+        Prepare_EnergyPoint(pt.E, need_spectral_function);
+
+        amrex::ParallelFor(
+            blkCol_size_loc,
+            [=] AMREX_GPU_DEVICE(int n) noexcept
+            {
+                s_ColumnGF<T> col;
+                col.n = n;
+                col.n_glo = n + cumulative_columns; /*global column number*/
+                col.G_nn = RGF_DiagonalBlock(Alpha(n), X(n), Y(n));
+#ifdef COMPUTE_GREENS_FUNCTION_OFFDIAG_ELEMS
+                GR_loc(col.n_glo, n) = col.G_nn;
+                for (int m = col.n_glo; m > 0; m--)
+                {
+                    GR_loc(m - 1, n) = RGF_PropagatorStep(Ytil_glo(m),
+                                                          GR_loc(m, n));
+                }
+                for (int m = col.n_glo; m < Hsize - 1; ++m)
+                {
+                    GR_loc(m + 1, n) = RGF_PropagatorStep(Xtil_glo(m),
+                                                          GR_loc(m, n));
+                }
+#endif
+                if constexpr (need_spectral_function)
+                {
+                    ComplexType imag(0., 1.);
+                    col.A_nn = 0.;
+                    col.Gn_nn = 0.;
+#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
+                    for (int m = 0; m < Hsize; ++m)
+                    {
+                        A_loc(m, n) = 0.;
+                    }
+#endif
+                    for (int k = 0; k < NUM_CONTACTS; ++k)
+                    {
+                        MatrixBlock<T> G_contact_nk = G_contact(n, k);
+
+                        col.Gamma[k] = imag * (Sigma_contact(k) -
+                                               Sigma_contact(k).Dagger());
+                        col.Fermi[k] = Fermi_contact(k);
+
+                        MatrixBlock<T> A_nn =
+                            G_contact_nk * col.Gamma[k] * G_contact_nk.Dagger();
+#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
+                        int k_glo = GC_ID[k];
+                        MatrixBlock<T> G_contact_kk = RGF_DiagonalBlock(
+                            Alpha_contact(k), X_contact(k), Y_contact(k));
+                        MatrixBlock<T> A_kn =
+                            G_contact_kk * col.Gamma[k] * G_contact_nk.Dagger();
+
+                        A_loc(k_glo, n) = A_loc(k_glo, n) + A_kn;
+                        for (int m = k_glo + 1; m < Hsize; ++m)
+                        {
+                            A_kn = RGF_PropagatorStep(Xtil_glo(m - 1), A_kn);
+                            A_loc(m, n) = A_loc(m, n) + A_kn;
+                        }
+                        for (int m = k_glo - 1; m >= 0; m--)
+                        {
+                            A_kn = RGF_PropagatorStep(Ytil_glo(m + 1), A_kn);
+                            A_loc(m, n) = A_loc(m, n) + A_kn;
+                        }
+                        col.A_tk[k] = 0.;
+                        if (col.n_glo == CT_ID[k])
+                        {
+                            col.A_tk[k] = A_kn;
+                        }
+#else
+                        /*A_tk = G_tk Gamma_k G_nk^dagger is needed at n = t
+                         * only, where it equals A_nn.*/
+                        col.A_tk[k] = 0.;
+                        if (col.n_glo == CT_ID[k])
+                        {
+                            col.A_tk[k] = A_nn;
+                        }
+#endif
+                        col.A_nn = col.A_nn + A_nn;
+                        col.Gn_nn = col.Gn_nn + A_nn * col.Fermi[k];
+                    }
+#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
+                    col.A_nn = A_loc(col.n_glo, n);
+#endif
+                }
+
+                amrex::Apply([&](auto const &...obs) { (obs(col, pt), ...); },
+                             observables_tuple);
+            });
+#ifdef AMREX_USE_GPU
+        amrex::Gpu::streamSynchronize();
+#endif
+        if (post_energy_fn) post_energy_fn(pt);
+    }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Allocate_TemporaryArraysForGFComputation()
+{
+    ComplexType zero(0., 0.);
+    h_Alpha_loc_data.resize({0}, {blkCol_size_loc}, The_Pinned_Arena());
     SetVal_Table1D(h_Alpha_loc_data, zero);
 
     h_Alpha_glo_data.resize({0}, {Hsize_glo}, The_Pinned_Arena());
@@ -2096,6 +3396,10 @@ void c_NEGF_Common<T>::Allocate_TemporaryArraysForGFComputation()
     h_Y_contact_data.resize({0}, {NUM_CONTACTS}, The_Pinned_Arena());
     SetVal_Table1D(h_Y_contact_data, zero);
 
+    h_G_contact_loc_data.resize({0, 0}, {blkCol_size_loc, NUM_CONTACTS},
+                                The_Pinned_Arena());
+    SetVal_Table2D(h_G_contact_loc_data, zero);
+
     h_Trace_r.resize(num_traces);
     h_Trace_i.resize(num_traces);
 
@@ -2111,6 +3415,8 @@ void c_NEGF_Common<T>::Allocate_TemporaryArraysForGFComputation()
     d_Alpha_contact_data.resize({0}, {NUM_CONTACTS}, The_Arena());
     d_X_contact_data.resize({0}, {NUM_CONTACTS}, The_Arena());
     d_Y_contact_data.resize({0}, {NUM_CONTACTS}, The_Arena());
+    d_G_contact_loc_data.resize({0, 0}, {blkCol_size_loc, NUM_CONTACTS},
+                                The_Arena());
 
     d_Trace_r.resize(num_traces);
     d_Trace_i.resize(num_traces);
@@ -2135,6 +3441,7 @@ void c_NEGF_Common<T>::Deallocate_TemporaryArraysForGFComputation()
     h_Alpha_contact_data.clear();
     h_X_contact_data.clear();
     h_Y_contact_data.clear();
+    h_G_contact_loc_data.clear();
 
     h_Trace_r.clear();
     h_Trace_i.clear();
@@ -2151,6 +3458,7 @@ void c_NEGF_Common<T>::Deallocate_TemporaryArraysForGFComputation()
     d_Alpha_contact_data.clear();
     d_X_contact_data.clear();
     d_Y_contact_data.clear();
+    d_G_contact_loc_data.clear();
 
     d_Trace_r.clear();
     d_Trace_i.clear();
@@ -2178,55 +3486,30 @@ void c_NEGF_Common<T>::Compute_DensityOfStates(std::string dos_foldername,
     if (flag_write_LDOS)
     {
         h_LDOS_loc_data.resize({0}, {blkCol_size_loc}, The_Pinned_Arena());
-        if (ParallelDescriptor::IOProcessor())
+        if (blkCol_rank == 0)
         {
             h_LDOS_glo_data.resize({0}, {Hsize_glo}, The_Pinned_Arena());
         }
     }
 
-    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
-    auto const &h_Hb_loc = h_Hb_loc_data.table();
-    auto const &h_Hc_loc = h_Hc_loc_data.table();
-    auto const &h_tau = h_tau_glo_data.table();
     auto const &h_DOS_loc = h_DOS_loc_data.table();
     auto const &h_Transmission_loc = h_Transmission_loc_data.table();
 
     Allocate_TemporaryArraysForGFComputation();
 
-    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
-    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
-    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
-    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
-    auto const &h_X_glo = h_X_glo_data.table();
-    auto const &h_Y_glo = h_Y_glo_data.table();
-    auto const &h_X_loc = h_X_loc_data.table();
-    auto const &h_Y_loc = h_Y_loc_data.table();
-    auto const &h_Alpha_contact = h_Alpha_contact_data.table();
-    auto const &h_Y_contact = h_Y_contact_data.table();
-    auto const &h_X_contact = h_X_contact_data.table();
-    auto const &h_Sigma_contact = h_Sigma_contact_data.table();
     auto const &h_LDOS_loc = h_LDOS_loc_data.table();
     auto const &h_LDOS_glo = h_LDOS_glo_data.table();
 
-#ifdef AMREX_USE_GPU
-    auto const &GR_loc = d_GR_loc_data.table();
-    auto const &A_loc = d_A_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = d_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = d_Xtil_glo_data.const_table();
-    auto const &d_Xtil_glo = d_Xtil_glo_data.table();
-    auto const &Ytil_glo = d_Ytil_glo_data.const_table();
-    auto const &d_Ytil_glo = d_Ytil_glo_data.table();
-    auto const &X = d_X_loc_data.const_table();
-    auto const &d_X_loc = d_X_loc_data.table();
-    auto const &Y = d_Y_loc_data.const_table();
-    auto const &d_Y_loc = d_Y_loc_data.table();
+    auto Write_LDOS = [&](const int e_glo, const amrex::Real E)
+    {
+        std::string spatialdos_filename =
+            dos_foldername + "/Ept_" + std::to_string(e_glo) + ".dat";
 
-    auto const &Alpha_contact = d_Alpha_contact_data.const_table();
-    auto const &X_contact = d_X_contact_data.const_table();
-    auto const &Y_contact = d_Y_contact_data.const_table();
-    auto const &Sigma_contact = d_Sigma_contact_data.const_table();
+        Write_Table1D(h_PTD_glo_vec, h_LDOS_glo_data, spatialdos_filename,
+                      "PTD LDOS_r at E=" + std::to_string(E));
+    };
 
+#ifdef AMREX_USE_GPU
     auto *trace_r = d_Trace_r.dataPtr();
     auto *trace_i = d_Trace_i.dataPtr();
     auto &degen_vec = block_degen_gpuvec;
@@ -2238,341 +3521,119 @@ void c_NEGF_Common<T>::Compute_DensityOfStates(std::string dos_foldername,
     }
     auto const &LDOS_loc = d_LDOS_loc_data.table();
 #else
-    auto const &GR_loc = h_GR_loc_data.table();
-    auto const &A_loc = h_A_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = h_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = h_Xtil_glo_data.const_table();
-
-    auto const &Ytil_glo = h_Ytil_glo_data.const_table();
-    auto const &X = h_X_loc_data.const_table();
-    auto const &Y = h_Y_loc_data.const_table();
-
-    auto const &Alpha_contact = h_Alpha_contact_data.const_table();
-    auto const &X_contact = h_X_contact_data.const_table();
-    auto const &Y_contact = h_Y_contact_data.const_table();
-    auto const &Sigma_contact = h_Sigma_contact_data.const_table();
-
     auto *trace_r = h_Trace_r.dataPtr();
     auto *trace_i = h_Trace_i.dataPtr();
     auto &degen_vec = block_degen_vec;
     auto const &LDOS_loc = h_LDOS_loc_data.table();
 #endif
 
-    int e_prev_pts = 0;
-    for (int p = 0; p < ContourPath_DOS.size(); ++p)
+    auto Reset_Traces = [&]()
     {
-        for (int e = 0; e < ContourPath_DOS[p].num_pts; ++e)
+        for (int t = 0; t < num_traces; ++t)
         {
-            int e_glo = e_prev_pts + e;
-            ComplexType E = ContourPath_DOS[p].E_vec[e];
-            ComplexType weight = ContourPath_DOS[p].weight_vec[e];
-            ComplexType mul_factor = ContourPath_DOS[p].mul_factor_vec[e];
-
-            for (int n = 0; n < blkCol_size_loc; ++n)
-            {
-                h_Alpha_loc(n) = E + h_minusHa_loc(n);
-                /*+ because h_minusHa is defined previously as -(H0+U)*/
-            }
-
-            get_Sigma_at_contacts(h_Sigma_contact_data, E);
+            h_Trace_r[t] = 0.;
+            h_Trace_i[t] = 0.;
+        }
+#ifdef AMREX_USE_GPU
+        amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Trace_r.begin(),
+                              h_Trace_r.end(), d_Trace_r.begin());
+        amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Trace_i.begin(),
+                              h_Trace_i.end(), d_Trace_i.begin());
+        amrex::Gpu::streamSynchronize();
+#endif
+    };
+
+    s_DOS_Observable<T> DOS_obs;
+    DOS_obs.LDOS_loc = LDOS_loc;
+    DOS_obs.trace_r = trace_r;
+    DOS_obs.trace_i = trace_i;
+    DOS_obs.degen_vec_ptr = degen_vec.dataPtr();
+    DOS_obs.write_LDOS = flag_write_LDOS;
+
+    /*LDOS messages to the root are tagged with the index of the point
+     *within its group, bounded by MPI_TAG_UB. Messages from one group keep
+     *their order, such that repeated tags still match.*/
+    int *p_tag_ub = nullptr;
+    int flag_tag_ub = 0;
+    MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_TAG_UB, &p_tag_ub, &flag_tag_ub);
+    const int tag_ub = flag_tag_ub ? *p_tag_ub : 32767;
+    auto LDOS_tag = [&](int e_glo)
+    { return (e_glo / num_energy_groups) % tag_ub; };
+
+    auto Store_DOS = [&](const s_EnergyPoint &pt)
+    {
 #ifdef AMREX_USE_GPU
-            d_Sigma_contact_data.copy(h_Sigma_contact_data);
+        amrex::Gpu::copy(amrex::Gpu::deviceToHost, d_Trace_r.begin(),
+                         d_Trace_r.end(), h_Trace_r.begin());
+        amrex::Gpu::copy(amrex::Gpu::deviceToHost, d_Trace_i.begin(),
+                         d_Trace_i.end(), h_Trace_i.begin());
 #endif
 
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n_glo = global_contact_index[c];
+        /*the DOS path is distributed over energy groups, traces are summed
+         *over the block columns of this group and, after the energy loop,
+         *over the groups*/
+        MPI_Allreduce(MPI_IN_PLACE, h_Trace_r.dataPtr(), num_traces,
+                      MPI_DOUBLE, MPI_SUM, BlkCol_Comm);
+        MPI_Allreduce(MPI_IN_PLACE, h_Trace_i.dataPtr(), num_traces,
+                      MPI_DOUBLE, MPI_SUM, BlkCol_Comm);
 
-                if (n_glo >= vec_cumu_blkCol_size[my_rank] &&
-                    n_glo < vec_cumu_blkCol_size[my_rank + 1])
-                {
-                    int n = n_glo - vec_cumu_blkCol_size[my_rank];
-                    h_Alpha_loc(n) = h_Alpha_loc(n) - h_Sigma_contact(c);
-                }
-            }
+        h_DOS_loc(pt.e_glo) =
+            spin_degen * h_Trace_r[0] / num_atoms_per_unitcell;
+        h_Transmission_loc(pt.e_glo) = h_Trace_r[1];
+
+        if (flag_write_LDOS)
+        {
 #ifdef AMREX_USE_GPU
-            d_Alpha_loc_data.copy(h_Alpha_loc_data);
+            h_LDOS_loc_data.copy(d_LDOS_loc_data);
+            amrex::Gpu::streamSynchronize();
 #endif
 
-            /*MPI_Allgather*/
-            MPI_Allgatherv(&h_Alpha_loc(0), blkCol_size_loc, MPI_BlkType,
-                           &h_Alpha_glo(0), MPI_recv_count.data(),
-                           MPI_recv_disp.data(), MPI_BlkType,
-                           ParallelDescriptor::Communicator());
+            /*gathered on the first process of the group, which passes it
+             *to the root unless it is the root*/
+            MPI_Gatherv(&h_LDOS_loc(0), blkCol_size_loc, MPI_DOUBLE,
+                        &h_LDOS_glo(0), MPI_blkCol_recv_count.data(),
+                        MPI_blkCol_recv_disp.data(), MPI_DOUBLE, 0,
+                        BlkCol_Comm);
 
-            for (int c = 0; c < NUM_CONTACTS; ++c)
+            if (NS_IOProcessor())
             {
-                int n_glo = global_contact_index[c];
-                h_Alpha_contact(c) = h_Alpha_glo(n_glo);
+                Write_LDOS(pt.e_glo, pt.E.real());
             }
-#ifdef AMREX_USE_GPU
-            d_Alpha_contact_data.copy(h_Alpha_contact_data);
-#endif
-
-            h_Y_glo(0) = 0;
-            h_X_glo(Hsize_glo - 1) = 0;
-            for (int section = 0; section < num_recursive_parts; ++section)
+            else if (blkCol_rank == 0)
             {
-                for (int n = std::max(1, Hsize_recur_part * section);
-                     n < std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-                     ++n)
-                {
-                    int p = (n - 1) % offDiag_repeatBlkSize;
-                    h_Ytil_glo(n) =
-                        h_Hc_loc(p) / (h_Alpha_glo(n - 1) - h_Y_glo(n - 1));
-                    h_Y_glo(n) = h_Hb_loc(p) * h_Ytil_glo(n);
-                }
-                for (int n = std::min(Hsize_glo - 2,
-                                      Hsize_recur_part *
-                                          (num_recursive_parts - section));
-                     n >=
-                     Hsize_recur_part * (num_recursive_parts - section - 1);
-                     n--)
-                {
-                    int p = n % offDiag_repeatBlkSize;
-                    h_Xtil_glo(n) =
-                        h_Hb_loc(p) / (h_Alpha_glo(n + 1) - h_X_glo(n + 1));
-                    h_X_glo(n) = h_Hc_loc(p) * h_Xtil_glo(n);
-                }
-
-#ifdef AMREX_USE_GPU
-                int Ytil_begin = section * Hsize_recur_part;
-                int Ytil_end =
-                    std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Ytil_glo.p + Ytil_begin,
-                                      h_Ytil_glo.p + Ytil_end,
-                                      d_Ytil_glo.p + Ytil_begin);
-
-                int Xtil_begin =
-                    Hsize_recur_part * (num_recursive_parts - section - 1);
-                int Xtil_end =
-                    std::min(Hsize_glo, Hsize_recur_part *
-                                            (num_recursive_parts - section));
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Xtil_glo.p + Xtil_begin,
-                                      h_Xtil_glo.p + Xtil_end,
-                                      d_Xtil_glo.p + Xtil_begin);
-#endif
-            }
-
-#ifdef AMREX_USE_GPU
-            int X_begin = vec_cumu_blkCol_size[my_rank];
-            int X_end = X_begin + blkCol_size_loc;
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_X_glo.p + X_begin,
-                                  h_X_glo.p + X_end, d_X_loc.p);
-
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Y_glo.p + X_begin,
-                                  h_Y_glo.p + X_end, d_Y_loc.p);
-#else
-            for (int c = 0; c < blkCol_size_loc; ++c)
-            {
-                int n = c + vec_cumu_blkCol_size[my_rank];
-                h_Y_loc(c) = h_Y_glo(n);
-                h_X_loc(c) = h_X_glo(n);
-            }
-#endif
-
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n = global_contact_index[c];
-                h_Y_contact(c) = h_Y_glo(n);
-                h_X_contact(c) = h_X_glo(n);
-            }
-#ifdef AMREX_USE_GPU
-            d_X_contact_data.copy(h_X_contact_data);
-            d_Y_contact_data.copy(h_Y_contact_data);
-#endif
-
-            for (int t = 0; t < num_traces; ++t)
-            {
-                h_Trace_r[t] = 0.;
-                h_Trace_i[t] = 0.;
-            }
-#ifdef AMREX_USE_GPU
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Trace_r.begin(),
-                                  h_Trace_r.end(), d_Trace_r.begin());
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Trace_i.begin(),
-                                  h_Trace_i.end(), d_Trace_i.begin());
-            amrex::Gpu::streamSynchronize();
-#endif
-
-            /*following is for lambda capture*/
-            int cumulative_columns = vec_cumu_blkCol_size[my_rank];
-            int Hsize = Hsize_glo;
-            auto &GC_ID = global_contact_index;
-            auto &CT_ID = contact_transmission_index;
-            auto *degen_vec_ptr = degen_vec.dataPtr();
-            bool gpu_flag_write_LDOS = flag_write_LDOS;
-
-            amrex::ParallelFor(
-                blkCol_size_loc,
-                [=] AMREX_GPU_DEVICE(int n) noexcept
-                {
-                    int n_glo = n + cumulative_columns; /*global column number*/
-                    ComplexType one(1., 0.);
-                    ComplexType minus_one(-1., 0.);
-                    ComplexType imag(0., 1.);
-
-#ifdef COMPUTE_GREENS_FUNCTION_OFFDIAG_ELEMS
-                    GR_loc(n_glo, n) = one / (Alpha(n) - X(n) - Y(n));
-
-                    for (int m = n_glo; m > 0; m--)
-                    {
-                        GR_loc(m - 1, n) = -1 * Ytil_glo(m) * GR_loc(m, n);
-                    }
-                    for (int m = n_glo; m < Hsize - 1; ++m)
-                    {
-                        GR_loc(m + 1, n) = -1 * Xtil_glo(m) * GR_loc(m, n);
-                    }
-#else
-                    GR_loc(n) = one / (Alpha(n) - X(n) - Y(n));
-#endif
-
-                    MatrixBlock<T> A_tk[NUM_CONTACTS];
-                    MatrixBlock<T> Gamma[NUM_CONTACTS];
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                    for (int m = 0; m < Hsize; ++m)
-                    {
-                        A_loc(m, n) = 0.;
-                    }
-#else
-                    A_loc(n) = 0.;
-#endif
-                    for (int k = 0; k < NUM_CONTACTS; ++k)
-                    {
-                        int k_glo = GC_ID[k];
-                        MatrixBlock<T> G_contact_kk =
-                            one /
-                            (Alpha_contact(k) - X_contact(k) - Y_contact(k));
-
-                        MatrixBlock<T> temp = G_contact_kk;
-                        for (int m = k_glo; m < n_glo; ++m)
-                        {
-                            temp = -1 * Xtil_glo(m) * temp;
-                        }
-                        for (int m = k_glo; m > n_glo; m--)
-                        {
-                            temp = -1 * Ytil_glo(m) * temp;
-                        }
-                        MatrixBlock<T> G_contact_nk = temp;
-
-                        Gamma[k] = imag * (Sigma_contact(k) -
-                                           Sigma_contact(k).Dagger());
-
-                        MatrixBlock<T> A_nn =
-                            G_contact_nk * Gamma[k] * G_contact_nk.Dagger();
-                        MatrixBlock<T> A_kn =
-                            G_contact_kk * Gamma[k] * G_contact_nk.Dagger();
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                        A_loc(k_glo, n) = A_loc(k_glo, n) + A_kn;
-                        for (int m = k_glo + 1; m < Hsize; ++m)
-                        {
-                            A_kn = -1 * Xtil_glo(m - 1) * A_kn;
-                            A_loc(m, n) = A_loc(m, n) + A_kn;
-                        }
-                        for (int m = k_glo - 1; m >= 0; m--)
-                        {
-                            A_kn = -1 * Ytil_glo(m + 1) * A_kn;
-                            A_loc(m, n) = A_loc(m, n) + A_kn;
-                        }
-                        A_tk[k] = 0.;
-                        if (n_glo == CT_ID[k])
-                        {
-                            A_tk[k] = A_kn;
-                        }
-#else
-                        for (int m = k_glo + 1; m < Hsize; ++m)
-                        {
-                            A_kn = -1 * Xtil_glo(m - 1) * A_kn;
-                        }
-                        for (int m = k_glo - 1; m >= 0; m--)
-                        {
-                            A_kn = -1 * Ytil_glo(m + 1) * A_kn;
-                        }
-                        A_tk[k] = 0.;
-                        if (n_glo == CT_ID[k])
-                        {
-                            A_tk[k] = A_kn;
-                        }
-                        A_loc(n) = A_loc(n) + A_nn;
-#endif
-                    }
-
-                /*LDOS*/
-
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                    ComplexType val =
-                        A_loc(n_glo, n).DiagDotSum(degen_vec_ptr) /
-                        (2. * MathConst::pi);
-#else
-                    ComplexType val = A_loc(n).DiagDotSum(degen_vec_ptr) /
-                                      (2. * MathConst::pi);
-#endif
-
-                    if (gpu_flag_write_LDOS) LDOS_loc(n) = val.real();
-
-                    amrex::HostDevice::Atomic::Add(&(trace_r[0]), val.real());
-                    amrex::HostDevice::Atomic::Add(&(trace_i[0]), val.imag());
-
-                    /*Transmission*/
-                    auto T12 = Gamma[0] * A_tk[1];
-
-                    ComplexType T12_blksum = T12.DiagDotSum(degen_vec_ptr);
-
-                    amrex::HostDevice::Atomic::Add(&(trace_r[1]),
-                                                   T12_blksum.real());
-                    amrex::HostDevice::Atomic::Add(&(trace_i[1]),
-                                                   T12_blksum.imag());
-                });
-
-#ifdef AMREX_USE_GPU
-            amrex::Gpu::streamSynchronize();
-            amrex::Gpu::copy(amrex::Gpu::deviceToHost, d_Trace_r.begin(),
-                             d_Trace_r.end(), h_Trace_r.begin());
-            amrex::Gpu::copy(amrex::Gpu::deviceToHost, d_Trace_i.begin(),
-                             d_Trace_i.end(), h_Trace_i.begin());
-#endif
-
-            for (int t = 0; t < num_traces; ++t)
-            {
-                amrex::ParallelDescriptor::ReduceRealSum(h_Trace_r[t]);
-                amrex::ParallelDescriptor::ReduceRealSum(h_Trace_i[t]);
+                MPI_Send(&h_LDOS_glo(0), Hsize_glo, MPI_DOUBLE, NS_root,
+                         LDOS_tag(pt.e_glo), NS_Comm);
             }
+        }
+        Reset_Traces();
+    };
 
-            h_DOS_loc(e_glo) =
-                spin_degen * h_Trace_r[0] / num_atoms_per_unitcell;
-            h_Transmission_loc(e_glo) = h_Trace_r[1];
-
-            if (flag_write_LDOS)
-            {
-#ifdef AMREX_USE_GPU
-                h_LDOS_loc_data.copy(d_LDOS_loc_data);
-                amrex::Gpu::streamSynchronize();
-#endif
+    Reset_Traces();
+    Run_RGF_EnergyLoop(Get_EnergyPoints(ContourPath_DOS, true), Store_DOS,
+                       DOS_obs);
 
-                MPI_Gatherv(&h_LDOS_loc(0), blkCol_size_loc, MPI_DOUBLE,
-                            &h_LDOS_glo(0), MPI_recv_count.data(),
-                            MPI_recv_disp.data(), MPI_DOUBLE,
-                            ParallelDescriptor::IOProcessorNumber(),
-                            ParallelDescriptor::Communicator());
+    MPI_Allreduce(MPI_IN_PLACE, &(h_DOS_loc(0)), E_total_pts, MPI_DOUBLE,
+                  MPI_SUM, Energy_Comm);
+    MPI_Allreduce(MPI_IN_PLACE, &(h_Transmission_loc(0)), E_total_pts,
+                  MPI_DOUBLE, MPI_SUM, Energy_Comm);
 
-                std::string spatialdos_filename =
-                    dos_foldername + "/Ept_" + std::to_string(e_glo) + ".dat";
+    if (flag_write_LDOS and NS_IOProcessor() and num_energy_groups > 1)
+    {
+        /*LDOS of the energy points of the other groups*/
+        for (auto &pt : Get_EnergyPoints(ContourPath_DOS, false))
+        {
+            if (is_energy_pt_of_this_group(pt.e_glo)) continue;
 
-                Write_Table1D(h_PTD_glo_vec, h_LDOS_glo_data,
-                              spatialdos_filename,
-                              "PTD LDOS_r at E=" + std::to_string(E.real()));
-            }
+            const int group = pt.e_glo % num_energy_groups;
+            MPI_Recv(&h_LDOS_glo(0), Hsize_glo, MPI_DOUBLE,
+                     group * num_proc_per_energy_group, LDOS_tag(pt.e_glo),
+                     NS_Comm, MPI_STATUS_IGNORE);
+            Write_LDOS(pt.e_glo, pt.E.real());
         }
-        e_prev_pts += ContourPath_DOS[p].num_pts;
     }
 
     amrex::Vector<ComplexType> E_total_vec(E_total_pts);
-    e_prev_pts = 0;
+    int e_prev_pts = 0;
     for (auto &path : ContourPath_DOS)
     {
         for (int e = 0; e < path.num_pts; ++e)
@@ -2583,7 +3644,7 @@ void c_NEGF_Common<T>::Compute_DensityOfStates(std::string dos_foldername,
         e_prev_pts += path.num_pts;
     }
 
-    if (amrex::ParallelDescriptor::IOProcessor())
+    if (NS_IOProcessor())
     {
         RealTable1D h_Conductance_loc_data({0}, {E_total_pts},
                                            The_Pinned_Arena());
@@ -2634,6 +3695,8 @@ void c_NEGF_Common<T>::Compute_InducedCharge(RealTable1D &n_curr_out_data)
     }
     // proc_times[1] = amrex::second() - noneq_time_begin;
 
+    Reduce_ChargeOverEnergyGroups();
+
     // MPI_Reduce(proc_times,
     //            max_times,
     //            2,
@@ -2661,7 +3724,8 @@ void c_NEGF_Common<T>::Compute_InducedCharge(RealTable1D &n_curr_out_data)
     auto const &RhoInduced_loc = n_curr_out_data.table();
 
     int SSL_offset = site_size_loc_offset; /*changes for multiple nanotube*/
-    amrex::ParallelFor(blkCol_size_loc,
+    /*only processes of energy group 0 own field sites*/
+    amrex::ParallelFor(MPI_recv_count[my_rank],
                        [=] AMREX_GPU_DEVICE(int n) noexcept
                        {
                            RhoInduced_loc(n + SSL_offset) =
@@ -2724,7 +3788,7 @@ void c_NEGF_Common<T>::Compute_InducedCharge(RealTable1D &n_curr_out_data)
         h_RhoInduced_loc_data.copy(n_curr_out_data);
 #endif
 
-        MPI_Barrier(ParallelDescriptor::Communicator());
+        MPI_Barrier(NS_Comm);
 
         RealTable1D h_Rho0_data({0}, {Hsize_glo}, The_Pinned_Arena());
         RealTable1D h_RhoEq_data({0}, {Hsize_glo}, The_Pinned_Arena());
@@ -2736,28 +3800,27 @@ void c_NEGF_Common<T>::Compute_InducedCharge(RealTable1D &n_curr_out_data)
         auto const &h_RhoNonEq = h_RhoNonEq_data.table();
         auto const &h_RhoInduced = h_RhoInduced_data.table();
 
-        MPI_Gatherv(&h_Rho0_loc(0), blkCol_size_loc, MPI_DOUBLE, &h_Rho0(0),
-                    MPI_recv_count.data(), MPI_recv_disp.data(), MPI_DOUBLE,
-                    ParallelDescriptor::IOProcessorNumber(),
-                    ParallelDescriptor::Communicator());
+        MPI_Gatherv(&h_Rho0_loc(0), MPI_recv_count[my_rank], MPI_DOUBLE,
+                    &h_Rho0(0), MPI_recv_count.data() + NS_rank_begin,
+                    MPI_recv_disp.data() + NS_rank_begin, MPI_DOUBLE, NS_root,
+                    NS_Comm);
 
-        MPI_Gatherv(&h_RhoEq_loc(0), blkCol_size_loc, MPI_DOUBLE, &h_RhoEq(0),
-                    MPI_recv_count.data(), MPI_recv_disp.data(), MPI_DOUBLE,
-                    ParallelDescriptor::IOProcessorNumber(),
-                    ParallelDescriptor::Communicator());
+        MPI_Gatherv(&h_RhoEq_loc(0), MPI_recv_count[my_rank], MPI_DOUBLE,
+                    &h_RhoEq(0), MPI_recv_count.data() + NS_rank_begin,
+                    MPI_recv_disp.data() + NS_rank_begin, MPI_DOUBLE, NS_root,
+                    NS_Comm);
 
-        MPI_Gatherv(&h_RhoNonEq_loc(0), blkCol_size_loc, MPI_DOUBLE,
-                    &h_RhoNonEq(0), MPI_recv_count.data(), MPI_recv_disp.data(),
-                    MPI_DOUBLE, ParallelDescriptor::IOProcessorNumber(),
-                    ParallelDescriptor::Communicator());
+        MPI_Gatherv(&h_RhoNonEq_loc(0), MPI_recv_count[my_rank], MPI_DOUBLE,
+                    &h_RhoNonEq(0), MPI_recv_count.data() + NS_rank_begin,
+                    MPI_recv_disp.data() + NS_rank_begin, MPI_DOUBLE, NS_root,
+                    NS_Comm);
 
-        MPI_Gatherv(&h_RhoInduced_loc(0), blkCol_size_loc, MPI_DOUBLE,
-                    &h_RhoInduced(0), MPI_recv_count.data(),
-                    MPI_recv_disp.data(), MPI_DOUBLE,
-                    ParallelDescriptor::IOProcessorNumber(),
-                    ParallelDescriptor::Communicator());
+        MPI_Gatherv(&h_RhoInduced_loc(0), MPI_recv_count[my_rank], MPI_DOUBLE,
+                    &h_RhoInduced(0), MPI_recv_count.data() + NS_rank_begin,
+                    MPI_recv_disp.data() + NS_rank_begin, MPI_DOUBLE, NS_root,
+                    NS_Comm);
 
-        if (ParallelDescriptor::IOProcessor())
+        if (NS_IOProcessor())
         {
             Write_ChargeComponents(iter_filename_str + "_chargeComp.dat",
                                    h_RhoEq_data, h_RhoNonEq_data, h_Rho0_data,
@@ -2766,6 +3829,100 @@ void c_NEGF_Common<T>::Compute_InducedCharge(RealTable1D &n_curr_out_data)
     }
 }
 
+template <typename T>
+void c_NEGF_Common<T>::Reduce_ChargeOverEnergyGroups()
+{
+    /*Each energy group holds a partial sum of RhoEq and RhoNonEq over its
+     *slice of the contour. Both are packed in one buffer and combined with a
+     *single reduction over the processes owning the same block columns.*/
+    if (num_energy_groups == 1 or blkCol_size_loc == 0) return;
+
+    const int num_blk_elems = sizeof(MatrixBlock<T>) / sizeof(ComplexType);
+    const int num_tables = flag_noneq_exists ? 2 : 1;
+    const int buffer_size = num_tables * blkCol_size_loc;
+
+    BlkTable1D h_Rho_buffer_data({0}, {buffer_size}, The_Pinned_Arena());
+    auto const &h_Rho_buffer = h_Rho_buffer_data.table();
+
+#ifdef AMREX_USE_GPU
+    auto const &RhoEq_loc = d_RhoEq_loc_data.table();
+    auto const &RhoNonEq_loc = d_RhoNonEq_loc_data.table();
+
+    amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, RhoEq_loc.p,
+                          RhoEq_loc.p + blkCol_size_loc, h_Rho_buffer.p);
+    if (flag_noneq_exists)
+    {
+        amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, RhoNonEq_loc.p,
+                              RhoNonEq_loc.p + blkCol_size_loc,
+                              h_Rho_buffer.p + blkCol_size_loc);
+    }
+    amrex::Gpu::streamSynchronize();
+#else
+    auto const &RhoEq_loc = h_RhoEq_loc_data.table();
+    auto const &RhoNonEq_loc = h_RhoNonEq_loc_data.table();
+
+    for (int n = 0; n < blkCol_size_loc; ++n)
+    {
+        h_Rho_buffer(n) = RhoEq_loc(n);
+        if (flag_noneq_exists)
+            h_Rho_buffer(n + blkCol_size_loc) = RhoNonEq_loc(n);
+    }
+#endif
+
+    MPI_Allreduce(MPI_IN_PLACE, &(h_Rho_buffer(0)), buffer_size * num_blk_elems,
+                  MPI_DOUBLE_COMPLEX, MPI_SUM, Energy_Comm);
+
+#ifdef AMREX_USE_GPU
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Rho_buffer.p,
+                          h_Rho_buffer.p + blkCol_size_loc, RhoEq_loc.p);
+    if (flag_noneq_exists)
+    {
+        amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
+                              h_Rho_buffer.p + blkCol_size_loc,
+                              h_Rho_buffer.p + buffer_size, RhoNonEq_loc.p);
+    }
+    amrex::Gpu::streamSynchronize();
+#else
+    for (int n = 0; n < blkCol_size_loc; ++n)
+    {
+        RhoEq_loc(n) = h_Rho_buffer(n);
+        if (flag_noneq_exists)
+            RhoNonEq_loc(n) = h_Rho_buffer(n + blkCol_size_loc);
+    }
+#endif
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Reduce_OverEnergyGroups(BlkTable1D &Rho_loc_data)
+{
+    /*Rho_loc_data, on the device with GPUs, holds a partial sum over the
+     *energy points of this group, see Get_EnergyPoints*/
+    if (num_energy_groups == 1 or blkCol_size_loc == 0) return;
+
+    const int num_blk_elems = sizeof(MatrixBlock<T>) / sizeof(ComplexType);
+    auto const &Rho_loc = Rho_loc_data.table();
+
+#ifdef AMREX_USE_GPU
+    BlkTable1D h_Rho_buffer_data({0}, {blkCol_size_loc}, The_Pinned_Arena());
+    auto const &h_Rho_buffer = h_Rho_buffer_data.table();
+
+    amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, Rho_loc.p,
+                          Rho_loc.p + blkCol_size_loc, h_Rho_buffer.p);
+    amrex::Gpu::streamSynchronize();
+
+    MPI_Allreduce(MPI_IN_PLACE, &(h_Rho_buffer(0)),
+                  blkCol_size_loc * num_blk_elems, MPI_DOUBLE_COMPLEX, MPI_SUM,
+                  Energy_Comm);
+
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Rho_buffer.p,
+                          h_Rho_buffer.p + blkCol_size_loc, Rho_loc.p);
+    amrex::Gpu::streamSynchronize();
+#else
+    MPI_Allreduce(MPI_IN_PLACE, &(Rho_loc(0)), blkCol_size_loc * num_blk_elems,
+                  MPI_DOUBLE_COMPLEX, MPI_SUM, Energy_Comm);
+#endif
+}
+
 template <typename T>
 template <typename TableType>
 void c_NEGF_Common<T>::Write_ChargeComponents(
@@ -2808,6 +3965,21 @@ void c_NEGF_Common<T>::Fetch_InputLocalCharge_FromNanostructure(
     h_n_curr_in_glo_data.clear();
 }
 
+template <typename T>
+void c_NEGF_Common<T>::Fetch_PotentialAtSites(RealTable1D &container_data,
+                                              const int NS_offset,
+                                              const int data_size)
+{
+    /*the first data_size local sites are the ones of this process in the
+     *partition of the self-consistency algorithm, see MPI_recv_count*/
+    auto const &h_U_loc = h_U_loc_data.const_table();
+    auto const &container = container_data.table();
+    for (int i = 0; i < data_size; ++i)
+    {
+        container(i + NS_offset) = h_U_loc(i);
+    }
+}
+
 template <typename T>
 void c_NEGF_Common<T>::Scatterv_BroydenComputed_GlobalCharge(
     RealTable1D &n_curr_in_glo_data)
@@ -2820,8 +3992,8 @@ void c_NEGF_Common<T>::Scatterv_BroydenComputed_GlobalCharge(
 
     MPI_Scatterv(&n_curr_in_glo(0), MPI_send_count.data(), MPI_send_disp.data(),
                  MPI_DOUBLE, &h_n_curr_in_loc(0), num_local_field_sites,
-                 MPI_DOUBLE, ParallelDescriptor::IOProcessorNumber(),
-                 ParallelDescriptor::Communicator());
+                 MPI_DOUBLE, ParallelContext::IOProcessorNumberSub(),
+                 ParallelContext::CommunicatorSub());
 
     // amrex::Print() << "h_n_curr_in_loc in CopyToNS: \n";
     // amrex::Print() << "MPI_send_count/disp: " << MPI_send_count[0] << " " <<
@@ -2843,7 +4015,7 @@ void c_NEGF_Common<T>::Write_PotentialAtSites(const std::string filename_prefix)
     std::ofstream outfile;
     std::string filename = filename_prefix + "_U.dat";
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         int size = num_field_sites;
         outfile.open(filename);
@@ -2852,12 +4024,12 @@ void c_NEGF_Common<T>::Write_PotentialAtSites(const std::string filename_prefix)
     auto const &h_U_glo = h_U_glo_data.table();
     auto const &h_U_loc = h_U_loc_data.table();
 
-    MPI_Gatherv(&h_U_loc(0), blkCol_size_loc, MPI_DOUBLE, &h_U_glo(0),
+    MPI_Gatherv(&h_U_loc(0), MPI_recv_count[my_rank], MPI_DOUBLE, &h_U_glo(0),
                 MPI_recv_count.data(), MPI_recv_disp.data(), MPI_DOUBLE,
-                ParallelDescriptor::IOProcessorNumber(),
-                ParallelDescriptor::Communicator());
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         amrex::Print() << " Root Writing " << filename << "\n";
         for (int l = 0; l < num_field_sites; ++l)
@@ -2875,7 +4047,7 @@ template <typename T>
 void c_NEGF_Common<T>::Write_InputInducedCharge(
     const std::string filename_prefix, const RealTable1D &n_curr_in_data)
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         std::string filename = filename_prefix + "_Qin.dat";
 
@@ -2908,76 +4080,24 @@ void c_NEGF_Common<T>::Write_ChargeNorm(const std::string filename_prefix,
 template <typename T>
 void c_NEGF_Common<T>::Compute_RhoNonEq()
 {
-    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
-    auto const &h_Hb_loc = h_Hb_loc_data.table();
-    auto const &h_Hc_loc = h_Hc_loc_data.table();
-    auto const &h_tau = h_tau_glo_data.table();
-
     Allocate_TemporaryArraysForGFComputation();
 
-    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
-    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
-    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
-    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
-    auto const &h_X_glo = h_X_glo_data.table();
-    auto const &h_Y_glo = h_Y_glo_data.table();
-    auto const &h_X_loc = h_X_loc_data.table();
-    auto const &h_Y_loc = h_Y_loc_data.table();
-    auto const &h_Alpha_contact = h_Alpha_contact_data.table();
-    auto const &h_Y_contact = h_Y_contact_data.table();
-    auto const &h_X_contact = h_X_contact_data.table();
-    auto const &h_Sigma_contact = h_Sigma_contact_data.table();
-    auto const &h_Fermi_contact = h_Fermi_contact_data.table();
-
 #ifdef AMREX_USE_GPU
     auto const &RhoNonEq_loc = d_RhoNonEq_loc_data.table();
     amrex::ParallelFor(blkCol_size_loc, [=] AMREX_GPU_DEVICE(int n) noexcept
                        { RhoNonEq_loc(n) = 0.; });
-    auto const &GR_loc = d_GR_loc_data.table();
-    auto const &A_loc = d_A_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = d_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = d_Xtil_glo_data.const_table();
-    auto const &d_Xtil_glo = d_Xtil_glo_data.table();
-    auto const &Ytil_glo = d_Ytil_glo_data.const_table();
-    auto const &d_Ytil_glo = d_Ytil_glo_data.table();
-    auto const &X = d_X_loc_data.const_table();
-    auto const &d_X_loc = d_X_loc_data.table();
-    auto const &Y = d_Y_loc_data.const_table();
-    auto const &d_Y_loc = d_Y_loc_data.table();
-
-    auto const &Alpha_contact = d_Alpha_contact_data.const_table();
-    auto const &X_contact = d_X_contact_data.const_table();
-    auto const &Y_contact = d_Y_contact_data.const_table();
-    auto const &Sigma_contact = d_Sigma_contact_data.const_table();
-    auto const &Fermi_contact = d_Fermi_contact_data.const_table();
-
     auto &degen_vec = block_degen_gpuvec;
-
 #else
     ComplexType zero(0., 0.);
     SetVal_Table1D(h_RhoNonEq_loc_data, zero);
     auto const &RhoNonEq_loc = h_RhoNonEq_loc_data.table();
-    auto const &GR_loc = h_GR_loc_data.table();
-    auto const &A_loc = h_A_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = h_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = h_Xtil_glo_data.const_table();
-    auto const &Ytil_glo = h_Ytil_glo_data.const_table();
-    auto const &X = h_X_loc_data.const_table();
-    auto const &Y = h_Y_loc_data.const_table();
-
-    auto const &Alpha_contact = h_Alpha_contact_data.const_table();
-    auto const &X_contact = h_X_contact_data.const_table();
-    auto const &Y_contact = h_Y_contact_data.const_table();
-    auto const &Sigma_contact = h_Sigma_contact_data.const_table();
-    auto const &Fermi_contact = h_Fermi_contact_data.const_table();
-
     auto &degen_vec = block_degen_vec;
-
 #endif
     bool flag_compute_integrand = false;
-    if (flag_write_integrand_iter or flag_correct_integration_limits)
+    /*the integrand is indexed along ContourPath_RhoNonEq, which is replaced
+     *by the adaptive quadrature, hence it is not sampled in that mode*/
+    if (!flag_noneq_adaptive_quadrature and
+        (flag_write_integrand_iter or flag_sample_integrand))
     {
         flag_compute_integrand = true;
         amrex::Print() << "\n setting flag_compute_integrand: "
@@ -3026,298 +4146,123 @@ void c_NEGF_Common<T>::Compute_RhoNonEq()
                            });
     }
 
-    int e_prev = 0;
-    for (int p = 0; p < ContourPath_RhoNonEq.size(); ++p)
+    if (flag_noneq_adaptive_quadrature)
+    {
+        Accumulate_RhoNonEq_Adaptive();
+    }
+    else if (energy_batch_size > 1)
     {
-        for (int e = 0; e < ContourPath_RhoNonEq[p].num_pts; ++e)
+        Accumulate_RhoNonEq_Batched(flag_compute_integrand);
+    }
+    else
+    {
+        amrex::Real const_multiplier = -1 * spin_degen / (2 * MathConst::pi);
+
+        s_RhoNonEq_Observable<T> RhoNonEq_obs;
+        RhoNonEq_obs.RhoNonEq_loc = RhoNonEq_loc;
+        RhoNonEq_obs.degen_vec_ptr = degen_vec.dataPtr();
+        RhoNonEq_obs.const_multiplier = const_multiplier;
+        if (flag_eq_pole_expansion)
         {
-            ComplexType E = ContourPath_RhoNonEq[p].E_vec[e];
-            ComplexType weight = ContourPath_RhoNonEq[p].weight_vec[e];
-            ComplexType mul_factor = ContourPath_RhoNonEq[p].mul_factor_vec[e];
+            RhoNonEq_obs.eq_mu = mu_min;
+            RhoNonEq_obs.eq_kT = kT_min;
+        }
 
-            for (int n = 0; n < blkCol_size_loc; ++n)
+        auto energy_pts = Get_EnergyPoints(ContourPath_RhoNonEq, true);
+
+        auto Run_WithIntegrand = [&](auto... observables)
+        {
+            if (flag_compute_integrand)
             {
-                h_Alpha_loc(n) = E + h_minusHa_loc(n);
-                /*+ because h_minusHa is defined previously as -(H0+U)*/
+                s_Integrand_Observable<T> Integrand_obs;
+                Integrand_obs.Integrand = NonEq_Integrand;
+                Integrand_obs.Integrand_Source = NonEq_Integrand_Source;
+                Integrand_obs.Integrand_Drain = NonEq_Integrand_Drain;
+                Integrand_obs.degen_vec_ptr = degen_vec.dataPtr();
+                Integrand_obs.const_multiplier = const_multiplier;
+                Integrand_obs.n_channel = int(Hsize_glo / 2);
+                Integrand_obs.n_source = int(Hsize_glo / 4);
+                Integrand_obs.n_drain = int(Hsize_glo * 3 / 4);
+
+                Run_RGF_EnergyLoop(energy_pts, nullptr, observables...,
+                                   Integrand_obs);
             }
+            else
+            {
+                Run_RGF_EnergyLoop(energy_pts, nullptr, observables...);
+            }
+        };
 
-            get_Sigma_at_contacts(h_Sigma_contact_data, E);
+        if (flag_fuse_current_with_charge)
+        {
+            /*current and transmission are accumulated at the same energy
+             *points, such that the pass that satisfies the self-consistency
+             *criterion also provides them, see Compute_Current*/
+            SetVal_Table1D(h_Current_loc_data, 0.);
+            h_NonEq_Transmission_data.resize(
+                {0}, {total_noneq_integration_pts}, The_Pinned_Arena());
+            SetVal_Table1D(h_NonEq_Transmission_data, 0.);
 #ifdef AMREX_USE_GPU
-            d_Sigma_contact_data.copy(h_Sigma_contact_data);
+            RealTable1D d_Current_loc_data({0}, {NUM_CONTACTS}, The_Arena());
+            RealTable1D d_NonEq_Transmission_data(
+                {0}, {total_noneq_integration_pts}, The_Arena());
+            d_Current_loc_data.copy(h_Current_loc_data);
+            d_NonEq_Transmission_data.copy(h_NonEq_Transmission_data);
+            auto const &Current_loc = d_Current_loc_data.table();
+            auto const &NonEq_Transmission = d_NonEq_Transmission_data.table();
+#else
+            auto const &Current_loc = h_Current_loc_data.table();
+            auto const &NonEq_Transmission = h_NonEq_Transmission_data.table();
 #endif
+            s_Current_Observable<T> Current_obs;
+            Current_obs.Current_loc = Current_loc;
+            Current_obs.GC_ID = global_contact_index;
+            Current_obs.degen_vec_ptr = degen_vec.dataPtr();
+            Current_obs.const_multiplier =
+                spin_degen * (PhysConst::q_e) / (PhysConst::h_eVperHz);
 
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n_glo = global_contact_index[c];
-                int n = n_glo - vec_cumu_blkCol_size[my_rank];
+            s_Transmission_Observable<T> Transmission_obs;
+            Transmission_obs.Transmission = NonEq_Transmission;
+            Transmission_obs.degen_vec_ptr = degen_vec.dataPtr();
+            Transmission_obs.n_transmission = contact_transmission_index[1];
+
+            Run_WithIntegrand(RhoNonEq_obs, Current_obs, Transmission_obs);
 
-                if (n_glo >= vec_cumu_blkCol_size[my_rank] &&
-                    n_glo < vec_cumu_blkCol_size[my_rank + 1])
-                {
-                    h_Alpha_loc(n) = h_Alpha_loc(n) - h_Sigma_contact(c);
-                }
-                h_Fermi_contact(c) =
-                    FermiFunction(E - mu_contact[c], kT_contact[c]);
-            }
 #ifdef AMREX_USE_GPU
-            d_Fermi_contact_data.copy(h_Fermi_contact_data);
-            d_Alpha_loc_data.copy(h_Alpha_loc_data);
+            h_Current_loc_data.copy(d_Current_loc_data);
+            h_NonEq_Transmission_data.copy(d_NonEq_Transmission_data);
+            amrex::Gpu::streamSynchronize();
 #endif
+            flag_fused_current_ready = true;
+        }
+        else
+        {
+            Run_WithIntegrand(RhoNonEq_obs);
+        }
+    }
 
-            /*MPI_Allgather*/
-            MPI_Allgatherv(&h_Alpha_loc(0), blkCol_size_loc, MPI_BlkType,
-                           &h_Alpha_glo(0), MPI_recv_count.data(),
-                           MPI_recv_disp.data(), MPI_BlkType,
-                           ParallelDescriptor::Communicator());
-
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n_glo = global_contact_index[c];
-                h_Alpha_contact(c) = h_Alpha_glo(n_glo);
-            }
+    if (flag_compute_integrand)
+    {
 #ifdef AMREX_USE_GPU
-            d_Alpha_contact_data.copy(h_Alpha_contact_data);
-#endif
-
-            h_Y_glo(0) = 0;
-            h_X_glo(Hsize_glo - 1) = 0;
-            for (int section = 0; section < num_recursive_parts; ++section)
-            {
-                for (int n = std::max(1, Hsize_recur_part * section);
-                     n < std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-                     ++n)
-                {
-                    int p = (n - 1) % offDiag_repeatBlkSize;
-                    h_Ytil_glo(n) =
-                        h_Hc_loc(p) / (h_Alpha_glo(n - 1) - h_Y_glo(n - 1));
-                    h_Y_glo(n) = h_Hb_loc(p) * h_Ytil_glo(n);
-                }
-                for (int n = std::min(Hsize_glo - 2,
-                                      Hsize_recur_part *
-                                          (num_recursive_parts - section));
-                     n >=
-                     Hsize_recur_part * (num_recursive_parts - section - 1);
-                     n--)
-                {
-                    int p = n % offDiag_repeatBlkSize;
-                    h_Xtil_glo(n) =
-                        h_Hb_loc(p) / (h_Alpha_glo(n + 1) - h_X_glo(n + 1));
-                    h_X_glo(n) = h_Hc_loc(p) * h_Xtil_glo(n);
-                }
-
-#ifdef AMREX_USE_GPU
-                int Ytil_begin = section * Hsize_recur_part;
-                int Ytil_end =
-                    std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Ytil_glo.p + Ytil_begin,
-                                      h_Ytil_glo.p + Ytil_end,
-                                      d_Ytil_glo.p + Ytil_begin);
-
-                int Xtil_begin =
-                    Hsize_recur_part * (num_recursive_parts - section - 1);
-                int Xtil_end =
-                    std::min(Hsize_glo, Hsize_recur_part *
-                                            (num_recursive_parts - section));
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Xtil_glo.p + Xtil_begin,
-                                      h_Xtil_glo.p + Xtil_end,
-                                      d_Xtil_glo.p + Xtil_begin);
-#endif
-            }
-
-#ifdef AMREX_USE_GPU
-            int X_begin = vec_cumu_blkCol_size[my_rank];
-            int X_end = X_begin + blkCol_size_loc;
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_X_glo.p + X_begin,
-                                  h_X_glo.p + X_end, d_X_loc.p);
-
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Y_glo.p + X_begin,
-                                  h_Y_glo.p + X_end, d_Y_loc.p);
-#else
-            for (int c = 0; c < blkCol_size_loc; ++c)
-            {
-                int n = c + vec_cumu_blkCol_size[my_rank];
-                h_Y_loc(c) = h_Y_glo(n);
-                h_X_loc(c) = h_X_glo(n);
-            }
-#endif
-
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n = global_contact_index[c];
-                h_Y_contact(c) = h_Y_glo(n);
-                h_X_contact(c) = h_X_glo(n);
-            }
-#ifdef AMREX_USE_GPU
-            d_X_contact_data.copy(h_X_contact_data);
-            d_Y_contact_data.copy(h_Y_contact_data);
-            amrex::Gpu::streamSynchronize();
-#endif
-
-            /*following is for lambda capture*/
-            int cumulative_columns = vec_cumu_blkCol_size[my_rank];
-            int Hsize = Hsize_glo;
-            auto &GC_ID = global_contact_index;
-            auto *degen_vec_ptr = degen_vec.dataPtr();
-
-            amrex::Real const_multiplier =
-                -1 * spin_degen / (2 * MathConst::pi);
-            bool compute_integrand = flag_compute_integrand;
-            int e_glo = e + e_prev;
-
-            amrex::ParallelFor(
-                blkCol_size_loc,
-                [=] AMREX_GPU_DEVICE(int n) noexcept
-                {
-                    int n_glo = n + cumulative_columns; /*global column number*/
-                    ComplexType one(1., 0.);
-
-#ifdef COMPUTE_GREENS_FUNCTION_OFFDIAG_ELEMS
-                    GR_loc(n_glo, n) = one / (Alpha(n) - X(n) - Y(n));
-                    for (int m = n_glo; m > 0; m--)
-                    {
-                        GR_loc(m - 1, n) = -1 * Ytil_glo(m) * GR_loc(m, n);
-                    }
-                    for (int m = n_glo; m < Hsize - 1; ++m)
-                    {
-                        GR_loc(m + 1, n) = -1 * Xtil_glo(m) * GR_loc(m, n);
-                    }
-#else
-                    GR_loc(n) = one / (Alpha(n) - X(n) - Y(n));
-#endif
-
-                    MatrixBlock<T> A_tk[NUM_CONTACTS];
-                    MatrixBlock<T> Gamma[NUM_CONTACTS];
-                    MatrixBlock<T> AnF_sum;
-                    AnF_sum = 0.;
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                    for (int m = 0; m < Hsize; ++m)
-                    {
-                        A_loc(m, n) = 0.;
-                    }
-#else
-                    A_loc(n) = 0.;
-#endif
-                    ComplexType imag(0., 1.);
-                    for (int k = 0; k < NUM_CONTACTS; ++k)
-                    {
-                        int k_glo = GC_ID[k];
-                        MatrixBlock<T> G_contact_kk =
-                            one /
-                            (Alpha_contact(k) - X_contact(k) - Y_contact(k));
-
-                        MatrixBlock<T> temp = G_contact_kk;
-                        for (int m = k_glo; m < n_glo; ++m)
-                        {
-                            temp = -1 * Xtil_glo(m) * temp;
-                        }
-                        for (int m = k_glo; m > n_glo; m--)
-                        {
-                            temp = -1 * Ytil_glo(m) * temp;
-                        }
-                        MatrixBlock<T> G_contact_nk = temp;
-
-                        Gamma[k] = imag * (Sigma_contact(k) -
-                                           Sigma_contact(k).Dagger());
-
-                        MatrixBlock<T> A_nn =
-                            G_contact_nk * Gamma[k] * G_contact_nk.Dagger();
-
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                        MatrixBlock<T> A_kn =
-                            G_contact_kk * Gamma[k] * G_contact_nk.Dagger();
-
-                        A_loc(k_glo, n) = A_loc(k_glo, n) + A_kn;
-                        for (int m = k_glo + 1; m < Hsize; ++m)
-                        {
-                            A_kn = -1 * Xtil_glo(m - 1) * A_kn;
-                            A_loc(m, n) = A_loc(m, n) + A_kn;
-                        }
-                        for (int m = k_glo - 1; m >= 0; m--)
-                        {
-                            A_kn = -1 * Ytil_glo(m + 1) * A_kn;
-                            A_loc(m, n) = A_loc(m, n) + A_kn;
-                        }
-                        A_tk[k] = 0.;
-                        if (n_glo == CT_ID[k])
-                        {
-                            A_tk[k] = A_kn;
-                        }
-#else
-                        A_loc(n) = A_loc(n) + A_nn;
-#endif
-                        AnF_sum = AnF_sum + A_nn * Fermi_contact(k);
-                    }
-
-                    /*RhoNonEq*/
-                    MatrixBlock<T> RhoNonEq_n =
-                        const_multiplier * AnF_sum * weight * mul_factor;
-                    RhoNonEq_loc(n) =
-                        RhoNonEq_loc(n) + RhoNonEq_n.DiagMult(degen_vec_ptr);
-
-                    if (compute_integrand)
-                    {
-                        if (n_glo == int(Hsize / 2))
-                        {
-                            MatrixBlock<T> Intermed =
-                                const_multiplier * AnF_sum;
-                            NonEq_Integrand(e_glo) =
-                                Intermed.DiagMult(degen_vec_ptr)
-                                    .DiagSum()
-                                    .real();
-                        }
-                        else if (n_glo == int(Hsize / 4))
-                        {
-                            MatrixBlock<T> Intermed =
-                                const_multiplier * AnF_sum;
-                            NonEq_Integrand_Source(e_glo) =
-                                Intermed.DiagMult(degen_vec_ptr)
-                                    .DiagSum()
-                                    .real();
-                        }
-                        else if (n_glo == int(Hsize * 3 / 4))
-                        {
-                            MatrixBlock<T> Intermed =
-                                const_multiplier * AnF_sum;
-                            NonEq_Integrand_Drain(e_glo) =
-                                Intermed.DiagMult(degen_vec_ptr)
-                                    .DiagSum()
-                                    .real();
-                        }
-                    }
-                });
-#ifdef AMREX_USE_GPU
-            amrex::Gpu::streamSynchronize();
-#endif
-        }
-        e_prev += ContourPath_RhoNonEq[p].num_pts;
-    }
-
-    if (flag_compute_integrand)
-    {
-#ifdef AMREX_USE_GPU
-        h_NonEq_Integrand_data.copy(d_NonEq_Integrand_data);
-        h_NonEq_Integrand_Source_data.copy(d_NonEq_Integrand_Source_data);
-        h_NonEq_Integrand_Drain_data.copy(d_NonEq_Integrand_Drain_data);
-        amrex::Gpu::streamSynchronize();
+        h_NonEq_Integrand_data.copy(d_NonEq_Integrand_data);
+        h_NonEq_Integrand_Source_data.copy(d_NonEq_Integrand_Source_data);
+        h_NonEq_Integrand_Drain_data.copy(d_NonEq_Integrand_Drain_data);
+        amrex::Gpu::streamSynchronize();
 #endif
 
         MPI_Allreduce(MPI_IN_PLACE, &(h_NonEq_Integrand(0)),
                       total_noneq_integration_pts, MPI_DOUBLE, MPI_SUM,
-                      ParallelDescriptor::Communicator());
+                      NS_Comm);
 
         MPI_Allreduce(MPI_IN_PLACE, &(h_NonEq_Integrand_Source(0)),
                       total_noneq_integration_pts, MPI_DOUBLE, MPI_SUM,
-                      ParallelDescriptor::Communicator());
+                      NS_Comm);
 
         MPI_Allreduce(MPI_IN_PLACE, &(h_NonEq_Integrand_Drain(0)),
                       total_noneq_integration_pts, MPI_DOUBLE, MPI_SUM,
-                      ParallelDescriptor::Communicator());
+                      NS_Comm);
 
-        if (amrex::ParallelDescriptor::IOProcessor())
+        if (NS_IOProcessor())
         {
             amrex::Vector<ComplexType> E_total_vec(total_noneq_integration_pts);
             int e_prev_pts = 0;
@@ -3355,8 +4300,9 @@ void c_NEGF_Common<T>::Compute_RhoNonEq()
             E_total_vec.clear();
         }
 
-        ParallelDescriptor::Bcast(&E_at_max_noneq_integrand, 1,
-                                  ParallelDescriptor::IOProcessorNumber());
+        ParallelDescriptor::Bcast(&E_at_max_noneq_integrand, 1, NS_root,
+                                  NS_Comm);
+        flag_integrand_peak_valid = true;
 
         h_NonEq_Integrand_data.clear();
         h_NonEq_Integrand_Source_data.clear();
@@ -3372,525 +4318,1041 @@ void c_NEGF_Common<T>::Compute_RhoNonEq()
 }
 
 template <typename T>
-void c_NEGF_Common<T>::Compute_RhoEq()
+void c_NEGF_Common<T>::Locate_NonEq_IntegrandPeak_Coarse()
 {
-    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
-    auto const &h_Hb_loc = h_Hb_loc_data.table();
-    auto const &h_Hc_loc = h_Hc_loc_data.table();
-    auto const &h_tau = h_tau_glo_data.table();
-
-    Allocate_TemporaryArraysForGFComputation();
-
-    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
-    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
-    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
-    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
-    auto const &h_X_glo = h_X_glo_data.table();
-    auto const &h_Y_glo = h_Y_glo_data.table();
-    auto const &h_X_loc = h_X_loc_data.table();
-    auto const &h_Y_loc = h_Y_loc_data.table();
-    auto const &h_Sigma_contact = h_Sigma_contact_data.table();
-
+    /*Coarse pass over the non-equilibrium window, used to locate the peak of
+     *the integrand when none was sampled at the present contact potentials.
+     *Only the channel integrand is evaluated.*/
+    amrex::Vector<c_IntegrationPath> prescan_path(1);
+    prescan_path[0].Define_RegularPoints(E_contour_right, E_rightmost,
+                                         noneq_prescan_pts);
+
+    RealTable1D h_Integrand_data({0}, {noneq_prescan_pts}, The_Pinned_Arena());
+    SetVal_Table1D(h_Integrand_data, 0.);
+    auto const &h_Integrand = h_Integrand_data.table();
 #ifdef AMREX_USE_GPU
-    auto const &RhoEq_loc = d_RhoEq_loc_data.table();
-    amrex::ParallelFor(blkCol_size_loc, [=] AMREX_GPU_DEVICE(int n) noexcept
-                       { RhoEq_loc(n) = 0.; });
-    /*constant references*/
-    auto const &Alpha = d_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = d_Xtil_glo_data.const_table();
-    auto const &d_Xtil_glo = d_Xtil_glo_data.table();
-    auto const &Ytil_glo = d_Ytil_glo_data.const_table();
-    auto const &d_Ytil_glo = d_Ytil_glo_data.table();
-    auto const &X = d_X_loc_data.const_table();
-    auto const &d_X_loc = d_X_loc_data.table();
-    auto const &Y = d_Y_loc_data.const_table();
-    auto const &d_Y_loc = d_Y_loc_data.table();
-    auto const &Sigma_contact = d_Sigma_contact_data.const_table();
+    RealTable1D d_Integrand_data({0}, {noneq_prescan_pts}, The_Arena());
+    d_Integrand_data.copy(h_Integrand_data);
+    auto const &Integrand = d_Integrand_data.table();
     auto &degen_vec = block_degen_gpuvec;
 #else
-    ComplexType zero(0., 0.);
-    SetVal_Table1D(h_RhoEq_loc_data, zero);
-    auto const &RhoEq_loc = h_RhoEq_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = h_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = h_Xtil_glo_data.const_table();
-    auto const &Ytil_glo = h_Ytil_glo_data.const_table();
-    auto const &X = h_X_loc_data.const_table();
-    auto const &Y = h_Y_loc_data.const_table();
-    auto const &Sigma_contact = h_Sigma_contact_data.const_table();
+    auto const &Integrand = h_Integrand_data.table();
     auto &degen_vec = block_degen_vec;
 #endif
 
-    for (int p = 0; p < ContourPath_RhoEq.size(); ++p)
+    s_Integrand_Observable<T> Integrand_obs;
+    Integrand_obs.Integrand = Integrand;
+    Integrand_obs.Integrand_Source = Integrand;
+    Integrand_obs.Integrand_Drain = Integrand;
+    Integrand_obs.degen_vec_ptr = degen_vec.dataPtr();
+    Integrand_obs.const_multiplier = -1 * spin_degen / (2 * MathConst::pi);
+    Integrand_obs.n_channel = int(Hsize_glo / 2);
+    Integrand_obs.n_source = -1;
+    Integrand_obs.n_drain = -1;
+
+    Allocate_TemporaryArraysForGFComputation();
+    Run_RGF_EnergyLoop(Get_EnergyPoints(prescan_path, true), nullptr,
+                       Integrand_obs);
+    Deallocate_TemporaryArraysForGFComputation();
+
+#ifdef AMREX_USE_GPU
+    h_Integrand_data.copy(d_Integrand_data);
+    amrex::Gpu::streamSynchronize();
+#endif
+    MPI_Allreduce(MPI_IN_PLACE, &(h_Integrand(0)), noneq_prescan_pts,
+                  MPI_DOUBLE, MPI_SUM, NS_Comm);
+
+    amrex::Real max_noneq_integrand = 0;
+    for (int e = 0; e < noneq_prescan_pts; ++e)
     {
-        for (int e = 0; e < ContourPath_RhoEq[p].num_pts; ++e)
+        if (max_noneq_integrand < fabs(h_Integrand(e)))
         {
-            ComplexType E = ContourPath_RhoEq[p].E_vec[e];
-            ComplexType weight = ContourPath_RhoEq[p].weight_vec[e];
-            ComplexType mul_factor = ContourPath_RhoEq[p].mul_factor_vec[e];
+            max_noneq_integrand = fabs(h_Integrand(e));
+            E_at_max_noneq_integrand = prescan_path[0].E_vec[e].real();
+        }
+    }
+    amrex::Print() << "\n Pre-scan with " << noneq_prescan_pts
+                   << " pts, abs. value of max integrand: "
+                   << max_noneq_integrand
+                   << " at E (eV): " << E_at_max_noneq_integrand << "\n";
 
-            for (int n = 0; n < blkCol_size_loc; ++n)
-            {
-                h_Alpha_loc(n) = E + h_minusHa_loc(n);
-                /*+ because -Ha = -H0a (=0) -U = -U as defined previously*/
-            }
+    flag_integrand_peak_valid = true;
+}
 
-            get_Sigma_at_contacts(h_Sigma_contact_data, E);
+template <typename T>
+void c_NEGF_Common<T>::Accumulate_RhoNonEq_Adaptive()
+{
+    /*Error-controlled quadrature of RhoNonEq over the nonequilibrium window.
+     *Each interval is integrated with the 15-point Gauss-Kronrod rule and
+     *the difference to the embedded 7-point Gauss rule is taken as its
+     *error, i.e., the max over block columns of the error in the column
+     *charge. All pending intervals of a round are evaluated in one pass of
+     *the energy loop. An interval is accepted if its error is below
+     *noneq_adaptive_tolerance times its fraction of the window, otherwise it
+     *is bisected for the next round. The accepted intervals define
+     *ContourPath_RhoNonEq, used by Compute_Current, and their breakpoints
+     *are the starting intervals of the next pass. Before that, two sibling
+     *intervals of a bisection are merged again if their errors sum to less
+     *than noneq_adaptive_coarsen_fraction of the tolerance, such that the
+     *grid follows the integrand as it moves with the bias, one level per
+     *pass, and does not only grow.
+     *Requires the temporary arrays for GF computation.*/
+    constexpr int pts_per_interval = 15;
+    const ComplexType E_min = E_contour_right;
+    const ComplexType E_max = E_rightmost;
+    const ComplexType window = E_max - E_min;
+
+    if (noneq_adaptive_breakpoints.empty() or
+        noneq_adaptive_window[0] != E_min or noneq_adaptive_window[1] != E_max)
+    {
+        noneq_adaptive_breakpoints.resize(noneq_adaptive_initial_intervals + 1);
+        for (int i = 0; i <= noneq_adaptive_initial_intervals; ++i)
+        {
+            noneq_adaptive_breakpoints[i] =
+                amrex::Real(i) / noneq_adaptive_initial_intervals;
+        }
+        noneq_adaptive_window[0] = E_min;
+        noneq_adaptive_window[1] = E_max;
+    }
 
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n_glo = global_contact_index[c];
+    /*intervals as (begin, end) fractions of the window, accepted ones as
+     *(begin, end, error)*/
+    amrex::Vector<std::pair<amrex::Real, amrex::Real>> pending;
+    amrex::Vector<std::array<amrex::Real, 3>> accepted;
+    for (int i = 0; i < noneq_adaptive_breakpoints.size() - 1; ++i)
+    {
+        pending.push_back(std::make_pair(noneq_adaptive_breakpoints[i],
+                                         noneq_adaptive_breakpoints[i + 1]));
+    }
 
-                if (n_glo >= vec_cumu_blkCol_size[my_rank] &&
-                    n_glo < vec_cumu_blkCol_size[my_rank + 1])
-                {
-                    int n = n_glo - vec_cumu_blkCol_size[my_rank];
-                    h_Alpha_loc(n) = h_Alpha_loc(n) - h_Sigma_contact(c);
-                }
-            }
 #ifdef AMREX_USE_GPU
-            d_Alpha_loc_data.copy(h_Alpha_loc_data);
+    auto const &RhoNonEq_loc = d_RhoNonEq_loc_data.table();
+    auto &degen_vec = block_degen_gpuvec;
+#else
+    auto const &RhoNonEq_loc = h_RhoNonEq_loc_data.table();
+    auto &degen_vec = block_degen_vec;
 #endif
+    int total_pts = 0;
+    int round = 0;
+    bool flag_limit_reached = false;
 
-            /*MPI_Allgather*/
-            MPI_Allgatherv(&h_Alpha_loc(0), blkCol_size_loc, MPI_BlkType,
-                           &h_Alpha_glo(0), MPI_recv_count.data(),
-                           MPI_recv_disp.data(), MPI_BlkType,
-                           ParallelDescriptor::Communicator());
+    for (; round < noneq_adaptive_max_rounds and !pending.empty(); ++round)
+    {
+        const int num_intervals = pending.size();
+        const int num_pts = num_intervals * pts_per_interval;
 
-            h_Y_glo(0) = 0;
-            h_X_glo(Hsize_glo - 1) = 0;
-            for (int section = 0; section < num_recursive_parts; ++section)
-            {
-                for (int n = std::max(1, Hsize_recur_part * section);
-                     n < std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-                     ++n)
-                {
-                    int p = (n - 1) % offDiag_repeatBlkSize;
-                    h_Ytil_glo(n) =
-                        h_Hc_loc(p) / (h_Alpha_glo(n - 1) - h_Y_glo(n - 1));
-                    h_Y_glo(n) = h_Hb_loc(p) * h_Ytil_glo(n);
-                }
-                for (int n = std::min(Hsize_glo - 2,
-                                      Hsize_recur_part *
-                                          (num_recursive_parts - section));
-                     n >=
-                     Hsize_recur_part * (num_recursive_parts - section - 1);
-                     n--)
-                {
-                    int p = n % offDiag_repeatBlkSize;
-                    h_Xtil_glo(n) =
-                        h_Hb_loc(p) / (h_Alpha_glo(n + 1) - h_X_glo(n + 1));
-                    h_X_glo(n) = h_Hc_loc(p) * h_Xtil_glo(n);
-                }
+        amrex::Vector<c_IntegrationPath> paths(num_intervals);
+        for (int i = 0; i < num_intervals; ++i)
+        {
+            paths[i].Define_GaussKronrodPoints(
+                E_min + pending[i].first * window,
+                E_min + pending[i].second * window);
+        }
 
-#ifdef AMREX_USE_GPU
-                int Ytil_begin = section * Hsize_recur_part;
-                int Ytil_end =
-                    std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Ytil_glo.p + Ytil_begin,
-                                      h_Ytil_glo.p + Ytil_end,
-                                      d_Ytil_glo.p + Ytil_begin);
-
-                int Xtil_begin =
-                    Hsize_recur_part * (num_recursive_parts - section - 1);
-                int Xtil_end =
-                    std::min(Hsize_glo, Hsize_recur_part *
-                                            (num_recursive_parts - section));
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Xtil_glo.p + Xtil_begin,
-                                      h_Xtil_glo.p + Xtil_end,
-                                      d_Xtil_glo.p + Xtil_begin);
-#endif
-            }
+        ComplexTable1D h_weight_gauss_data({0}, {num_pts}, The_Pinned_Arena());
+        RealTable2D h_Charge_Diff_data({0, 0}, {blkCol_size_loc, num_intervals},
+                                       The_Pinned_Arena());
+        TableData<int, 1> h_accept_data({0}, {num_intervals},
+                                        The_Pinned_Arena());
+        BlkTable2D Charge_K_data({0, 0}, {blkCol_size_loc, num_intervals},
+                                 The_Arena());
 
-#ifdef AMREX_USE_GPU
-            int X_begin = vec_cumu_blkCol_size[my_rank];
-            int X_end = X_begin + blkCol_size_loc;
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_X_glo.p + X_begin,
-                                  h_X_glo.p + X_end, d_X_loc.p);
+        auto const &h_weight_gauss = h_weight_gauss_data.table();
+        auto const &h_Charge_Diff = h_Charge_Diff_data.table();
+        auto const &h_accept = h_accept_data.table();
+        auto const &Charge_K = Charge_K_data.table();
 
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Y_glo.p + X_begin,
-                                  h_Y_glo.p + X_end, d_Y_loc.p);
-            amrex::Gpu::streamSynchronize();
-#else
-            for (int c = 0; c < blkCol_size_loc; ++c)
+        for (int i = 0; i < num_intervals; ++i)
+        {
+            for (int e = 0; e < pts_per_interval; ++e)
             {
-                int n = c + vec_cumu_blkCol_size[my_rank];
-                h_Y_loc(c) = h_Y_glo(n);
-                h_X_loc(c) = h_X_glo(n);
+                h_weight_gauss(i * pts_per_interval + e) =
+                    paths[i].weight_gauss_vec[e] * paths[i].mul_factor_vec[e];
             }
+        }
+        SetVal_Table2D(h_Charge_Diff_data, 0.);
+#ifdef AMREX_USE_GPU
+        ComplexTable1D d_weight_gauss_data({0}, {num_pts}, The_Arena());
+        RealTable2D d_Charge_Diff_data({0, 0}, {blkCol_size_loc, num_intervals},
+                                       The_Arena());
+        TableData<int, 1> d_accept_data({0}, {num_intervals}, The_Arena());
+        d_weight_gauss_data.copy(h_weight_gauss_data);
+        d_Charge_Diff_data.copy(h_Charge_Diff_data);
+
+        auto const &weight_gauss = d_weight_gauss_data.const_table();
+        auto const &Charge_Diff = d_Charge_Diff_data.table();
+        auto const &accept = d_accept_data.const_table();
+#else
+        auto const &weight_gauss = h_weight_gauss_data.const_table();
+        auto const &Charge_Diff = h_Charge_Diff_data.table();
+        auto const &accept = h_accept_data.const_table();
 #endif
+        amrex::ParallelFor(blkCol_size_loc,
+                           [=] AMREX_GPU_DEVICE(int n) noexcept
+                           {
+                               for (int i = 0; i < num_intervals; ++i)
+                                   Charge_K(n, i) = 0.;
+                           });
 
-            /*following is for lambda capture*/
-
-            int cumulative_columns = vec_cumu_blkCol_size[my_rank];
-            auto *degen_vec_ptr = degen_vec.dataPtr();
-            ComplexType nF_eq = FermiFunction(E - mu_min, kT_min);
+        s_IntervalCharge_Observable<T> IntervalCharge_obs;
+        IntervalCharge_obs.Charge_K = Charge_K;
+        IntervalCharge_obs.Charge_Diff = Charge_Diff;
+        IntervalCharge_obs.weight_gauss = weight_gauss;
+        IntervalCharge_obs.degen_vec_ptr = degen_vec.dataPtr();
+        IntervalCharge_obs.const_multiplier =
+            -1 * spin_degen / (2 * MathConst::pi);
+        IntervalCharge_obs.pts_per_interval = pts_per_interval;
+        if (flag_eq_pole_expansion)
+        {
+            IntervalCharge_obs.eq_mu = mu_min;
+            IntervalCharge_obs.eq_kT = kT_min;
+        }
 
-            amrex::Real const_multiplier = -1. * spin_degen / MathConst::pi;
+        Run_RGF_EnergyLoop(Get_EnergyPoints(paths, true), nullptr,
+                           IntervalCharge_obs);
+        total_pts += num_pts;
 
-            amrex::ParallelFor(blkCol_size_loc,
-                               [=] AMREX_GPU_DEVICE(int n) noexcept
-                               {
-                                   ComplexType one(1., 0.);
-                                   MatrixBlock<T> G_nn =
-                                       one / (Alpha(n) - X(n) - Y(n));
-                                   MatrixBlock<T> RhoEq_n = const_multiplier *
-                                                            G_nn * weight *
-                                                            mul_factor * nF_eq;
-                                   RhoEq_loc(n) =
-                                       RhoEq_loc(n) +
-                                       RhoEq_n.DiagMult(degen_vec_ptr);
-                               });
 #ifdef AMREX_USE_GPU
-            amrex::Gpu::streamSynchronize();
+        h_Charge_Diff_data.copy(d_Charge_Diff_data);
+        amrex::Gpu::streamSynchronize();
 #endif
-        } /*Energy loop*/
-    }     /*Path loop*/
-
-    Deallocate_TemporaryArraysForGFComputation();
+        /*error per interval, max over columns of the charge difference
+         *summed over energy groups*/
+        if (num_energy_groups > 1 and blkCol_size_loc > 0)
+        {
+            MPI_Allreduce(MPI_IN_PLACE, &(h_Charge_Diff(0, 0)),
+                          blkCol_size_loc * num_intervals, MPI_DOUBLE, MPI_SUM,
+                          Energy_Comm);
+        }
+        amrex::Vector<amrex::Real> error(num_intervals, 0.);
+        for (int i = 0; i < num_intervals; ++i)
+        {
+            for (int n = 0; n < blkCol_size_loc; ++n)
+            {
+                error[i] = std::max(error[i], fabs(h_Charge_Diff(n, i)));
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, error.dataPtr(), num_intervals, MPI_DOUBLE,
+                      MPI_MAX, NS_Comm);
 
-    if (!flag_noneq_exists)
-    {
+        int num_rejected = 0;
+        for (int i = 0; i < num_intervals; ++i)
+        {
+            amrex::Real fraction = pending[i].second - pending[i].first;
+            h_accept(i) = (error[i] <= noneq_adaptive_tolerance * fraction);
+            if (!h_accept(i)) ++num_rejected;
+        }
+        /*accept all at the last round or if bisection exceeds the limit*/
+        if (round == noneq_adaptive_max_rounds - 1 or
+            int(accepted.size()) + num_intervals + num_rejected >
+                noneq_adaptive_max_intervals)
+        {
+            if (num_rejected > 0) flag_limit_reached = true;
+            for (int i = 0; i < num_intervals; ++i) h_accept(i) = 1;
+        }
 #ifdef AMREX_USE_GPU
-        auto const &GR_atPoles_loc = d_GR_atPoles_loc_data.const_table();
-#else
-        auto const &GR_atPoles_loc = h_GR_atPoles_loc_data.const_table();
+        d_accept_data.copy(h_accept_data);
 #endif
-
-        Compute_GR_atPoles();
-
+        /*partial sums of the group, see Reduce_ChargeOverEnergyGroups*/
         amrex::ParallelFor(blkCol_size_loc,
-                           [=] AMREX_GPU_DEVICE(int n) noexcept {
-                               RhoEq_loc(n) = RhoEq_loc(n) + GR_atPoles_loc(n);
+                           [=] AMREX_GPU_DEVICE(int n) noexcept
+                           {
+                               for (int i = 0; i < num_intervals; ++i)
+                               {
+                                   if (accept(i))
+                                       RhoNonEq_loc(n) =
+                                           RhoNonEq_loc(n) + Charge_K(n, i);
+                               }
                            });
 #ifdef AMREX_USE_GPU
         amrex::Gpu::streamSynchronize();
 #endif
+        amrex::Vector<std::pair<amrex::Real, amrex::Real>> bisected;
+        for (int i = 0; i < num_intervals; ++i)
+        {
+            if (h_accept(i))
+            {
+                accepted.push_back(
+                    {pending[i].first, pending[i].second, error[i]});
+            }
+            else
+            {
+                amrex::Real mid = 0.5 * (pending[i].first + pending[i].second);
+                bisected.push_back(std::make_pair(pending[i].first, mid));
+                bisected.push_back(std::make_pair(mid, pending[i].second));
+            }
+        }
+        pending = bisected;
+    }
+
+    std::sort(accepted.begin(), accepted.end());
+
+    ContourPath_RhoNonEq.clear();
+    ContourPath_RhoNonEq.resize(accepted.size());
+    for (int i = 0; i < accepted.size(); ++i)
+    {
+        ContourPath_RhoNonEq[i].Define_GaussKronrodPoints(
+            E_min + accepted[i][0] * window, E_min + accepted[i][1] * window);
+    }
+    total_noneq_integration_pts = accepted.size() * pts_per_interval;
+
+    /*breakpoints of the next pass. Siblings have equal length, are finer
+     *than the initial intervals, and the left one starts at an even
+     *multiple of the length.*/
+    const amrex::Real initial_length = 1. / noneq_adaptive_initial_intervals;
+    int num_merged = 0;
+    noneq_adaptive_breakpoints.clear();
+    for (int i = 0; i < accepted.size(); ++i)
+    {
+        noneq_adaptive_breakpoints.push_back(accepted[i][0]);
+        if (i + 1 == accepted.size()) continue;
+
+        const amrex::Real length = accepted[i][1] - accepted[i][0];
+        const amrex::Real next_length = accepted[i + 1][1] - accepted[i + 1][0];
+        const amrex::Real position = accepted[i][0] / length;
+        const bool is_sibling =
+            length < (1. - 1.e-6) * initial_length and
+            std::abs(next_length - length) < 1.e-6 * length and
+            std::abs(position - std::round(position)) < 1.e-6 and
+            static_cast<long>(std::round(position)) % 2 == 0;
+
+        if (is_sibling and
+            accepted[i][2] + accepted[i + 1][2] <
+                noneq_adaptive_coarsen_fraction * noneq_adaptive_tolerance *
+                    2. * length)
+        {
+            ++i;
+            ++num_merged;
+        }
+    }
+    noneq_adaptive_breakpoints.push_back(accepted.back()[1]);
+
+    amrex::Print() << "\n Adaptive nonequilibrium quadrature, rounds: " << round
+                   << " intervals: " << accepted.size()
+                   << " energy points evaluated: " << total_pts
+                   << " merged for the next pass: " << num_merged << "\n";
+    if (flag_limit_reached)
+    {
+        amrex::Print() << " Warning: noneq_adaptive_tolerance not met within "
+                          "noneq_adaptive_max_rounds/max_intervals.\n";
     }
 }
 
 template <typename T>
-void c_NEGF_Common<T>::Compute_GR_atPoles()
+void c_NEGF_Common<T>::Accumulate_RhoNonEq_Batched(const bool compute_integrand)
 {
-    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
-    auto const &h_Hb_loc = h_Hb_loc_data.table();
-    auto const &h_Hc_loc = h_Hc_loc_data.table();
-    auto const &h_tau = h_tau_glo_data.table();
+    /*The energy points of this group are processed in batches of
+     *energy_batch_size. Only the contact self-energies and Fermi functions
+     *are evaluated per energy on the host. The recursion, the contact
+     *propagators and the accumulation of RhoNonEq then run for all energies
+     *of a batch at once, on tables with the energy as the fastest-moving
+     *index. On GPUs, the stages independent over the columns run one
+     *thread per energy and column, the sequential walks one thread per
+     *energy and direction; on CPUs, the loop over energies is innermost
+     *such that it can be vectorized.
+     *Launch and synchronization costs are thus shared by the batch.
+     *GR_loc and A_loc are not filled.
+     *Requires the temporary arrays for GF computation.*/
+    auto const &h_Sigma_contact = h_Sigma_contact_data.const_table();
+
+    const int batch_size = energy_batch_size;
+
+    /*diagonal blocks of all columns, gathered once for all batches*/
+    BlkTable1D h_minusHa_gathered_data;
+    if (!flag_replicate_diagonal)
+    {
+        auto const &h_minusHa_loc = h_minusHa_loc_data.table();
+        h_minusHa_gathered_data.resize({0}, {Hsize_glo}, The_Pinned_Arena());
+        auto const &h_minusHa_gathered = h_minusHa_gathered_data.table();
 
-    Allocate_TemporaryArraysForGFComputation();
-    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
-    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
-    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
-    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
-    auto const &h_X_glo = h_X_glo_data.table();
-    auto const &h_Y_glo = h_Y_glo_data.table();
-    auto const &h_X_loc = h_X_loc_data.table();
-    auto const &h_Y_loc = h_Y_loc_data.table();
-    auto const &h_Sigma_contact = h_Sigma_contact_data.table();
+        MPI_Allgatherv(&h_minusHa_loc(0), blkCol_size_loc, MPI_BlkType,
+                       &h_minusHa_gathered(0), MPI_blkCol_recv_count.data(),
+                       MPI_blkCol_recv_disp.data(), MPI_BlkType, BlkCol_Comm);
+    }
+    const BlkTable1D &h_minusHa_all_data =
+        flag_replicate_diagonal ? h_minusHa_glo_data : h_minusHa_gathered_data;
+
+    ComplexTable1D h_E_batch_data({0}, {batch_size}, The_Pinned_Arena());
+    BlkTable2D h_Sigma_batch_data({0, 0}, {batch_size, NUM_CONTACTS},
+                                  The_Pinned_Arena());
+    BlkTable2D h_Gamma_batch_data({0, 0}, {batch_size, NUM_CONTACTS},
+                                  The_Pinned_Arena());
+    BlkTable2D h_Fermi_batch_data({0, 0}, {batch_size, NUM_CONTACTS},
+                                  The_Pinned_Arena());
+    ComplexTable1D h_weight_batch_data({0}, {batch_size}, The_Pinned_Arena());
+    TableData<int, 1> h_e_glo_batch_data({0}, {batch_size},
+                                         The_Pinned_Arena());
+
+    auto const &h_E_batch = h_E_batch_data.table();
+    auto const &h_Sigma_batch = h_Sigma_batch_data.table();
+    auto const &h_Gamma_batch = h_Gamma_batch_data.table();
+    auto const &h_Fermi_batch = h_Fermi_batch_data.table();
+    auto const &h_weight_batch = h_weight_batch_data.table();
+    auto const &h_e_glo_batch = h_e_glo_batch_data.table();
+
+    /*recursion workspace, index (energy, column)*/
+    BlkTable2D Alpha_batch_data({0, 0}, {batch_size, Hsize_glo}, The_Arena());
+    BlkTable2D Xtil_batch_data({0, 0}, {batch_size, Hsize_glo}, The_Arena());
+    BlkTable2D Ytil_batch_data({0, 0}, {batch_size, Hsize_glo}, The_Arena());
+    BlkTable2D X_batch_data({0, 0}, {batch_size, Hsize_glo}, The_Arena());
+    BlkTable2D Y_batch_data({0, 0}, {batch_size, Hsize_glo}, The_Arena());
+    BlkTable2D G_kk_batch_data({0, 0}, {batch_size, NUM_CONTACTS},
+                               The_Arena());
+    BlkTable3D G_contact_batch_data(
+        {0, 0, 0}, {batch_size, blkCol_size_loc, NUM_CONTACTS}, The_Arena());
 
 #ifdef AMREX_USE_GPU
-    auto const &GR_atPoles_loc = d_GR_atPoles_loc_data.table();
-    amrex::ParallelFor(blkCol_size_loc, [=] AMREX_GPU_DEVICE(int n) noexcept
-                       { GR_atPoles_loc(n) = 0.; });
-
-    /*constant references*/
-    auto const &Alpha = d_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = d_Xtil_glo_data.const_table();
-    auto const &d_Xtil_glo = d_Xtil_glo_data.table();
-    auto const &Ytil_glo = d_Ytil_glo_data.const_table();
-    auto const &d_Ytil_glo = d_Ytil_glo_data.table();
-    auto const &X = d_X_loc_data.const_table();
-    auto const &d_X_loc = d_X_loc_data.table();
-    auto const &Y = d_Y_loc_data.const_table();
-    auto const &d_Y_loc = d_Y_loc_data.table();
-    auto const &Sigma_contact = d_Sigma_contact_data.const_table();
+    BlkTable1D d_minusHa_all_data({0}, {Hsize_glo}, The_Arena());
+    BlkTable1D d_Hb_data(h_Hb_loc_data.lo(), h_Hb_loc_data.hi(), The_Arena());
+    BlkTable1D d_Hc_data(h_Hc_loc_data.lo(), h_Hc_loc_data.hi(), The_Arena());
+    d_minusHa_all_data.copy(h_minusHa_all_data);
+    d_Hb_data.copy(h_Hb_loc_data);
+    d_Hc_data.copy(h_Hc_loc_data);
+
+    ComplexTable1D d_E_batch_data({0}, {batch_size}, The_Arena());
+    BlkTable2D d_Sigma_batch_data({0, 0}, {batch_size, NUM_CONTACTS},
+                                  The_Arena());
+    BlkTable2D d_Gamma_batch_data({0, 0}, {batch_size, NUM_CONTACTS},
+                                  The_Arena());
+    BlkTable2D d_Fermi_batch_data({0, 0}, {batch_size, NUM_CONTACTS},
+                                  The_Arena());
+    ComplexTable1D d_weight_batch_data({0}, {batch_size}, The_Arena());
+    TableData<int, 1> d_e_glo_batch_data({0}, {batch_size}, The_Arena());
+
+    auto const &minusHa_all = d_minusHa_all_data.table();
+    auto const &Hb = d_Hb_data.table();
+    auto const &Hc = d_Hc_data.table();
+    auto const &E_batch = d_E_batch_data.table();
+    auto const &Sigma_batch = d_Sigma_batch_data.table();
+    auto const &RhoNonEq_loc = d_RhoNonEq_loc_data.table();
+    auto const &Gamma_batch = d_Gamma_batch_data.const_table();
+    auto const &Fermi_batch = d_Fermi_batch_data.const_table();
+    auto const &weight_batch = d_weight_batch_data.const_table();
+    auto const &e_glo_batch = d_e_glo_batch_data.const_table();
+    auto const &NonEq_Integrand = d_NonEq_Integrand_data.table();
+    auto const &NonEq_Integrand_Source = d_NonEq_Integrand_Source_data.table();
+    auto const &NonEq_Integrand_Drain = d_NonEq_Integrand_Drain_data.table();
     auto &degen_vec = block_degen_gpuvec;
 #else
-    ComplexType zero(0., 0.);
-    SetVal_Table1D(h_GR_atPoles_loc_data, zero);
-    auto const &GR_atPoles_loc = h_GR_atPoles_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = h_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = h_Xtil_glo_data.const_table();
-    auto const &Ytil_glo = h_Ytil_glo_data.const_table();
-    auto const &X = h_X_loc_data.const_table();
-    auto const &Y = h_Y_loc_data.const_table();
-    auto const &Sigma_contact = h_Sigma_contact_data.const_table();
+    auto const &minusHa_all = h_minusHa_all_data.table();
+    auto const &Hb = h_Hb_loc_data.table();
+    auto const &Hc = h_Hc_loc_data.table();
+    auto const &E_batch = h_E_batch_data.table();
+    auto const &Sigma_batch = h_Sigma_batch_data.table();
+    auto const &RhoNonEq_loc = h_RhoNonEq_loc_data.table();
+    auto const &Gamma_batch = h_Gamma_batch_data.const_table();
+    auto const &Fermi_batch = h_Fermi_batch_data.const_table();
+    auto const &weight_batch = h_weight_batch_data.const_table();
+    auto const &e_glo_batch = h_e_glo_batch_data.const_table();
+    auto const &NonEq_Integrand = h_NonEq_Integrand_data.table();
+    auto const &NonEq_Integrand_Source = h_NonEq_Integrand_Source_data.table();
+    auto const &NonEq_Integrand_Drain = h_NonEq_Integrand_Drain_data.table();
     auto &degen_vec = block_degen_vec;
-#endif
 
-    for (int e = 0; e < E_poles_vec.size(); ++e)
+    /*propagator being walked, per energy*/
+    BlkTable1D G_walk_batch_data({0}, {batch_size}, The_Arena());
+    auto const &G_walk_batch = G_walk_batch_data.table();
+#endif
+    auto const &Alpha_batch = Alpha_batch_data.table();
+    auto const &Xtil_batch = Xtil_batch_data.table();
+    auto const &Ytil_batch = Ytil_batch_data.table();
+    auto const &X_batch = X_batch_data.table();
+    auto const &Y_batch = Y_batch_data.table();
+    auto const &G_kk_batch = G_kk_batch_data.table();
+    auto const &G_contact_batch = G_contact_batch_data.table();
+
+    /*following is for lambda capture*/
+    const int Hsize = Hsize_glo;
+    const int num_repeat = offDiag_repeatBlkSize;
+    const int col_begin = vec_cumu_blkCol_size[blkCol_rank];
+    const int col_end = col_begin + blkCol_size_loc;
+    const auto contact_index = global_contact_index;
+    auto *degen_vec_ptr = degen_vec.dataPtr();
+
+    /*steps of the recursion and of the contact propagators for energy k,
+     *see RGF_Kernels.H*/
+    auto assemble_alpha = [=] AMREX_GPU_HOST_DEVICE(int k, int n) noexcept
     {
-        ComplexType E = E_poles_vec[e];
-
-        for (int n = 0; n < blkCol_size_loc; ++n)
+        Alpha_batch(k, n) = E_batch(k) + minusHa_all(n);
+        /*+ because h_minusHa is defined previously as -(H0+U)*/
+        for (int c = 0; c < NUM_CONTACTS; ++c)
         {
-            h_Alpha_loc(n) = E + h_minusHa_loc(n);
-            /*+ because h_minusHa is defined previously as -(H0+U)*/
+            if (contact_index[c] == n)
+            {
+                Alpha_batch(k, n) = Alpha_batch(k, n) - Sigma_batch(k, c);
+            }
         }
-        get_Sigma_at_contacts(h_Sigma_contact_data, E);
+    };
+    auto forward_step = [=] AMREX_GPU_HOST_DEVICE(int k, int n) noexcept
+    {
+        int p = (n - 1) % num_repeat;
+        RGF_ForwardStep(Hb(p), Hc(p), Alpha_batch(k, n - 1), Y_batch(k, n - 1),
+                        Ytil_batch(k, n), Y_batch(k, n));
+    };
+    auto backward_step = [=] AMREX_GPU_HOST_DEVICE(int k, int n) noexcept
+    {
+        int p = n % num_repeat;
+        RGF_BackwardStep(Hb(p), Hc(p), Alpha_batch(k, n + 1),
+                         X_batch(k, n + 1), Xtil_batch(k, n), X_batch(k, n));
+    };
+    auto contact_diagonal = [=] AMREX_GPU_HOST_DEVICE(int k, int c) noexcept
+    {
+        int n = contact_index[c];
+        G_kk_batch(k, c) =
+            RGF_DiagonalBlock(Alpha_batch(k, n), X_batch(k, n), Y_batch(k, n));
+        if (n >= col_begin and n < col_end)
+        {
+            G_contact_batch(k, n - col_begin, c) = G_kk_batch(k, c);
+        }
+    };
+    auto walk_right = [=] AMREX_GPU_HOST_DEVICE(int k, int c, int m,
+                                                MatrixBlock<T> &G) noexcept
+    {
+        G = RGF_PropagatorStep(Xtil_batch(k, m), G);
+        if (m + 1 >= col_begin) G_contact_batch(k, m + 1 - col_begin, c) = G;
+    };
+    auto walk_left = [=] AMREX_GPU_HOST_DEVICE(int k, int c, int m,
+                                               MatrixBlock<T> &G) noexcept
+    {
+        G = RGF_PropagatorStep(Ytil_batch(k, m), G);
+        if (m - 1 < col_end) G_contact_batch(k, m - 1 - col_begin, c) = G;
+    };
 
-        for (int c = 0; c < NUM_CONTACTS; ++c)
+    /*energy points of this group*/
+    auto energy_pts = Get_EnergyPoints(ContourPath_RhoNonEq, true);
+    const int num_pts = energy_pts.size();
+
+    for (int batch_begin = 0; batch_begin < num_pts;
+         batch_begin += batch_size)
+    {
+        const int num_energies = std::min(batch_size, num_pts - batch_begin);
+
+        /*Get_ContactSelfEnergy leaves h_Sigma_contact free for reuse, such
+         *that the self-energies of the batch are gathered without
+         *synchronizing per energy*/
+        ComplexType imag(0., 1.);
+        for (int k = 0; k < num_energies; ++k)
         {
-            int n_glo = global_contact_index[c];
+            const s_EnergyPoint &pt = energy_pts[batch_begin + k];
+
+            Get_ContactSelfEnergy(pt.E);
 
-            if (n_glo >= vec_cumu_blkCol_size[my_rank] &&
-                n_glo < vec_cumu_blkCol_size[my_rank + 1])
+            for (int c = 0; c < NUM_CONTACTS; ++c)
             {
-                int n = n_glo - vec_cumu_blkCol_size[my_rank];
-                h_Alpha_loc(n) = h_Alpha_loc(n) - h_Sigma_contact(c);
+                h_Sigma_batch(k, c) = h_Sigma_contact(c);
+                h_Gamma_batch(k, c) =
+                    imag * (h_Sigma_batch(k, c) - h_Sigma_batch(k, c).Dagger());
+                h_Fermi_batch(k, c) =
+                    FermiFunction(pt.E - mu_contact[c], kT_contact[c]);
             }
+            h_E_batch(k) = pt.E;
+            h_weight_batch(k) = pt.weight;
+            h_e_glo_batch(k) = pt.e_glo;
         }
-
 #ifdef AMREX_USE_GPU
-        d_Alpha_loc_data.copy(h_Alpha_loc_data);
-#endif
+        d_E_batch_data.copy(h_E_batch_data);
+        d_Sigma_batch_data.copy(h_Sigma_batch_data);
+        d_Gamma_batch_data.copy(h_Gamma_batch_data);
+        d_Fermi_batch_data.copy(h_Fermi_batch_data);
+        d_weight_batch_data.copy(h_weight_batch_data);
+        d_e_glo_batch_data.copy(h_e_glo_batch_data);
+
+        /*Alpha and the contact diagonals are independent over energies and
+         *columns or contacts, with the energy as the fastest-moving thread
+         *index. The recursions and the propagator walks are sequential in
+         *the column and run one thread per energy and direction, and for
+         *the walks also per contact.*/
+        amrex::ParallelFor(num_energies * Hsize,
+                           [=] AMREX_GPU_DEVICE(int i) noexcept {
+                               assemble_alpha(i % num_energies,
+                                              i / num_energies);
+                           });
 
-        /*MPI_Allgather*/
-        MPI_Allgatherv(&h_Alpha_loc(0), blkCol_size_loc, MPI_BlkType,
-                       &h_Alpha_glo(0), MPI_recv_count.data(),
-                       MPI_recv_disp.data(), MPI_BlkType,
-                       ParallelDescriptor::Communicator());
+        amrex::ParallelFor(
+            2 * num_energies,
+            [=] AMREX_GPU_DEVICE(int i) noexcept
+            {
+                int k = i % num_energies;
+                if (i < num_energies)
+                {
+                    Y_batch(k, 0) = 0.;
+                    for (int n = 1; n < Hsize; ++n) forward_step(k, n);
+                }
+                else
+                {
+                    X_batch(k, Hsize - 1) = 0.;
+                    for (int n = Hsize - 2; n >= 0; n--) backward_step(k, n);
+                }
+            });
+
+        amrex::ParallelFor(num_energies * NUM_CONTACTS,
+                           [=] AMREX_GPU_DEVICE(int i) noexcept {
+                               contact_diagonal(i % num_energies,
+                                                i / num_energies);
+                           });
+
+        amrex::ParallelFor(
+            2 * NUM_CONTACTS * num_energies,
+            [=] AMREX_GPU_DEVICE(int i) noexcept
+            {
+                int k = i % num_energies;
+                int c = (i / num_energies) % NUM_CONTACTS;
+                MatrixBlock<T> G = G_kk_batch(k, c);
+                if (i < NUM_CONTACTS * num_energies)
+                {
+                    for (int m = contact_index[c]; m < col_end - 1; ++m)
+                    {
+                        walk_right(k, c, m, G);
+                    }
+                }
+                else
+                {
+                    for (int m = contact_index[c]; m > col_begin; m--)
+                    {
+                        walk_left(k, c, m, G);
+                    }
+                }
+            });
+#else
+        for (int n = 0; n < Hsize; ++n)
+        {
+            for (int k = 0; k < num_energies; ++k) assemble_alpha(k, n);
+        }
+
+        for (int k = 0; k < num_energies; ++k)
+        {
+            Y_batch(k, 0) = 0.;
+            X_batch(k, Hsize - 1) = 0.;
+        }
+        for (int n = 1; n < Hsize; ++n)
+        {
+            for (int k = 0; k < num_energies; ++k) forward_step(k, n);
+        }
+        for (int n = Hsize - 2; n >= 0; n--)
+        {
+            for (int k = 0; k < num_energies; ++k) backward_step(k, n);
+        }
 
-        h_Y_glo(0) = 0;
-        h_X_glo(Hsize_glo - 1) = 0;
-        for (int section = 0; section < num_recursive_parts; ++section)
+        for (int c = 0; c < NUM_CONTACTS; ++c)
         {
-            for (int n = std::max(1, Hsize_recur_part * section);
-                 n < std::min(Hsize_recur_part * (section + 1), Hsize_glo); ++n)
+            for (int k = 0; k < num_energies; ++k)
+            {
+                contact_diagonal(k, c);
+                G_walk_batch(k) = G_kk_batch(k, c);
+            }
+            for (int m = contact_index[c]; m < col_end - 1; ++m)
+            {
+                for (int k = 0; k < num_energies; ++k)
+                {
+                    walk_right(k, c, m, G_walk_batch(k));
+                }
+            }
+            for (int k = 0; k < num_energies; ++k)
             {
-                int p = (n - 1) % offDiag_repeatBlkSize;
-                h_Ytil_glo(n) =
-                    h_Hc_loc(p) / (h_Alpha_glo(n - 1) - h_Y_glo(n - 1));
-                h_Y_glo(n) = h_Hb_loc(p) * h_Ytil_glo(n);
+                G_walk_batch(k) = G_kk_batch(k, c);
             }
-            for (int n = std::min(Hsize_glo - 2,
-                                  Hsize_recur_part *
-                                      (num_recursive_parts - section));
-                 n >= Hsize_recur_part * (num_recursive_parts - section - 1);
-                 n--)
+            for (int m = contact_index[c]; m > col_begin; m--)
             {
-                int p = n % offDiag_repeatBlkSize;
-                h_Xtil_glo(n) =
-                    h_Hb_loc(p) / (h_Alpha_glo(n + 1) - h_X_glo(n + 1));
-                h_X_glo(n) = h_Hc_loc(p) * h_Xtil_glo(n);
+                for (int k = 0; k < num_energies; ++k)
+                {
+                    walk_left(k, c, m, G_walk_batch(k));
+                }
             }
+        }
+#endif
+
+        amrex::Real const_multiplier = -1 * spin_degen / (2 * MathConst::pi);
+
+        amrex::ParallelFor(
+            blkCol_size_loc,
+            [=] AMREX_GPU_DEVICE(int n) noexcept
+            {
+                int n_glo = n + col_begin; /*global column number*/
+
+                MatrixBlock<T> AnF_weighted_sum;
+                AnF_weighted_sum = 0.;
+                for (int k = 0; k < num_energies; ++k)
+                {
+                    MatrixBlock<T> AnF_sum;
+                    AnF_sum = 0.;
+                    for (int c = 0; c < NUM_CONTACTS; ++c)
+                    {
+                        MatrixBlock<T> G_contact_nk = G_contact_batch(k, n, c);
+                        MatrixBlock<T> A_nn = G_contact_nk * Gamma_batch(k, c) *
+                                              G_contact_nk.Dagger();
+                        AnF_sum = AnF_sum + A_nn * Fermi_batch(k, c);
+                    }
+                    AnF_weighted_sum =
+                        AnF_weighted_sum + AnF_sum * weight_batch(k);
+
+                    if (compute_integrand)
+                    {
+                        MatrixBlock<T> Intermed = const_multiplier * AnF_sum;
+                        amrex::Real integrand =
+                            Intermed.DiagMult(degen_vec_ptr).DiagSum().real();
+                        int e_glo = e_glo_batch(k);
+
+                        if (n_glo == int(Hsize / 2))
+                        {
+                            NonEq_Integrand(e_glo) = integrand;
+                        }
+                        else if (n_glo == int(Hsize / 4))
+                        {
+                            NonEq_Integrand_Source(e_glo) = integrand;
+                        }
+                        else if (n_glo == int(Hsize * 3 / 4))
+                        {
+                            NonEq_Integrand_Drain(e_glo) = integrand;
+                        }
+                    }
+                }
 
+                /*RhoNonEq*/
+                MatrixBlock<T> RhoNonEq_n = const_multiplier * AnF_weighted_sum;
+                RhoNonEq_loc(n) =
+                    RhoNonEq_loc(n) + RhoNonEq_n.DiagMult(degen_vec_ptr);
+            });
 #ifdef AMREX_USE_GPU
-            int Ytil_begin = section * Hsize_recur_part;
-            int Ytil_end =
-                std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                  h_Ytil_glo.p + Ytil_begin,
-                                  h_Ytil_glo.p + Ytil_end,
-                                  d_Ytil_glo.p + Ytil_begin);
-
-            int Xtil_begin =
-                Hsize_recur_part * (num_recursive_parts - section - 1);
-            int Xtil_end =
-                std::min(Hsize_glo,
-                         Hsize_recur_part * (num_recursive_parts - section));
-
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                  h_Xtil_glo.p + Xtil_begin,
-                                  h_Xtil_glo.p + Xtil_end,
-                                  d_Xtil_glo.p + Xtil_begin);
+        amrex::Gpu::streamSynchronize();
 #endif
-        }
+    }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Compute_RhoEq()
+{
+    Allocate_TemporaryArraysForGFComputation();
+
+#ifdef AMREX_USE_GPU
+    auto const &RhoEq_loc = d_RhoEq_loc_data.table();
+    amrex::ParallelFor(blkCol_size_loc, [=] AMREX_GPU_DEVICE(int n) noexcept
+                       { RhoEq_loc(n) = 0.; });
+    auto &degen_vec = block_degen_gpuvec;
+#else
+    ComplexType zero(0., 0.);
+    SetVal_Table1D(h_RhoEq_loc_data, zero);
+    auto const &RhoEq_loc = h_RhoEq_loc_data.table();
+    auto &degen_vec = block_degen_vec;
+#endif
+
+    if (flag_eq_pole_expansion)
+    {
+        Accumulate_RhoEq_PoleExpansion();
+        Deallocate_TemporaryArraysForGFComputation();
+        return;
+    }
 
+    /*the equilibrium Fermi function is folded into the weights*/
+    auto energy_pts = Get_EnergyPoints(ContourPath_RhoEq, true);
+    for (auto &pt : energy_pts)
+    {
+        pt.weight *= FermiFunction(pt.E - mu_min, kT_min);
+    }
+
+    s_DiagGF_Observable<T> RhoEq_obs;
+    RhoEq_obs.target = RhoEq_loc;
+    RhoEq_obs.degen_vec_ptr = degen_vec.dataPtr();
+    RhoEq_obs.mult = -1. * spin_degen / MathConst::pi;
+
+    Run_RGF_EnergyLoop(energy_pts, nullptr, RhoEq_obs);
+
+    Deallocate_TemporaryArraysForGFComputation();
+
+    /*poles are distributed over energy groups like the contour points and
+     *added before the reduction over energy groups*/
+    if (!flag_noneq_exists)
+    {
 #ifdef AMREX_USE_GPU
-        int X_begin = vec_cumu_blkCol_size[my_rank];
-        int X_end = X_begin + blkCol_size_loc;
-        amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_X_glo.p + X_begin,
-                              h_X_glo.p + X_end, d_X_loc.p);
+        auto const &GR_atPoles_loc = d_GR_atPoles_loc_data.const_table();
+#else
+        auto const &GR_atPoles_loc = h_GR_atPoles_loc_data.const_table();
+#endif
+
+        Compute_GR_atPoles();
 
-        amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Y_glo.p + X_begin,
-                              h_Y_glo.p + X_end, d_Y_loc.p);
+        amrex::ParallelFor(blkCol_size_loc,
+                           [=] AMREX_GPU_DEVICE(int n) noexcept {
+                               RhoEq_loc(n) = RhoEq_loc(n) + GR_atPoles_loc(n);
+                           });
+#ifdef AMREX_USE_GPU
         amrex::Gpu::streamSynchronize();
+#endif
+    }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Accumulate_RhoEq_PoleExpansion()
+{
+    /*Equilibrium charge of all states from the pole expansion,
+     *  f(x) = 1/2 - sum_p R_p [1/(x - i z_p) + 1/(x + i z_p)],
+     *with x = (E - mu_min)/kT_min. Closing the real-axis integral of G f in
+     *the upper half plane, where the truncated expansion tends to 1/2, gives
+     *  -1/pi int G f dE = 2i kT_min sum_p R_p G(mu_min + i z_p kT_min)
+     *                     + i/2 M0,
+     *where M0 = lim iR G(iR) is the identity for an orthonormal basis.
+     *The imaginary part is the charge of all states, which equals that of
+     *ContourPath_RhoEq from E_contour_left as long as no state lies below
+     *it. With nonequilibrium, RhoNonEq is taken relative to the equilibrium
+     *occupation, see NonEq_Occupation. Poles are distributed over energy
+     *groups and M0 is added by group 0.
+     *Requires the temporary arrays for GF computation.*/
+#ifdef AMREX_USE_GPU
+    auto const &RhoEq_loc = d_RhoEq_loc_data.table();
+    auto &degen_vec = block_degen_gpuvec;
 #else
-        for (int c = 0; c < blkCol_size_loc; ++c)
-        {
-            int n = c + vec_cumu_blkCol_size[my_rank];
-            h_Y_loc(c) = h_Y_glo(n);
-            h_X_loc(c) = h_X_glo(n);
-        }
+    auto const &RhoEq_loc = h_RhoEq_loc_data.table();
+    auto &degen_vec = block_degen_vec;
 #endif
 
-        /*following is for lambda capture*/
-        int cumulative_columns = vec_cumu_blkCol_size[my_rank];
+    amrex::Vector<s_EnergyPoint> energy_pts;
+    for (int p = 0; p < eq_pole_vec.size(); ++p)
+    {
+        if (!is_energy_pt_of_this_group(p)) continue;
+
+        s_EnergyPoint pt;
+        pt.E = ComplexType(mu_min, eq_pole_vec[p] * kT_min);
+        pt.weight = ComplexType(0., 2. * kT_min * eq_residue_vec[p]);
+        pt.e_glo = p;
+        energy_pts.push_back(pt);
+    }
+
+    s_DiagGF_Observable<T> RhoEq_obs;
+    RhoEq_obs.target = RhoEq_loc;
+    RhoEq_obs.degen_vec_ptr = degen_vec.dataPtr();
+    RhoEq_obs.mult = spin_degen;
 
-        ComplexType pole_const(0., -2 * kT_min * spin_degen);
-        auto *degen_vec_ptr = degen_vec.dataPtr();
+    Run_RGF_EnergyLoop(energy_pts, nullptr, RhoEq_obs);
+
+    if (energy_group_id == 0)
+    {
+        int *degen_vec_ptr = degen_vec.dataPtr();
+        ComplexType moment_factor(0., 0.5 * spin_degen);
 
         amrex::ParallelFor(blkCol_size_loc,
                            [=] AMREX_GPU_DEVICE(int n) noexcept
                            {
-                               ComplexType one(1., 0.);
-                               MatrixBlock<T> G_nn =
-                                   one / (Alpha(n) - X(n) - Y(n));
-                               MatrixBlock<T> GR_atPoles_n = pole_const * G_nn;
-
-                               GR_atPoles_loc(n) =
-                                   GR_atPoles_loc(n) +
-                                   GR_atPoles_n.DiagMult(degen_vec_ptr);
+                               MatrixBlock<T> M0;
+                               M0 = moment_factor;
+                               RhoEq_loc(n) =
+                                   RhoEq_loc(n) + M0.DiagMult(degen_vec_ptr);
                            });
 #ifdef AMREX_USE_GPU
         amrex::Gpu::streamSynchronize();
 #endif
     }
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Compute_GR_atPoles()
+{
+    Allocate_TemporaryArraysForGFComputation();
+
+#ifdef AMREX_USE_GPU
+    auto const &GR_atPoles_loc = d_GR_atPoles_loc_data.table();
+    amrex::ParallelFor(blkCol_size_loc, [=] AMREX_GPU_DEVICE(int n) noexcept
+                       { GR_atPoles_loc(n) = 0.; });
+    auto &degen_vec = block_degen_gpuvec;
+#else
+    ComplexType zero(0., 0.);
+    SetVal_Table1D(h_GR_atPoles_loc_data, zero);
+    auto const &GR_atPoles_loc = h_GR_atPoles_loc_data.table();
+    auto &degen_vec = block_degen_vec;
+#endif
+
+    amrex::Vector<s_EnergyPoint> energy_pts;
+    for (int e = 0; e < E_poles_vec.size(); ++e)
+    {
+        if (!is_energy_pt_of_this_group(e)) continue;
+
+        s_EnergyPoint pt;
+        pt.E = E_poles_vec[e];
+        pt.weight = 1.;
+        pt.e_glo = e;
+        energy_pts.push_back(pt);
+    }
+
+    s_DiagGF_Observable<T> GR_atPoles_obs;
+    GR_atPoles_obs.target = GR_atPoles_loc;
+    GR_atPoles_obs.degen_vec_ptr = degen_vec.dataPtr();
+    GR_atPoles_obs.mult = ComplexType(0., -2 * kT_min * spin_degen);
+
+    Run_RGF_EnergyLoop(energy_pts, nullptr, GR_atPoles_obs);
+
     Deallocate_TemporaryArraysForGFComputation();
 }
 
 template <typename T>
 void c_NEGF_Common<T>::Compute_Rho0()
 {
-    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
-    auto const &h_Hb_loc = h_Hb_loc_data.table();
-    auto const &h_Hc_loc = h_Hc_loc_data.table();
-    auto const &h_tau = h_tau_glo_data.table();
-
     Allocate_TemporaryArraysForGFComputation();
 
-    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
-    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
-    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
-    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
-    auto const &h_X_glo = h_X_glo_data.table();
-    auto const &h_Y_glo = h_Y_glo_data.table();
-    auto const &h_X_loc = h_X_loc_data.table();
-    auto const &h_Y_loc = h_Y_loc_data.table();
-    auto const &h_Sigma_contact = h_Sigma_contact_data.table();
-
 #ifdef AMREX_USE_GPU
     auto const &Rho0_loc = d_Rho0_loc_data.table();
     amrex::ParallelFor(blkCol_size_loc, [=] AMREX_GPU_DEVICE(int n) noexcept
                        { Rho0_loc(n) = 0.; });
-    /*constant references*/
-    auto const &Alpha = d_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = d_Xtil_glo_data.const_table();
-    auto const &Ytil_glo = d_Ytil_glo_data.const_table();
-    auto const &X = d_X_loc_data.const_table();
-    auto const &Y = d_Y_loc_data.const_table();
-    auto const &Sigma_contact = d_Sigma_contact_data.const_table();
     auto &degen_vec = block_degen_gpuvec;
 #else
     ComplexType zero(0., 0.);
     SetVal_Table1D(h_Rho0_loc_data, zero);
     auto const &Rho0_loc = h_Rho0_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = h_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = h_Xtil_glo_data.const_table();
-    auto const &Ytil_glo = h_Ytil_glo_data.const_table();
-    auto const &X = h_X_loc_data.const_table();
-    auto const &Y = h_Y_loc_data.const_table();
-    auto const &Sigma_contact = h_Sigma_contact_data.const_table();
     auto &degen_vec = block_degen_vec;
 #endif
 
-    for (int p = 0; p < ContourPath_Rho0.size(); ++p)
+    s_DiagGF_Observable<T> Rho0_obs;
+    Rho0_obs.target = Rho0_loc;
+    Rho0_obs.degen_vec_ptr = degen_vec.dataPtr();
+    Rho0_obs.mult = -1 * spin_degen / (MathConst::pi);
+
+    Run_RGF_EnergyLoop(Get_EnergyPoints(ContourPath_Rho0, true), nullptr,
+                       Rho0_obs);
+
+    Deallocate_TemporaryArraysForGFComputation();
+
+#ifdef AMREX_USE_GPU
+    Reduce_OverEnergyGroups(d_Rho0_loc_data);
+#else
+    Reduce_OverEnergyGroups(h_Rho0_loc_data);
+#endif
+}
+
+// template<typename T>
+// AMREX_GPU_HOST_DEVICE
+// void
+// c_NEGF_Common<T>:: Compute_SurfaceGreensFunction (MatrixBlock<T>& gr, const
+// ComplexType EmU) {}
+
+template <typename T>
+void c_NEGF_Common<T>::Condense_Lead(s_CondensedLead<T> &lead,
+                                     const ComplexType EmU)
+{
+    amrex::Abort(
+        "surface_GF_method = eigenfunction or decimation is not implemented "
+        "for nanostructure " +
+        name + ". Use surface_GF_method = material.");
+}
+
+template <typename T>
+int c_NEGF_Common<T>::Decimate_Lead(MatrixBlock<T> &gr,
+                                    const s_CondensedLead<T> &lead,
+                                    const ComplexType EmU)
+{
+    int max_iter = Decimation_IterationCap(lead, EmU, surface_GF_max_iter,
+                                           surface_GF_tol);
+    int iter =
+        Compute_SurfaceGF_Decimation(gr, lead, max_iter, surface_GF_tol);
+    if (iter < 0) num_unconverged_surface_GF++;
+
+    return iter;
+}
+
+template <typename T>
+void c_NEGF_Common<T>::Compute_LeadSurfaceGF(MatrixBlock<T> &gr,
+                                             const ComplexType EmU)
+{
+    if (surface_GF_method == s_SurfaceGF_Method::Material)
     {
-        for (int e = 0; e < ContourPath_Rho0[p].num_pts; ++e)
-        {
-            ComplexType E = ContourPath_Rho0[p].E_vec[e];
-            ComplexType weight = ContourPath_Rho0[p].weight_vec[e];
-            ComplexType mul_factor = ContourPath_Rho0[p].mul_factor_vec[e];
+        Compute_SurfaceGreensFunction(gr, EmU);
+        return;
+    }
 
-            for (int n = 0; n < blkCol_size_loc; ++n)
-            {
-                h_Alpha_loc(n) = E + h_minusHa_loc(n);
-                /*+ because h_minusHa is defined previously as -(H0+U)*/
-            }
+    s_CondensedLead<T> lead;
+    Condense_Lead(lead, EmU);
 
-            get_Sigma_at_contacts(h_Sigma_contact_data, E);
+    if (surface_GF_method == s_SurfaceGF_Method::Eigenfunction)
+    {
+        if constexpr (std::rank_v<T> == 1)
+        {
+            Compute_SurfaceGF_Eigenfunction(gr, lead);
+        }
+        else
+        {
+            amrex::Abort("surface_GF_method = eigenfunction requires "
+                         "diagonal blocks.");
+        }
+    }
+    else
+    {
+        Decimate_Lead(gr, lead, EmU);
+    }
+}
 
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n_glo = global_contact_index[c];
+template <typename T>
+void c_NEGF_Common<T>::Invalidate_ContactSelfEnergyCache()
+{
+    if (!p_Sigma_cache) return;
+    p_Sigma_cache->index.clear();
+    p_Sigma_cache->num_cached = 0;
+}
 
-                if (n_glo >= vec_cumu_blkCol_size[my_rank] &&
-                    n_glo < vec_cumu_blkCol_size[my_rank + 1])
-                {
-                    int n = n_glo - vec_cumu_blkCol_size[my_rank];
-                    h_Alpha_loc(n) = h_Alpha_loc(n) - h_Sigma_contact(c);
-                }
-            }
+template <typename T>
+int c_NEGF_Common<T>::Get_ContactSelfEnergy(const ComplexType E)
+{
+    /*Fills h_Sigma_contact_data at energy E. With
+     *flag_cache_contact_self_energy, the self-energies are taken from the
+     *cache if E was visited before at the present contact potentials, else
+     *they are computed and added to the cache. A full cache is emptied,
+     *entries of previous contact potentials being unlikely to be visited
+     *again.
+     *Returns the cache column holding Sigma at E, or -1 if not cached.
+     *The keys are exact, such that entries stay valid when the integration
+     *paths change and energies of earlier paths may still be hit.*/
+    if (!flag_cache_contact_self_energy)
+    {
+        get_Sigma_at_contacts(h_Sigma_contact_data, E);
+        return -1;
+    }
 
-            /*MPI_Allgather*/
-            MPI_Allgatherv(&h_Alpha_loc(0), blkCol_size_loc, MPI_BlkType,
-                           &h_Alpha_glo(0), MPI_recv_count.data(),
-                           MPI_recv_disp.data(), MPI_BlkType,
-                           ParallelDescriptor::Communicator());
+    auto const &h_Sigma = h_Sigma_contact_data.table();
+    auto const &h_Sigma_cache = p_Sigma_cache->h_data.table();
+    auto &index = p_Sigma_cache->index;
 
-            h_Y_glo(0) = 0;
-            for (int n = 1; n < Hsize_glo; ++n)
-            {
-                int p = (n - 1) % offDiag_repeatBlkSize;
-                h_Ytil_glo(n) =
-                    h_Hc_loc(p) / (h_Alpha_glo(n - 1) - h_Y_glo(n - 1));
-                h_Y_glo(n) = h_Hb_loc(p) * h_Ytil_glo(n);
-            }
+    SigmaCacheKey key;
+    key[0] = E.real();
+    key[1] = E.imag();
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        key[2 + c] = U_contact[c];
+    }
 
-            h_X_glo(Hsize_glo - 1) = 0;
-            for (int n = Hsize_glo - 2; n > -1; n--)
-            {
-                int p = n % offDiag_repeatBlkSize;
-                h_Xtil_glo(n) =
-                    h_Hb_loc(p) / (h_Alpha_glo(n + 1) - h_X_glo(n + 1));
-                h_X_glo(n) = h_Hc_loc(p) * h_Xtil_glo(n);
-            }
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        for (int c = 0; c < NUM_CONTACTS; ++c)
+        {
+            h_Sigma(c) = h_Sigma_cache(c, it->second);
+        }
+        return it->second;
+    }
 
-            for (int c = 0; c < blkCol_size_loc; ++c)
-            {
-                int n = c + vec_cumu_blkCol_size[my_rank];
-                h_Y_loc(c) = h_Y_glo(n);
-                h_X_loc(c) = h_X_glo(n);
-            }
+    get_Sigma_at_contacts(h_Sigma_contact_data, E);
 
+    if (p_Sigma_cache->num_cached == contact_self_energy_cache_size)
+    {
 #ifdef AMREX_USE_GPU
-            d_Alpha_loc_data.copy(h_Alpha_loc_data);
-            d_X_loc_data.copy(h_X_loc_data);
-            d_Y_loc_data.copy(h_Y_loc_data);
-            amrex::Gpu::streamSynchronize();
+        /*columns about to be reused may still be in flight to the device*/
+        amrex::Gpu::streamSynchronize();
 #endif
+        Invalidate_ContactSelfEnergyCache();
+    }
 
-            /*following is for lambda capture*/
-            int cumulative_columns = vec_cumu_blkCol_size[my_rank];
-            auto *degen_vec_ptr = degen_vec.dataPtr();
-            amrex::Real const_multiplier = -1 * spin_degen / (MathConst::pi);
-
-            amrex::ParallelFor(blkCol_size_loc,
-                               [=] AMREX_GPU_DEVICE(int n) noexcept
-                               {
-                                   ComplexType one(1., 0.);
-                                   MatrixBlock<T> G_nn =
-                                       one / (Alpha(n) - X(n) - Y(n));
-                                   MatrixBlock<T> Rho0_n = const_multiplier *
-                                                           G_nn * weight *
-                                                           mul_factor;
-                                   Rho0_loc(n) = Rho0_loc(n) +
-                                                 Rho0_n.DiagMult(degen_vec_ptr);
-                               });
+    int cache_id = p_Sigma_cache->num_cached++;
+    index[key] = cache_id;
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        h_Sigma_cache(c, cache_id) = h_Sigma(c);
+    }
 #ifdef AMREX_USE_GPU
-            amrex::Gpu::streamSynchronize();
+    auto const &Sigma_cache = p_Sigma_cache->d_data.table();
+    /*copied from the cache column, such that h_Sigma_contact may be
+     *overwritten before the copy completes*/
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
+                          &h_Sigma_cache(0, cache_id),
+                          &h_Sigma_cache(0, cache_id) + NUM_CONTACTS,
+                          &Sigma_cache(0, cache_id));
 #endif
-        } /*Energy loop*/
-    }     /*Path loop*/
-
-    Deallocate_TemporaryArraysForGFComputation();
+    return -1;
 }
 
-// template<typename T>
-// AMREX_GPU_HOST_DEVICE
-// void
-// c_NEGF_Common<T>:: Compute_SurfaceGreensFunction (MatrixBlock<T>& gr, const
-// ComplexType EmU) {}
-
 template <typename T>
 void c_NEGF_Common<T>::get_Sigma_at_contacts(BlkTable1D &h_Sigma_contact_data,
                                              ComplexType E)
@@ -3901,7 +5363,7 @@ void c_NEGF_Common<T>::get_Sigma_at_contacts(BlkTable1D &h_Sigma_contact_data,
     for (std::size_t c = 0; c < NUM_CONTACTS; ++c)
     {
         MatrixBlock<T> gr;
-        Compute_SurfaceGreensFunction(gr, E - U_contact[c]);
+        Compute_LeadSurfaceGF(gr, E - U_contact[c]);
         // amrex::Print() << "c, E, gr: " << c << " " << E << " " << gr << "\n";
         h_Sigma(c) = h_tau(c) * gr * h_tau(c).Dagger();
     }
@@ -3922,7 +5384,7 @@ void c_NEGF_Common<T>::Write_BlkTable1D_asaf_E(
     const amrex::Vector<ComplexType> &E_vec, const BlkTable1D &Arr_data,
     std::string filename, std::string header)
 {
-    if (amrex::ParallelDescriptor::IOProcessor())
+    if (amrex::ParallelContext::IOProcessorSub())
     {
         // amrex::Print() << "Root Writing " << filename << "\n";
         std::ofstream outfile;
@@ -3955,33 +5417,32 @@ void c_NEGF_Common<T>::Write_Table1D(const amrex::Vector<VectorType> &Vec,
                                      const TableType &Arr_data,
                                      std::string filename, std::string header)
 {
-    if (amrex::ParallelDescriptor::IOProcessor())
-    {
-        // amrex::Print() << "\nRoot Writing " << filename << "\n";
-        std::ofstream outfile;
-        outfile.open(filename.c_str());
+    /*called by the process holding Arr_data, i.e. the root of the
+     *communicator it was gathered on*/
+    // amrex::Print() << "\nRoot Writing " << filename << "\n";
+    std::ofstream outfile;
+    outfile.open(filename.c_str());
 
-        auto const &Arr = Arr_data.const_table();
-        auto thi = Arr_data.hi();
+    auto const &Arr = Arr_data.const_table();
+    auto thi = Arr_data.hi();
 
-        outfile << header << "\n";
+    outfile << header << "\n";
 
-        if (Vec.size() == thi[0])
-        {
-            for (int e = 0; e < Vec.size(); ++e)
-            {
-                outfile << std::setprecision(15) << std::setw(35) << Vec[e]
-                        << std::setw(35) << Arr(e) << "\n";
-            }
-        }
-        else
+    if (Vec.size() == thi[0])
+    {
+        for (int e = 0; e < Vec.size(); ++e)
         {
-            outfile << "Mismatch in the size of Vec size: " << Vec.size()
-                    << " and Table1D_data: " << thi[0] << "\n";
+            outfile << std::setprecision(15) << std::setw(35) << Vec[e]
+                    << std::setw(35) << Arr(e) << "\n";
         }
-
-        outfile.close();
     }
+    else
+    {
+        outfile << "Mismatch in the size of Vec size: " << Vec.size()
+                << " and Table1D_data: " << thi[0] << "\n";
+    }
+
+    outfile.close();
 }
 
 template <typename T>
@@ -3989,7 +5450,7 @@ void c_NEGF_Common<T>::Write_BlkTable2D_asaf_E(const BlkTable2D &Arr_data,
                                                std::string filename,
                                                std::string header)
 {
-    if (amrex::ParallelDescriptor::IOProcessor())
+    if (amrex::ParallelContext::IOProcessorSub())
     {
         // amrex::Print() << "\n Root Writing " << filename << "\n";
         std::ofstream outfile;
@@ -4051,78 +5512,27 @@ void c_NEGF_Common<T>::Print_Table2D_loc(const U &Tab2D_data)
 template <typename T>
 void c_NEGF_Common<T>::Compute_Current()
 {
+    if (flag_fused_current_ready and !flag_write_integrand_main)
+    {
+        Finalize_FusedCurrent();
+        return;
+    }
+
     SetVal_Table1D(h_Current_loc_data, 0.);
 
-    auto const &h_minusHa_loc = h_minusHa_loc_data.table();
-    auto const &h_Hb_loc = h_Hb_loc_data.table();
-    auto const &h_Hc_loc = h_Hc_loc_data.table();
-    auto const &h_tau = h_tau_glo_data.table();
     auto const &h_Current_loc = h_Current_loc_data.table();
 
     Allocate_TemporaryArraysForGFComputation();
 
-    auto const &h_Alpha_loc = h_Alpha_loc_data.table();
-    auto const &h_Alpha_glo = h_Alpha_glo_data.table();
-    auto const &h_Xtil_glo = h_Xtil_glo_data.table();
-    auto const &h_Ytil_glo = h_Ytil_glo_data.table();
-    auto const &h_X_glo = h_X_glo_data.table();
-    auto const &h_Y_glo = h_Y_glo_data.table();
-    auto const &h_X_loc = h_X_loc_data.table();
-    auto const &h_Y_loc = h_Y_loc_data.table();
-    auto const &h_Alpha_contact = h_Alpha_contact_data.table();
-    auto const &h_Y_contact = h_Y_contact_data.table();
-    auto const &h_X_contact = h_X_contact_data.table();
-    auto const &h_Sigma_contact = h_Sigma_contact_data.table();
-    auto const &h_Fermi_contact = h_Fermi_contact_data.table();
-
 #ifdef AMREX_USE_GPU
     RealTable1D d_Current_loc_data({0}, {NUM_CONTACTS}, The_Arena());
     auto const &Current_loc = d_Current_loc_data.table();
     d_Current_loc_data.copy(h_Current_loc_data);
 
-    auto const &GR_loc = d_GR_loc_data.table();
-    auto const &A_loc = d_A_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = d_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = d_Xtil_glo_data.const_table();
-    auto const &d_Xtil_glo = d_Xtil_glo_data.table();
-    auto const &Ytil_glo = d_Ytil_glo_data.const_table();
-    auto const &d_Ytil_glo = d_Ytil_glo_data.table();
-    auto const &X = d_X_loc_data.const_table();
-    auto const &d_X_loc = d_X_loc_data.table();
-    auto const &Y = d_Y_loc_data.const_table();
-    auto const &d_Y_loc = d_Y_loc_data.table();
-
-    auto const &Alpha_contact = d_Alpha_contact_data.const_table();
-    auto const &X_contact = d_X_contact_data.const_table();
-    auto const &Y_contact = d_Y_contact_data.const_table();
-    auto const &Sigma_contact = d_Sigma_contact_data.const_table();
-    auto const &Fermi_contact = d_Fermi_contact_data.const_table();
-
-    auto *trace_r = d_Trace_r.dataPtr();
-    auto *trace_i = d_Trace_i.dataPtr();
     auto &degen_vec = block_degen_gpuvec;
-
 #else
     auto const &Current_loc = h_Current_loc_data.table();
 
-    auto const &GR_loc = h_GR_loc_data.table();
-    auto const &A_loc = h_A_loc_data.table();
-    /*constant references*/
-    auto const &Alpha = h_Alpha_loc_data.const_table();
-    auto const &Xtil_glo = h_Xtil_glo_data.const_table();
-    auto const &Ytil_glo = h_Ytil_glo_data.const_table();
-    auto const &X = h_X_loc_data.const_table();
-    auto const &Y = h_Y_loc_data.const_table();
-
-    auto const &Alpha_contact = h_Alpha_contact_data.const_table();
-    auto const &X_contact = h_X_contact_data.const_table();
-    auto const &Y_contact = h_Y_contact_data.const_table();
-    auto const &Sigma_contact = h_Sigma_contact_data.const_table();
-    auto const &Fermi_contact = h_Fermi_contact_data.const_table();
-
-    auto *trace_r = h_Trace_r.dataPtr();
-    auto *trace_i = h_Trace_i.dataPtr();
     auto &degen_vec = block_degen_vec;
 #endif
 
@@ -4167,301 +5577,43 @@ void c_NEGF_Common<T>::Compute_Current()
                            });
     }
 
-    int e_prev = 0;
-    for (int p = 0; p < ContourPath_RhoNonEq.size(); ++p)
-    {
-        for (int e = 0; e < ContourPath_RhoNonEq[p].num_pts; ++e)
-        {
-            ComplexType E = ContourPath_RhoNonEq[p].E_vec[e];
-            ComplexType weight = ContourPath_RhoNonEq[p].weight_vec[e];
-            ComplexType mul_factor = ContourPath_RhoNonEq[p].mul_factor_vec[e];
-
-            for (int n = 0; n < blkCol_size_loc; ++n)
-            {
-                h_Alpha_loc(n) = E + h_minusHa_loc(n);
-                /*+ because h_minusHa is defined previously as -(H0+U)*/
-            }
-
-            get_Sigma_at_contacts(h_Sigma_contact_data, E);
-#ifdef AMREX_USE_GPU
-            d_Sigma_contact_data.copy(h_Sigma_contact_data);
-#endif
-
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n_glo = global_contact_index[c];
-                int n = n_glo - vec_cumu_blkCol_size[my_rank];
-
-                if (n_glo >= vec_cumu_blkCol_size[my_rank] &&
-                    n_glo < vec_cumu_blkCol_size[my_rank + 1])
-                {
-                    h_Alpha_loc(n) = h_Alpha_loc(n) - h_Sigma_contact(c);
-                }
-                h_Fermi_contact(c) =
-                    FermiFunction(E - mu_contact[c], kT_contact[c]);
-            }
-#ifdef AMREX_USE_GPU
-            d_Fermi_contact_data.copy(h_Fermi_contact_data);
-            d_Alpha_loc_data.copy(h_Alpha_loc_data);
-#endif
-
-            /*MPI_Allgather*/
-            MPI_Allgatherv(&h_Alpha_loc(0), blkCol_size_loc, MPI_BlkType,
-                           &h_Alpha_glo(0), MPI_recv_count.data(),
-                           MPI_recv_disp.data(), MPI_BlkType,
-                           ParallelDescriptor::Communicator());
-
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n_glo = global_contact_index[c];
-                h_Alpha_contact(c) = h_Alpha_glo(n_glo);
-            }
-#ifdef AMREX_USE_GPU
-            d_Alpha_contact_data.copy(h_Alpha_contact_data);
-#endif
-
-            h_Y_glo(0) = 0;
-            h_X_glo(Hsize_glo - 1) = 0;
-            for (int section = 0; section < num_recursive_parts; ++section)
-            {
-                for (int n = std::max(1, Hsize_recur_part * section);
-                     n < std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-                     ++n)
-                {
-                    int p = (n - 1) % offDiag_repeatBlkSize;
-                    h_Ytil_glo(n) =
-                        h_Hc_loc(p) / (h_Alpha_glo(n - 1) - h_Y_glo(n - 1));
-                    h_Y_glo(n) = h_Hb_loc(p) * h_Ytil_glo(n);
-                }
-                for (int n = std::min(Hsize_glo - 2,
-                                      Hsize_recur_part *
-                                          (num_recursive_parts - section));
-                     n >=
-                     Hsize_recur_part * (num_recursive_parts - section - 1);
-                     n--)
-                {
-                    int p = n % offDiag_repeatBlkSize;
-                    h_Xtil_glo(n) =
-                        h_Hb_loc(p) / (h_Alpha_glo(n + 1) - h_X_glo(n + 1));
-                    h_X_glo(n) = h_Hc_loc(p) * h_Xtil_glo(n);
-                }
-
-#ifdef AMREX_USE_GPU
-                int Ytil_begin = section * Hsize_recur_part;
-                int Ytil_end =
-                    std::min(Hsize_recur_part * (section + 1), Hsize_glo);
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Ytil_glo.p + Ytil_begin,
-                                      h_Ytil_glo.p + Ytil_end,
-                                      d_Ytil_glo.p + Ytil_begin);
-
-                int Xtil_begin =
-                    Hsize_recur_part * (num_recursive_parts - section - 1);
-                int Xtil_end =
-                    std::min(Hsize_glo, Hsize_recur_part *
-                                            (num_recursive_parts - section));
-
-                amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice,
-                                      h_Xtil_glo.p + Xtil_begin,
-                                      h_Xtil_glo.p + Xtil_end,
-                                      d_Xtil_glo.p + Xtil_begin);
-#endif
-            }
-
-#ifdef AMREX_USE_GPU
-            int X_begin = vec_cumu_blkCol_size[my_rank];
-            int X_end = X_begin + blkCol_size_loc;
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_X_glo.p + X_begin,
-                                  h_X_glo.p + X_end, d_X_loc.p);
-
-            amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_Y_glo.p + X_begin,
-                                  h_Y_glo.p + X_end, d_Y_loc.p);
-#else
-            for (int c = 0; c < blkCol_size_loc; ++c)
-            {
-                int n = c + vec_cumu_blkCol_size[my_rank];
-                h_Y_loc(c) = h_Y_glo(n);
-                h_X_loc(c) = h_X_glo(n);
-            }
-#endif
-
-            for (int c = 0; c < NUM_CONTACTS; ++c)
-            {
-                int n = global_contact_index[c];
-                h_Y_contact(c) = h_Y_glo(n);
-                h_X_contact(c) = h_X_glo(n);
-            }
-#ifdef AMREX_USE_GPU
-            d_X_contact_data.copy(h_X_contact_data);
-            d_Y_contact_data.copy(h_Y_contact_data);
-            amrex::Gpu::streamSynchronize();
-#endif
-
-            /*following is for lambda capture*/
-            int cumulative_columns = vec_cumu_blkCol_size[my_rank];
-            int Hsize = Hsize_glo;
-            auto &GC_ID = global_contact_index;
-            auto *degen_vec_ptr = degen_vec.dataPtr();
-
-            amrex::Real const_multiplier =
-                spin_degen * (PhysConst::q_e) / (PhysConst::h_eVperHz);
-            bool write_integrand = flag_write_integrand_main;
-            int e_glo = e + e_prev;
-
-            amrex::ParallelFor(
-                blkCol_size_loc,
-                [=] AMREX_GPU_DEVICE(int n) noexcept
-                {
-                    int n_glo = n + cumulative_columns; /*global column number*/
-                    ComplexType one(1., 0.);
-                    ComplexType minus_one(-1., 0.);
-                    ComplexType imag(0., 1.);
-
-#ifdef COMPUTE_GREENS_FUNCTION_OFFDIAG_ELEMS
-                    GR_loc(n_glo, n) = one / (Alpha(n) - X(n) - Y(n));
-                    for (int m = n_glo; m > 0; m--)
-                    {
-                        GR_loc(m - 1, n) = -1 * Ytil_glo(m) * GR_loc(m, n);
-                    }
-                    for (int m = n_glo; m < Hsize - 1; ++m)
-                    {
-                        GR_loc(m + 1, n) = -1 * Xtil_glo(m) * GR_loc(m, n);
-                    }
-#else
-                    GR_loc(n) = one / (Alpha(n) - X(n) - Y(n));
-#endif
-
-                    MatrixBlock<T> A_tk[NUM_CONTACTS];
-                    MatrixBlock<T> Gamma[NUM_CONTACTS];
-                    MatrixBlock<T> Gn_nn;
-                    Gn_nn = 0.;
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                    for (int m = 0; m < Hsize; ++m)
-                    {
-                        A_loc(m, n) = 0.;
-                    }
-#else
-                    A_loc(n) = 0.;
-#endif
-                    for (int k = 0; k < NUM_CONTACTS; ++k)
-                    {
-                        int k_glo = GC_ID[k];
-                        MatrixBlock<T> G_contact_kk =
-                            one /
-                            (Alpha_contact(k) - X_contact(k) - Y_contact(k));
-
-                        MatrixBlock<T> temp = G_contact_kk;
-                        for (int m = k_glo; m < n_glo; ++m)
-                        {
-                            temp = -1 * Xtil_glo(m) * temp;
-                        }
-                        for (int m = k_glo; m > n_glo; m--)
-                        {
-                            temp = -1 * Ytil_glo(m) * temp;
-                        }
-                        MatrixBlock<T> G_contact_nk = temp;
-
-                        Gamma[k] = imag * (Sigma_contact(k) -
-                                           Sigma_contact(k).Dagger());
-
-                        MatrixBlock<T> A_nn =
-                            G_contact_nk * Gamma[k] * G_contact_nk.Dagger();
-                        MatrixBlock<T> A_kn =
-                            G_contact_kk * Gamma[k] * G_contact_nk.Dagger();
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                        A_loc(k_glo, n) = A_loc(k_glo, n) + A_kn;
-                        for (int m = k_glo + 1; m < Hsize; ++m)
-                        {
-                            A_kn = -1 * Xtil_glo(m - 1) * A_kn;
-                            A_loc(m, n) = A_loc(m, n) + A_kn;
-                        }
-                        for (int m = k_glo - 1; m >= 0; m--)
-                        {
-                            A_kn = -1 * Ytil_glo(m + 1) * A_kn;
-                            A_loc(m, n) = A_loc(m, n) + A_kn;
-                        }
-
-                        A_tk[k] = 0.;
-                        if (n_glo == CT_ID[k])
-                        {
-                            A_tk[k] = A_kn;
-                        }
-#else
-                        A_loc(n) = A_loc(n) + A_nn;
-#endif
-                        Gn_nn = Gn_nn + A_nn * Fermi_contact(k);
-                    }
-
-                    /*Current calculation*/
-                    for (int k = 0; k < NUM_CONTACTS; ++k)
-                    {
-                        if (n_glo == GC_ID[k])
-                        {
-#ifdef COMPUTE_SPECTRAL_FUNCTION_OFFDIAG_ELEMS
-                            MatrixBlock<T> IF =
-                                Gamma[k] * Fermi_contact(k) * A_loc(n_glo, n) -
-                                Gamma[k] * Gn_nn;
-#else
-                            MatrixBlock<T> IF =
-                                Gamma[k] * Fermi_contact(k) * A_loc(n) -
-                                Gamma[k] * Gn_nn;
-#endif
+    amrex::Real const_multiplier =
+        spin_degen * (PhysConst::q_e) / (PhysConst::h_eVperHz);
 
-                            MatrixBlock<T> Current_atE =
-                                const_multiplier * IF.DiagMult(degen_vec_ptr) *
-                                weight * mul_factor;
-                            /*integrating*/
-                            Current_loc(k) =
-                                Current_loc(k) + Current_atE.DiagSum().real();
-                        }
-                    }
+    s_Current_Observable<T> Current_obs;
+    Current_obs.Current_loc = Current_loc;
+    Current_obs.GC_ID = global_contact_index;
+    Current_obs.degen_vec_ptr = degen_vec.dataPtr();
+    Current_obs.const_multiplier = const_multiplier;
 
-                    if (write_integrand)
-                    {
-                        if (n_glo == int(Hsize / 2))
-                        {
-                            MatrixBlock<T> Intermed = const_multiplier * Gn_nn;
-                            NonEq_Integrand(e_glo) =
-                                Intermed.DiagMult(degen_vec_ptr)
-                                    .DiagSum()
-                                    .real();
-                        }
-                        else if (n_glo == 0)
-                        {
-                            MatrixBlock<T> Intermed = const_multiplier * Gn_nn;
-                            NonEq_Integrand_Source(e_glo) =
-                                Intermed.DiagMult(degen_vec_ptr)
-                                    .DiagSum()
-                                    .real();
-                        }
-                        else if (n_glo == Hsize - 1)
-                        {
-                            MatrixBlock<T> Intermed = const_multiplier * Gn_nn;
-                            NonEq_Integrand_Drain(e_glo) =
-                                Intermed.DiagMult(degen_vec_ptr)
-                                    .DiagSum()
-                                    .real();
-                        }
-                    }
-                });
+    auto energy_pts = Get_EnergyPoints(ContourPath_RhoNonEq, true);
 
-#ifdef AMREX_USE_GPU
-            amrex::Gpu::streamSynchronize();
-#endif
-        }
-        e_prev += ContourPath_RhoNonEq[p].num_pts;
+    if (flag_write_integrand_main)
+    {
+        s_Integrand_Observable<T> Integrand_obs;
+        Integrand_obs.Integrand = NonEq_Integrand;
+        Integrand_obs.Integrand_Source = NonEq_Integrand_Source;
+        Integrand_obs.Integrand_Drain = NonEq_Integrand_Drain;
+        Integrand_obs.degen_vec_ptr = degen_vec.dataPtr();
+        Integrand_obs.const_multiplier = const_multiplier;
+        Integrand_obs.n_channel = int(Hsize_glo / 2);
+        Integrand_obs.n_source = 0;
+        Integrand_obs.n_drain = Hsize_glo - 1;
+
+        Run_RGF_EnergyLoop(energy_pts, nullptr, Current_obs, Integrand_obs);
+    }
+    else
+    {
+        Run_RGF_EnergyLoop(energy_pts, nullptr, Current_obs);
     }
 #ifdef AMREX_USE_GPU
     h_Current_loc_data.copy(d_Current_loc_data);
     amrex::Gpu::streamSynchronize();
 #endif
 
-    for (int k = 0; k < NUM_CONTACTS; ++k)
-    {
-        amrex::ParallelDescriptor::ReduceRealSum(h_Current_loc(k));
-    }
-    if (ParallelDescriptor::IOProcessor())
+    MPI_Allreduce(MPI_IN_PLACE, &(h_Current_loc(0)), NUM_CONTACTS, MPI_DOUBLE,
+                  MPI_SUM, NS_Comm);
+    if (NS_IOProcessor())
     {
         amrex::Print() << "\nCurrent: \n";
         for (int k = 0; k < NUM_CONTACTS; ++k)
@@ -4482,17 +5634,17 @@ void c_NEGF_Common<T>::Compute_Current()
 #endif
         MPI_Allreduce(MPI_IN_PLACE, &(h_NonEq_Integrand(0)),
                       total_noneq_integration_pts, MPI_DOUBLE, MPI_SUM,
-                      ParallelDescriptor::Communicator());
+                      NS_Comm);
 
         MPI_Allreduce(MPI_IN_PLACE, &(h_NonEq_Integrand_Source(0)),
                       total_noneq_integration_pts, MPI_DOUBLE, MPI_SUM,
-                      ParallelDescriptor::Communicator());
+                      NS_Comm);
 
         MPI_Allreduce(MPI_IN_PLACE, &(h_NonEq_Integrand_Drain(0)),
                       total_noneq_integration_pts, MPI_DOUBLE, MPI_SUM,
-                      ParallelDescriptor::Communicator());
+                      NS_Comm);
 
-        if (amrex::ParallelDescriptor::IOProcessor())
+        if (NS_IOProcessor())
         {
             amrex::Vector<ComplexType> E_total_vec;
             E_total_vec.resize(total_noneq_integration_pts);
@@ -4529,8 +5681,8 @@ void c_NEGF_Common<T>::Compute_Current()
                                   kT_contact[0]
                            << "\n";
         }
-        ParallelDescriptor::Bcast(&E_at_max_noneq_integrand, 1,
-                                  ParallelDescriptor::IOProcessorNumber());
+        ParallelDescriptor::Bcast(&E_at_max_noneq_integrand, 1, NS_root,
+                                  NS_Comm);
 
         h_NonEq_Integrand_data.clear();
         h_NonEq_Integrand_Source_data.clear();
@@ -4545,6 +5697,51 @@ void c_NEGF_Common<T>::Compute_Current()
     Deallocate_TemporaryArraysForGFComputation();
 }
 
+template <typename T>
+void c_NEGF_Common<T>::Finalize_FusedCurrent()
+{
+    /*The last charge pass was done at the potential and on the energy points
+     *that Compute_Current would use, so only the reductions are left.*/
+    auto const &h_Current_loc = h_Current_loc_data.table();
+    auto const &h_NonEq_Transmission = h_NonEq_Transmission_data.table();
+
+    MPI_Allreduce(MPI_IN_PLACE, &(h_Current_loc(0)), NUM_CONTACTS, MPI_DOUBLE,
+                  MPI_SUM, NS_Comm);
+    if (NS_IOProcessor())
+    {
+        amrex::Print() << "\nCurrent (from the final charge pass): \n";
+        for (int k = 0; k < NUM_CONTACTS; ++k)
+        {
+            amrex::Print() << " contact, total current: " << k
+                           << std::setprecision(5) << std::setw(15)
+                           << h_Current_loc(k) << "\n";
+        }
+    }
+
+    /*energy points are distributed over energy groups and the transmission
+     *column is owned by one process of each group*/
+    MPI_Reduce(NS_IOProcessor() ? MPI_IN_PLACE : &(h_NonEq_Transmission(0)),
+               &(h_NonEq_Transmission(0)), total_noneq_integration_pts,
+               MPI_DOUBLE, MPI_SUM, NS_root, NS_Comm);
+
+    if (NS_IOProcessor())
+    {
+        amrex::Vector<amrex::Real> E_total_vec;
+        for (auto &path : ContourPath_RhoNonEq)
+        {
+            for (int e = 0; e < path.num_pts; ++e)
+            {
+                E_total_vec.push_back(path.E_vec[e].real());
+            }
+        }
+        Write_Table1D(E_total_vec, h_NonEq_Transmission_data,
+                      step_filename_str + "_transmission.dat",
+                      "E_r, Transmission_r over the non-equilibrium window");
+    }
+    h_NonEq_Transmission_data.clear();
+    flag_fused_current_ready = false;
+}
+
 template <typename T>
 void c_NEGF_Common<T>::Write_Current(const int step, const amrex::Real Vds,
                                      const amrex::Real Vgs,
@@ -4552,7 +5749,7 @@ void c_NEGF_Common<T>::Write_Current(const int step, const amrex::Real Vds,
                                      const amrex::Real Broyden_fraction,
                                      const int Broyden_Scalar)
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (NS_IOProcessor())
     {
         amrex::Print() << "Root writing current\n";
         auto const &h_Current_loc = h_Current_loc_data.table();
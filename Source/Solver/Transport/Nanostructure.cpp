@@ -15,8 +15,14 @@
 //
 #include <iostream>
 
-template class c_Nanostructure<c_CNT>;
-template class c_Nanostructure<c_Graphene>;
+#define INSTANTIATE_NANOSTRUCTURE_CNT(N) \
+    template class c_Nanostructure<c_CNT<N>>;
+CNT_FOR_EACH_NUM_MODES(INSTANTIATE_NANOSTRUCTURE_CNT)
+#undef INSTANTIATE_NANOSTRUCTURE_CNT
+#define INSTANTIATE_NANOSTRUCTURE_GRAPHENE(W) \
+    template class c_Nanostructure<c_Graphene<W>>;
+GRAPHENE_FOR_EACH_WIDTH(INSTANTIATE_NANOSTRUCTURE_GRAPHENE)
+#undef INSTANTIATE_NANOSTRUCTURE_GRAPHENE
 // template class c_Nanostructure<c_Silicon>;
 
 template <typename NSType>
@@ -68,12 +74,9 @@ c_Nanostructure<NSType>::c_Nanostructure(
         Deposit_AtomAttributeToMesh();
     }
 
-    if (_use_negf)
-    {
-        NSType::Initialize_NEGF(negf_foldername_str + "/transport_common",
-                                _use_electrostatic);
-        pos_vec.clear();
-    }
+    /*NSType::Initialize_NEGF is called by the transport solver once the
+     *processes of all nanostructures are assigned*/
+    if (_use_negf) pos_vec.clear();
 }
 
 template <typename NSType>
@@ -91,7 +94,7 @@ amrex::Real c_Nanostructure<NSType>::Compute_CellVolume()
 template <typename NSType>
 void c_Nanostructure<NSType>::Fill_AtomLocations()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         auto get_1D_site_id = NSType::get_1D_site_id();
 
@@ -187,7 +190,7 @@ void c_Nanostructure<NSType>::Evaluate_LocalFieldSites()
 template <typename NSType>
 void c_Nanostructure<NSType>::Read_AtomLocations()
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         std::string read_filename = NSType::get_read_atom_filename();
 
@@ -283,6 +286,20 @@ void c_Nanostructure<NSType>::Mark_CellsWithAtoms()
 
 template <typename NSType>
 void c_Nanostructure<NSType>::Gather_MeshAttributeAtAtoms()
+{
+    amrex::Gpu::HostVector<amrex::Real> h_vec_V(NSType::num_field_sites);
+
+    amrex::Print() << "\n";
+
+    Gather_FieldAtSites(h_vec_V.dataPtr());
+
+    Set_PotentialAtSites(h_vec_V.dataPtr());
+
+    h_vec_V.clear();
+}
+
+template <typename NSType>
+void c_Nanostructure<NSType>::Gather_FieldAtSites(amrex::Real *p_V)
 {
     const auto &plo = _geom->ProbLoArray();
     const auto dx = _geom->CellSizeArray();
@@ -312,7 +329,7 @@ void c_Nanostructure<NSType>::Gather_MeshAttributeAtAtoms()
                            });
     }
 
-    Obtain_PotentialAtSites();
+    Obtain_PotentialAtSites(p_V);
 }
 
 template <typename NSType>
@@ -398,13 +415,14 @@ void c_Nanostructure<NSType>::Deposit_AtomAttributeToMesh()
 }
 
 template <typename NSType>
-void c_Nanostructure<NSType>::Obtain_PotentialAtSites()
+void c_Nanostructure<NSType>::Obtain_PotentialAtSites(amrex::Real *p_V)
 {
+    /*p_V receives the gathered field averaged over the atoms of each of the
+     *num_field_sites sites, on all processes*/
     const int num_field_sites = NSType::num_field_sites;
     const int num_atoms_per_field_site = NSType::num_atoms_per_field_site;
     const int num_atoms_to_avg_over = NSType::num_atoms_to_avg_over;
     const int average_field_flag = NSType::average_field_flag;
-    const int blkCol_size_loc = NSType::blkCol_size_loc;
 
     amrex::Gpu::DeviceVector<amrex::Real> d_vec_V(num_field_sites);
     amrex::Gpu::HostVector<amrex::Real> h_vec_V(num_field_sites);
@@ -416,8 +434,6 @@ void c_Nanostructure<NSType>::Obtain_PotentialAtSites()
 
     const int FSO = NSType::NS_field_sites_offset;
 
-    amrex::Print() << "\n";
-
     int lev = 0;
     for (MyParIter pti(*this, lev); pti.isValid(); ++pti)
     {
@@ -492,18 +508,11 @@ void c_Nanostructure<NSType>::Obtain_PotentialAtSites()
                      h_vec_V.begin());
     amrex::Gpu::streamSynchronize();
     MPI_Allreduce(MPI_IN_PLACE, &(p_hV[0]), num_field_sites, MPI_DOUBLE,
-                  MPI_SUM, ParallelDescriptor::Communicator());
+                  MPI_SUM, ParallelContext::CommunicatorSub());
 
-    auto const &h_U_loc = NSType::h_U_loc_data.table();
-    for (int l = 0; l < blkCol_size_loc; ++l)
+    for (int s = 0; s < num_field_sites; ++s)
     {
-        int gid = NSType::vec_blkCol_gids[l];
-        h_U_loc(l) = -p_hV[gid] / num_atoms_to_avg_over;
-    }
-    for (int c = 0; c < NUM_CONTACTS; ++c)
-    {
-        NSType::U_contact[c] =
-            -p_hV[NSType::global_contact_index[c]] / num_atoms_to_avg_over;
+        p_V[s] = p_hV[s] / num_atoms_to_avg_over;
     }
     d_vec_V.clear();
     h_vec_V.clear();
@@ -519,3 +528,61 @@ void c_Nanostructure<NSType>::Obtain_PotentialAtSites()
     //     }
     // }
 }
+
+template <typename NSType>
+void c_Nanostructure<NSType>::Set_PotentialAtSites(amrex::Real const *p_V)
+{
+    /*U = -V, p_V holds the field of all num_field_sites sites*/
+    const int blkCol_size_loc = NSType::blkCol_size_loc;
+
+    auto const &h_U_loc = NSType::h_U_loc_data.table();
+    for (int l = 0; l < blkCol_size_loc; ++l)
+    {
+        int gid = NSType::vec_blkCol_gids[l];
+        h_U_loc(l) = -p_V[gid];
+    }
+    for (int c = 0; c < NUM_CONTACTS; ++c)
+    {
+        NSType::U_contact[c] = -p_V[NSType::global_contact_index[c]];
+    }
+}
+
+template <typename NSType>
+void c_Nanostructure<NSType>::Deposit_UnitChargeAtSite(const int site)
+{
+    /*adds the charge +q_e of field site `site` to the deposit field, spread
+     *over its atoms as in Deposit_AtomAttributeToMesh*/
+    const auto &plo = _geom->ProbLoArray();
+    const auto dx = _geom->CellSizeArray();
+    int lev = 0;
+
+    for (MyParIter pti(*this, lev); pti.isValid(); ++pti)
+    {
+        auto np = pti.numParticles();
+
+        const auto &particles = pti.GetArrayOfStructs();
+        const auto p_par = particles().data();
+
+        auto rho = p_mf_deposit->array(pti);
+        auto get_1D_site_id = NSType::get_1D_site_id();
+
+        amrex::Real unit_charge = PhysConst::q_e;
+        int atoms_per_field_site = NSType::num_atoms_per_field_site;
+        const int FSO = NSType::NS_field_sites_offset;
+
+        amrex::ParallelFor(np,
+                           [=] AMREX_GPU_DEVICE(int p) noexcept
+                           {
+                               int global_id = p_par[p].id();
+                               int site_id = get_1D_site_id(global_id) - FSO;
+                               if (site_id != site) return;
+
+                               amrex::Real vol =
+                                   AMREX_D_TERM(dx[0], *dx[1], *dx[2]);
+                               amrex::Real qp =
+                                   unit_charge / vol / atoms_per_field_site;
+                               CloudInCell::Deposit_Trilinear(p_par[p].pos(),
+                                                              plo, dx, rho, qp);
+                           });
+    }
+}
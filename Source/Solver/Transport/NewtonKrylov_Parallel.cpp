@@ -0,0 +1,385 @@
+#include <cmath>
+
+#include "Transport.H"
+
+using namespace amrex;
+
+#ifdef BROYDEN_PARALLEL
+/*Jacobian-free Newton-Krylov for the fixed point n = N(n), where N maps the
+ *input charge n_curr_in over Poisson, gather and NEGF to the output charge
+ *n_curr_out. Newton solves J delta = -F for the residual F = n - N(n) with
+ *flexible GMRES, and the products with the Jacobian are finite differences,
+ * J z = (F(n_k + eps z) - F(n_k)) / eps.
+ *
+ *Every pass of the self-consistent loop in Solve evaluates F once, hence
+ *this is a state machine that picks the input charge of the next pass:
+ * Base:       F(n_k) at the base point n_k, converged or a GMRES starts,
+ * Probe:      F(n_k + eps z_j) for the Krylov direction z_j,
+ * LineSearch: F(n_k + lambda delta) for the Newton direction delta, lambda
+ *             is halved at most Newton_max_backtracks times.
+ *Broyden_Step counts the evaluations and Broyden_Norm of a probe is the one
+ *of its base point, such that only base points end the loop.
+ *
+ *The right preconditioner is diagonal. The linearized Poisson-charge map
+ *has the Jacobian 1 + C_q,i G_ii at site i, where C_q is the quantum
+ *capacitance dn/dU of the site and G_ii the electrostatic response of its
+ *potential to its own charge. It is estimated from the probes themselves,
+ *by least squares sum_p (J z_p)_i z_p,i / sum_p z_p,i^2, such that neither
+ *the LDOS nor additional Poisson solves are needed. Before the first probe
+ *it is linear mixing with Broyden_fraction.*/
+void c_TransportSolver::Set_NewtonKrylov_Parallel()
+{
+    const int SSL = site_size_loc_all_NS;
+    const int m = Newton_KrylovDim;
+
+    h_Newton_n_base_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Newton_F_base_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Newton_F_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Newton_delta_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Newton_diag_num_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Newton_diag_den_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Newton_V_data.resize({0, 0}, {SSL, m + 1}, The_Pinned_Arena());
+    h_Newton_Z_data.resize({0, 0}, {SSL, m}, The_Pinned_Arena());
+
+    SetVal_RealTable1D(h_Newton_diag_num_data, 0.);
+    SetVal_RealTable1D(h_Newton_diag_den_data, 0.);
+
+    Newton_Hessenberg.resize((m + 1) * m);
+    Newton_Givens_c.resize(m);
+    Newton_Givens_s.resize(m);
+    Newton_g.resize(m + 1);
+
+    Reset_NewtonKrylov_Parallel();
+}
+
+void c_TransportSolver::Reset_NewtonKrylov_Parallel()
+{
+    /*the diagonal estimate is kept, the quantum capacitance changes little
+     *from one bias step to the next*/
+    Newton_Stage = s_Newton_Stage::Base;
+    Newton_KrylovIter = 0;
+    Newton_NumBacktracks = 0;
+    Newton_Lambda = 1.;
+}
+
+void c_TransportSolver::Start_NewtonKrylovStep()
+{
+    const int m = Newton_KrylovDim;
+    auto const &F_base = h_Newton_F_base_data.const_table();
+    auto const &V = h_Newton_V_data.table();
+    auto const &diag_num = h_Newton_diag_num_data.table();
+    auto const &diag_den = h_Newton_diag_den_data.table();
+
+    /*older probes count half, such that the preconditioner follows the
+     *Jacobian from one Newton step to the next*/
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        V(site, 0) = -F_base(site) / Newton_BaseNorm;
+        diag_num(site) *= 0.5;
+        diag_den(site) *= 0.5;
+    }
+
+    for (auto &h : Newton_Hessenberg) h = 0.;
+    for (int i = 0; i <= m; ++i) Newton_g[i] = 0.;
+    Newton_g[0] = Newton_BaseNorm;
+    Newton_KrylovIter = 0;
+
+    Probe_KrylovDirection();
+}
+
+void c_TransportSolver::Probe_KrylovDirection()
+{
+    const int j = Newton_KrylovIter;
+    const amrex::Real BF = Broyden_fraction;
+    auto const &n_curr_in = h_n_curr_in_data.table();
+    auto const &n_base = h_Newton_n_base_data.const_table();
+    auto const &V = h_Newton_V_data.const_table();
+    auto const &Z = h_Newton_Z_data.table();
+    auto const &diag_num = h_Newton_diag_num_data.const_table();
+    auto const &diag_den = h_Newton_diag_den_data.const_table();
+
+    /*z_j = M^-1 v_j, and the squared norms of n_k and z_j*/
+    amrex::Real sums[2] = {0., 0.};
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        amrex::Real M_inv = BF;
+        if (diag_den(site) > 0.)
+        {
+            M_inv = 1. / amrex::max(diag_num(site) / diag_den(site),
+                                  amrex::Real(1.));
+        }
+        Z(site, j) = M_inv * V(site, j);
+
+        sums[0] += n_base(site) * n_base(site);
+        sums[1] += Z(site, j) * Z(site, j);
+    }
+    ParallelAllReduce::Sum(sums, 2, ParallelContext::CommunicatorSub());
+
+    /*The perturbation is relative to the charge, or to the residual for a
+     *vanishing charge. The noise of the NEGF integration limits how small
+     *Newton_fd_epsilon can be.*/
+    const amrex::Real scale = amrex::max(std::sqrt(sums[0]), Newton_BaseNorm);
+    Newton_Eps = Newton_FDEpsilon * scale / std::sqrt(sums[1]);
+
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        n_curr_in(site) = n_base(site) + Newton_Eps * Z(site, j);
+    }
+    Newton_Stage = s_Newton_Stage::Probe;
+}
+
+void c_TransportSolver::Finish_KrylovSolve()
+{
+    /*y minimizes |g - H y| over the k = Newton_KrylovIter + 1 directions,
+     *H is upper triangular after the Givens rotations*/
+    const int m = Newton_KrylovDim;
+    const int k = Newton_KrylovIter + 1;
+    auto const &H = Newton_Hessenberg;
+
+    amrex::Vector<amrex::Real> y(k, 0.);
+    for (int i = k - 1; i >= 0; --i)
+    {
+        amrex::Real sum = Newton_g[i];
+        for (int l = i + 1; l < k; ++l) sum -= H[i + (m + 1) * l] * y[l];
+        const amrex::Real diag = H[i + (m + 1) * i];
+        y[i] = (diag != 0.) ? sum / diag : 0.;
+    }
+
+    auto const &n_curr_in = h_n_curr_in_data.table();
+    auto const &n_base = h_Newton_n_base_data.const_table();
+    auto const &Z = h_Newton_Z_data.const_table();
+    auto const &delta = h_Newton_delta_data.table();
+
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        delta(site) = 0.;
+        for (int i = 0; i < k; ++i) delta(site) += y[i] * Z(site, i);
+        n_curr_in(site) = n_base(site) + delta(site);
+    }
+
+    amrex::Print() << " Newton-Krylov: Newton direction from " << k
+                   << " Krylov directions\n";
+
+    Newton_Lambda = 1.;
+    Newton_NumBacktracks = 0;
+    Newton_Stage = s_Newton_Stage::LineSearch;
+}
+
+void c_TransportSolver::Execute_NewtonKrylov_Parallel()
+{
+    const int SSL = site_size_loc_all_NS;
+    const int m = Newton_KrylovDim;
+    auto const comm = ParallelContext::CommunicatorSub();
+
+    bool relative = false;
+    switch (map_NormType[Broyden_Norm_Type])
+    {
+        case s_Norm_Type::Absolute:
+            break;
+        case s_Norm_Type::Relative:
+            relative = true;
+            break;
+        default:
+            amrex::Abort("Norm Type " + Broyden_Norm_Type +
+                         " is not yet defined.");
+    }
+
+#ifndef BROYDEN_SKIP_GPU_OPTIMIZATION
+    /*GMRES runs on the host, its loops are cheap compared with NEGF*/
+    h_n_curr_in_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_n_curr_out_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Norm_data.resize({0}, {SSL}, The_Pinned_Arena());
+
+    auto const &d_n_curr_in = d_n_curr_in_data.const_table();
+    auto const &d_n_curr_out = d_n_curr_out_data.const_table();
+    amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, d_n_curr_in.p,
+                          d_n_curr_in.p + SSL, h_n_curr_in_data.table().p);
+    amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, d_n_curr_out.p,
+                          d_n_curr_out.p + SSL, h_n_curr_out_data.table().p);
+    amrex::Gpu::streamSynchronize();
+#endif
+
+    auto const &n_curr_in = h_n_curr_in_data.table();
+    auto const &n_curr_out = h_n_curr_out_data.const_table();
+    auto const &Norm = h_Norm_data.table();
+    auto const &F = h_Newton_F_data.table();
+
+    /*residual, max norm, and sums of F^2 and Norm^2*/
+    amrex::Real max_norm = 0.;
+    amrex::Real sums[2] = {0., 0.};
+    for (int site = 0; site < SSL; ++site)
+    {
+        F(site) = n_curr_in(site) - n_curr_out(site);
+        Norm(site) =
+            relative ? fabs(F(site) / (n_curr_in(site) + n_curr_out(site)))
+                     : fabs(F(site));
+        max_norm = amrex::max(max_norm, Norm(site));
+        sums[0] += F(site) * F(site);
+        sums[1] += Norm(site) * Norm(site);
+    }
+    ParallelAllReduce::Max(max_norm, comm);
+    ParallelAllReduce::Sum(sums, 2, comm);
+
+    const amrex::Real F_norm = std::sqrt(sums[0]);
+    Broyden_NormSum_Curr = std::sqrt(sums[1]);
+
+    bool new_base = (Newton_Stage == s_Newton_Stage::Base);
+
+    if (Newton_Stage == s_Newton_Stage::Probe)
+    {
+        const int j = Newton_KrylovIter;
+        auto const &F_base = h_Newton_F_base_data.const_table();
+        auto const &V = h_Newton_V_data.table();
+        auto const &Z = h_Newton_Z_data.const_table();
+        auto const &diag_num = h_Newton_diag_num_data.table();
+        auto const &diag_den = h_Newton_diag_den_data.table();
+        auto &H = Newton_Hessenberg;
+
+        /*w = J z_j, stored in column j + 1 of V*/
+        for (int site = 0; site < SSL; ++site)
+        {
+            V(site, j + 1) = (F(site) - F_base(site)) / Newton_Eps;
+            diag_num(site) += V(site, j + 1) * Z(site, j);
+            diag_den(site) += Z(site, j) * Z(site, j);
+        }
+
+        /*classical Gram-Schmidt, twice, with one reduction per pass*/
+        amrex::Vector<amrex::Real> h(j + 1);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (int i = 0; i <= j; ++i) h[i] = 0.;
+            for (int site = 0; site < SSL; ++site)
+            {
+                for (int i = 0; i <= j; ++i)
+                {
+                    h[i] += V(site, i) * V(site, j + 1);
+                }
+            }
+            ParallelAllReduce::Sum(h.data(), j + 1, comm);
+
+            for (int site = 0; site < SSL; ++site)
+            {
+                for (int i = 0; i <= j; ++i)
+                {
+                    V(site, j + 1) -= h[i] * V(site, i);
+                }
+            }
+            for (int i = 0; i <= j; ++i) H[i + (m + 1) * j] += h[i];
+        }
+
+        amrex::Real w_sq = 0.;
+        for (int site = 0; site < SSL; ++site)
+        {
+            w_sq += V(site, j + 1) * V(site, j + 1);
+        }
+        ParallelAllReduce::Sum(w_sq, comm);
+        const amrex::Real h_next = std::sqrt(w_sq);
+        if (h_next > 0.)
+        {
+            for (int site = 0; site < SSL; ++site) V(site, j + 1) /= h_next;
+        }
+
+        /*previous rotations on column j, and the rotation eliminating
+         *H(j+1, j)*/
+        auto &c = Newton_Givens_c;
+        auto &s = Newton_Givens_s;
+        for (int i = 0; i < j; ++i)
+        {
+            const amrex::Real a = H[i + (m + 1) * j];
+            const amrex::Real b = H[i + 1 + (m + 1) * j];
+            H[i + (m + 1) * j] = c[i] * a + s[i] * b;
+            H[i + 1 + (m + 1) * j] = -s[i] * a + c[i] * b;
+        }
+        const amrex::Real a = H[j + (m + 1) * j];
+        const amrex::Real r = std::hypot(a, h_next);
+        c[j] = (r > 0.) ? a / r : 1.;
+        s[j] = (r > 0.) ? h_next / r : 0.;
+        H[j + (m + 1) * j] = r;
+        H[j + 1 + (m + 1) * j] = 0.;
+        Newton_g[j + 1] = -s[j] * Newton_g[j];
+        Newton_g[j] = c[j] * Newton_g[j];
+
+        const amrex::Real lin_res = std::abs(Newton_g[j + 1]);
+        amrex::Print() << "\n Newton-Krylov: Krylov direction " << j
+                       << ", |F|: " << F_norm
+                       << ", relative linear residual: "
+                       << lin_res / Newton_BaseNorm << "\n";
+
+        Broyden_Norm = Newton_BaseMaxNorm;
+
+        if (lin_res <= Newton_Forcing * Newton_BaseNorm or j + 1 == m or
+            h_next <= 1.e-14 * Newton_BaseNorm)
+        {
+            Finish_KrylovSolve();
+        }
+        else
+        {
+            ++Newton_KrylovIter;
+            Probe_KrylovDirection();
+        }
+    }
+    else if (Newton_Stage == s_Newton_Stage::LineSearch)
+    {
+        const bool decreased =
+            F_norm <= (1. - 1.e-4 * Newton_Lambda) * Newton_BaseNorm;
+
+        if (max_norm > Broyden_max_norm and !decreased and
+            Newton_NumBacktracks < Newton_MaxBacktracks)
+        {
+            Newton_Lambda *= 0.5;
+            ++Newton_NumBacktracks;
+            amrex::Print() << "\n Newton-Krylov: |F|: " << F_norm
+                           << " did not decrease from " << Newton_BaseNorm
+                           << ", backtracking to lambda: " << Newton_Lambda
+                           << "\n";
+
+            auto const &n_base = h_Newton_n_base_data.const_table();
+            auto const &delta = h_Newton_delta_data.const_table();
+            for (int site = 0; site < SSL; ++site)
+            {
+                n_curr_in(site) = n_base(site) + Newton_Lambda * delta(site);
+            }
+            Broyden_Norm = max_norm;
+        }
+        else
+        {
+            /*also without a decrease once the backtracks are used up*/
+            new_base = true;
+        }
+    }
+
+    if (new_base)
+    {
+        auto const &n_base = h_Newton_n_base_data.table();
+        auto const &F_base = h_Newton_F_base_data.table();
+        for (int site = 0; site < SSL; ++site)
+        {
+            n_base(site) = n_curr_in(site);
+            F_base(site) = F(site);
+        }
+        Newton_BaseNorm = F_norm;
+        Newton_BaseMaxNorm = max_norm;
+        Broyden_Norm = max_norm;
+
+        amrex::Print() << "\n Broyden_NormSum_Curr: " << std::setw(20)
+                       << Broyden_NormSum_Curr << "\n";
+        amrex::Print() << " Broyden_NormSum_Prev: " << std::setw(20)
+                       << Broyden_NormSum_Prev << ",   Difference: "
+                       << (Broyden_NormSum_Curr - Broyden_NormSum_Prev)
+                       << "\n";
+        amrex::Print() << " Broyden max norm: " << Broyden_Norm << "\n\n";
+
+        Broyden_NormSum_Prev = Broyden_NormSum_Curr;
+
+        /*once converged, n_curr_in stays at the base point*/
+        if (Broyden_Norm > Broyden_max_norm) Start_NewtonKrylovStep();
+    }
+
+#ifndef BROYDEN_SKIP_GPU_OPTIMIZATION
+    d_n_curr_in_data.copy(h_n_curr_in_data);
+    d_Norm_data.copy(h_Norm_data);
+#endif
+
+    Broyden_Step += 1;
+}
+#endif
@@ -7,7 +7,7 @@ void c_TransportSolver::Execute_Simple_Mixing_Algorithm()
 {
     /*update h_RhoInduced_glo*/
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         amrex::Print() << "\nBroydenStep: " << Broyden_Step
                        << ",  fraction: " << Broyden_fraction
@@ -98,7 +98,7 @@ void c_TransportSolver::Execute_Simple_Mixing_Algorithm()
     }
 
     MPI_Bcast(&Broyden_Norm, 1, MPI_DOUBLE,
-              ParallelDescriptor::IOProcessorNumber(),
-              ParallelDescriptor::Communicator());
+              ParallelContext::IOProcessorNumberSub(),
+              ParallelContext::CommunicatorSub());
 }
 #endif
@@ -27,7 +27,9 @@ enum class s_Algorithm_Type : int
 {
     broyden_first,
     broyden_second,
-    simple_mixing
+    simple_mixing,
+    anderson,
+    newton_krylov
 };
 enum class Gate_Terminal_Type : int
 {
@@ -51,6 +53,11 @@ const std::map<std::string, s_Algorithm_Type>
         {"broyden_second", s_Algorithm_Type::broyden_second},
         {"Broyden_second", s_Algorithm_Type::broyden_second},
         {"simple_mixing", s_Algorithm_Type::simple_mixing},
+        {"anderson", s_Algorithm_Type::anderson},
+        {"Anderson", s_Algorithm_Type::anderson},
+        {"newton_krylov", s_Algorithm_Type::newton_krylov},
+        {"Newton_Krylov", s_Algorithm_Type::newton_krylov},
+        {"jfnk", s_Algorithm_Type::newton_krylov},
 };
 
 const std::map<std::string, Gate_Terminal_Type>
@@ -64,6 +71,10 @@ c_TransportSolver::c_TransportSolver() { ReadData(); }
 
 void c_TransportSolver::Cleanup()
 {
+    for (auto &NS_var : vp_NS)
+    {
+        std::visit([](auto &NS) { NS->Cleanup(); }, NS_var);
+    }
 #ifdef BROYDEN_PARALLEL
     Free_MPIDerivedDataTypes();
 #endif
@@ -187,18 +198,32 @@ void c_TransportSolver::InitData()
     }
     num_field_sites_all_NS = Instantiate_Materials();
 
+    if (use_negf) Initialize_NEGF_OfAllNS();
+
     if (rCode.use_electrostatic) Sum_ChargeDepositedByAllNS();
 
     Set_Broyden_Parallel();
+
+    if (rCode.use_electrostatic and flag_predictor_corrector_poisson)
+    {
+        Set_PredictorCorrectorPoisson();
+    }
+    if (rCode.use_electrostatic and flag_site_response_matrix)
+    {
+        Set_SiteResponseMatrix();
+    }
 }
 
 void c_TransportSolver::Read_ControlFlags(amrex::ParmParse &pp)
 {
     pp.query("use_selfconsistent_potential", use_selfconsistent_potential);
     pp.query("use_negf", use_negf);
+    pp.query("flag_concurrent_nanostructures", flag_concurrent_nanostructures);
     amrex::Print() << "##### transport.use_selfconsistent_potential: "
                    << use_selfconsistent_potential << "\n";
     amrex::Print() << "##### transport.use_negf: " << use_negf << "\n";
+    amrex::Print() << "##### transport.flag_concurrent_nanostructures: "
+                   << flag_concurrent_nanostructures << "\n";
 }
 
 void c_TransportSolver::Set_NEGFFolderDirectories()
@@ -273,15 +298,108 @@ void c_TransportSolver::Read_SelfConsistencyInput(amrex::ParmParse &pp)
     amrex::Print() << "##### Broyden_Threshold_MaxStep: "
                    << Broyden_Threshold_MaxStep << "\n";
 
+    /*Limited-memory Broyden: only the last Broyden_history_window updates
+     *are kept, VmatTran and Wmat are allocated with that many columns and
+     *the number of iterations is not limited.*/
+    pp.query("Broyden_history_window", Broyden_HistoryWindow);
+    amrex::Print() << "##### Broyden_history_window: "
+                   << Broyden_HistoryWindow << "\n";
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        Broyden_HistoryWindow >= 0,
+        "transport.Broyden_history_window must be non-negative.");
+    if (Broyden_HistoryWindow > 0)
+    {
+        Broyden_Threshold_MaxStep = Broyden_HistoryWindow + 1;
+        amrex::Print() << "#####* Broyden_Threshold_MaxStep is set to "
+                       << Broyden_Threshold_MaxStep
+                       << " and no longer limits the iterations.\n";
+    }
+
+    pp.query("Broyden_warm_start_columns", Broyden_WarmStart_MaxColumns);
+    amrex::Print() << "##### Broyden_warm_start_columns: "
+                   << Broyden_WarmStart_MaxColumns << "\n";
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        Broyden_WarmStart_MaxColumns >= 0 and
+            Broyden_WarmStart_MaxColumns < Broyden_Threshold_MaxStep - 1,
+        "transport.Broyden_warm_start_columns must be smaller than "
+        "Broyden_threshold_maxstep - 1.");
+
+    queryWithParser(pp, "Broyden_warm_start_decay", Broyden_WarmStart_Decay);
+    amrex::Print() << "##### Broyden_warm_start_decay: "
+                   << Broyden_WarmStart_Decay << "\n";
+
     pp.query("selfconsistency_algorithm", Algorithm_Type);
     amrex::Print() << "##### selfconsistency_algorithm: " << Algorithm_Type
                    << "\n";
 
+    pp.query("Anderson_history", Anderson_History);
+    amrex::Print() << "##### Anderson_history: " << Anderson_History << "\n";
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        Anderson_History >= 1,
+        "transport.Anderson_history must be at least 1.");
+
+    /*Jacobian-free Newton-Krylov, see Execute_NewtonKrylov_Parallel*/
+    pp.query("Newton_krylov_dim", Newton_KrylovDim);
+    amrex::Print() << "##### Newton_krylov_dim: " << Newton_KrylovDim << "\n";
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        Newton_KrylovDim >= 1,
+        "transport.Newton_krylov_dim must be at least 1.");
+
+    queryWithParser(pp, "Newton_forcing", Newton_Forcing);
+    amrex::Print() << "##### Newton_forcing: " << Newton_Forcing << "\n";
+
+    queryWithParser(pp, "Newton_fd_epsilon", Newton_FDEpsilon);
+    amrex::Print() << "##### Newton_fd_epsilon: " << Newton_FDEpsilon << "\n";
+
+    pp.query("Newton_max_backtracks", Newton_MaxBacktracks);
+    amrex::Print() << "##### Newton_max_backtracks: " << Newton_MaxBacktracks
+                   << "\n";
+
     pp.query("reset_with_previous_charge_distribution",
              flag_reset_with_previous_charge_distribution);
     amrex::Print() << "##### reset_with_previous_charge_distribution: "
                    << flag_reset_with_previous_charge_distribution << "\n";
 
+    pp.query("bias_continuation_order", bias_continuation_order);
+    amrex::Print() << "##### bias_continuation_order: "
+                   << bias_continuation_order << "\n";
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        bias_continuation_order >= 0 and
+            bias_continuation_order < max_continuation_points,
+        "transport.bias_continuation_order must be 0 (off), 1 (linear) or "
+        "2 (quadratic).");
+
+    /*Poisson with the charge linearized by the quantum capacitance of the
+     *sites, see Update_QuantumCapacitance*/
+    pp.query("predictor_corrector_poisson", flag_predictor_corrector_poisson);
+    amrex::Print() << "##### predictor_corrector_poisson: "
+                   << flag_predictor_corrector_poisson << "\n";
+
+    /*Potential at the sites from a precomputed response matrix instead of
+     *a Poisson solve in each iteration, see Build_SiteResponseMatrix*/
+    pp.query("use_site_response_matrix", flag_site_response_matrix);
+    amrex::Print() << "##### use_site_response_matrix: "
+                   << flag_site_response_matrix << "\n";
+
+    pp.query("site_response_max_sites", site_response_max_sites);
+    amrex::Print() << "##### site_response_max_sites: "
+                   << site_response_max_sites << "\n";
+
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        !(flag_site_response_matrix and flag_predictor_corrector_poisson),
+        "transport.use_site_response_matrix and "
+        "transport.predictor_corrector_poisson cannot be used together.");
+
+    /*phi_prev and C_q change with each NEGF evaluation, which the finite
+     *differences of Newton-Krylov would take for a change of the residual*/
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        !(flag_predictor_corrector_poisson and
+          map_AlgorithmType.count(Algorithm_Type) and
+          map_AlgorithmType.at(Algorithm_Type) ==
+              s_Algorithm_Type::newton_krylov),
+        "transport.predictor_corrector_poisson cannot be used with the "
+        "newton_krylov self-consistency algorithm.");
+
     flag_initialize_inverse_jacobian = 0;
     pp.query("initialize_inverse_jacobian", flag_initialize_inverse_jacobian);
     amrex::Print() << "##### flag_initialize_inverse_jacobian: "
@@ -362,6 +480,59 @@ std::string c_TransportSolver::Get_NS_type_str(const std::string &name)
                                           : map_NSNameToTypeStr.at(name);
 }
 
+int c_TransportSolver::Get_CNT_NumModes(const std::string &name)
+{
+    /*num_modes of CNT_default, overridden by that of the nanostructure*/
+    int num_modes = 1;
+    amrex::ParmParse pp_ns_default("CNT_default");
+    queryWithParser(pp_ns_default, "num_modes", num_modes);
+    amrex::ParmParse pp_ns(name);
+    queryWithParser(pp_ns, "num_modes", num_modes);
+
+    amrex::Print() << "##### num_modes: " << num_modes << "\n";
+
+    return num_modes;
+}
+
+template <int N>
+void c_TransportSolver::Instantiate_CNT(const std::string &name,
+                                        const int NS_id_counter,
+                                        const int NS_field_sites_offset)
+{
+    using T = c_CNT<N>;
+    vp_NS.push_back(std::make_unique<c_Nanostructure<T>>(
+        *_geom, *_dm, *_ba, name, NS_id_counter, NS_gather_field_str,
+        NS_deposit_field_str, NS_initial_deposit_value, use_negf,
+        negf_foldername_str, NS_field_sites_offset));
+}
+
+int c_TransportSolver::Get_Graphene_NumDimerLines(const std::string &name)
+{
+    /*num_dimer_lines of Graphene_default, overridden by that of the
+     *nanostructure*/
+    int num_dimer_lines = 0;
+    amrex::ParmParse pp_ns_default("Graphene_default");
+    queryWithParser(pp_ns_default, "num_dimer_lines", num_dimer_lines);
+    amrex::ParmParse pp_ns(name);
+    queryWithParser(pp_ns, "num_dimer_lines", num_dimer_lines);
+
+    amrex::Print() << "##### num_dimer_lines: " << num_dimer_lines << "\n";
+
+    return num_dimer_lines;
+}
+
+template <int W>
+void c_TransportSolver::Instantiate_Graphene(const std::string &name,
+                                             const int NS_id_counter,
+                                             const int NS_field_sites_offset)
+{
+    using T = c_Graphene<W>;
+    vp_NS.push_back(std::make_unique<c_Nanostructure<T>>(
+        *_geom, *_dm, *_ba, name, NS_id_counter, NS_gather_field_str,
+        NS_deposit_field_str, NS_initial_deposit_value, use_negf,
+        negf_foldername_str, NS_field_sites_offset));
+}
+
 int c_TransportSolver::Instantiate_Materials()
 {
     amrex::Vector<int> NS_field_sites_cumulative(1, 0);
@@ -371,32 +542,60 @@ int c_TransportSolver::Instantiate_Materials()
     {
         amrex::Print() << "##### Instantiating material: " << name << "\n";
 
-        int field_sites = 0;
         int NS_field_sites_offset = NS_field_sites_cumulative.back();
         switch (c_TransportSolver::map_NSType_enum.at(Get_NS_type_str(name)))
         {
             case s_NS_Type::CNT:
             {
-                using T = c_CNT;
-                vp_CNT.push_back(std::make_unique<c_Nanostructure<T>>(
-                    *_geom, *_dm, *_ba, name, NS_id_counter,
-                    NS_gather_field_str, NS_deposit_field_str,
-                    NS_initial_deposit_value, use_negf, negf_foldername_str,
-                    NS_field_sites_offset));
-                field_sites = vp_CNT.back()->get_num_field_sites();
+                int num_modes = Get_CNT_NumModes(name);
+                switch (num_modes)
+                {
+#define CASE_INSTANTIATE_CNT(N)                                          \
+    case N:                                                              \
+        Instantiate_CNT<N>(name, NS_id_counter, NS_field_sites_offset); \
+        break;
+                    CNT_FOR_EACH_NUM_MODES(CASE_INSTANTIATE_CNT)
+#undef CASE_INSTANTIATE_CNT
+                    default:
+                    {
+                        std::string supported_str;
+                        for (int n : {CNT_NUM_MODES_LIST})
+                        {
+                            supported_str += " " + std::to_string(n);
+                        }
+                        amrex::Abort("num_modes = " +
+                                     std::to_string(num_modes) +
+                                     " is not supported for CNT " + name +
+                                     ". Supported values:" + supported_str);
+                    }
+                }
                 break;
             }
             case s_NS_Type::Graphene:
             {
-                using T = c_Graphene;
-
-                vp_Graphene.push_back(std::make_unique<c_Nanostructure<T>>(
-                    *_geom, *_dm, *_ba, name, NS_id_counter,
-                    NS_gather_field_str, NS_deposit_field_str,
-                    NS_initial_deposit_value, use_negf, negf_foldername_str,
-                    NS_field_sites_offset));
-                field_sites = vp_Graphene.back()->get_num_field_sites();
-                amrex::Abort("NS_type graphene is not yet defined.");
+                int num_dimer_lines = Get_Graphene_NumDimerLines(name);
+                switch (num_dimer_lines)
+                {
+#define CASE_INSTANTIATE_GRAPHENE(W)                                          \
+    case 2 * W:                                                               \
+        Instantiate_Graphene<W>(name, NS_id_counter, NS_field_sites_offset); \
+        break;
+                    GRAPHENE_FOR_EACH_WIDTH(CASE_INSTANTIATE_GRAPHENE)
+#undef CASE_INSTANTIATE_GRAPHENE
+                    default:
+                    {
+                        std::string supported_str;
+                        for (int w : {GRAPHENE_WIDTH_LIST})
+                        {
+                            supported_str += " " + std::to_string(2 * w);
+                        }
+                        amrex::Abort("num_dimer_lines = " +
+                                     std::to_string(num_dimer_lines) +
+                                     " is not supported for graphene " +
+                                     name + ". Supported values:" +
+                                     supported_str);
+                    }
+                }
                 break;
             }
             case s_NS_Type::Silicon:
@@ -409,6 +608,8 @@ int c_TransportSolver::Instantiate_Materials()
                              " is not supported.");
             }
         }
+        int field_sites = std::visit(
+            [](auto &NS) { return NS->get_num_field_sites(); }, vp_NS.back());
         int cumulative_sites = NS_field_sites_cumulative.back() + field_sites;
         NS_field_sites_cumulative.push_back(cumulative_sites);
 
@@ -424,6 +625,105 @@ int c_TransportSolver::Instantiate_Materials()
     return NS_field_sites_cumulative.back();
 }
 
+void c_TransportSolver::Define_ProcessRangesOfNS(
+    amrex::Vector<int> &rank_begin, amrex::Vector<int> &nproc)
+{
+    /*Without flag_concurrent_nanostructures, or with too few processes,
+     *every nanostructure is solved by all processes, one after the other.
+     *Otherwise each nanostructure gets its own consecutive range of
+     *processes, a multiple of its num_energy_groups. Starting from one
+     *process per energy group, the remaining processes are handed out one
+     *set of num_energy_groups at a time to the nanostructure with the most
+     *block columns per process, since the cost of the recursive Green's
+     *function algorithm is proportional to Hsize.*/
+    const int num_NS = vp_NS.size();
+    const int num_proc = amrex::ParallelContext::NProcsSub();
+    rank_begin.assign(num_NS, 0);
+    nproc.assign(num_NS, num_proc);
+
+    if (!flag_concurrent_nanostructures or num_NS < 2) return;
+
+    amrex::Vector<int> Hsize(num_NS);
+    amrex::Vector<int> num_groups(num_NS);
+    int num_proc_required = 0;
+    for (int c = 0; c < num_NS; ++c)
+    {
+        std::visit(
+            [&](auto &NS)
+            {
+                Hsize[c] = NS->get_Hsize_glo();
+                num_groups[c] = NS->get_num_energy_groups();
+            },
+            vp_NS[c]);
+        num_proc_required += num_groups[c];
+    }
+
+    if (num_proc_required > num_proc)
+    {
+        amrex::Print() << "##### Warning: " << num_proc
+                       << " processes are too few for solving the "
+                       << num_NS << " nanostructures concurrently, "
+                       << num_proc_required
+                       << " are required. Solving them one after the other.\n";
+        return;
+    }
+
+    for (int c = 0; c < num_NS; ++c) nproc[c] = num_groups[c];
+    int num_proc_left = num_proc - num_proc_required;
+
+    while (true)
+    {
+        int c_max = -1;
+        amrex::Real max_load = 0.;
+        for (int c = 0; c < num_NS; ++c)
+        {
+            int nproc_per_group = nproc[c] / num_groups[c];
+            if (num_groups[c] > num_proc_left or nproc_per_group >= Hsize[c])
+                continue;
+
+            amrex::Real load = static_cast<amrex::Real>(Hsize[c]) /
+                               static_cast<amrex::Real>(nproc_per_group);
+            if (load > max_load)
+            {
+                max_load = load;
+                c_max = c;
+            }
+        }
+        if (c_max < 0) break;
+
+        nproc[c_max] += num_groups[c_max];
+        num_proc_left -= num_groups[c_max];
+    }
+
+    for (int c = 1; c < num_NS; ++c)
+    {
+        rank_begin[c] = rank_begin[c - 1] + nproc[c - 1];
+    }
+}
+
+void c_TransportSolver::Initialize_NEGF_OfAllNS()
+{
+    /*All processes take part in the initialization of every nanostructure,
+     *the NEGF solvers of which are then called by its own processes only.*/
+    amrex::Vector<int> rank_begin;
+    amrex::Vector<int> nproc;
+    Define_ProcessRangesOfNS(rank_begin, nproc);
+
+    auto &rCode = c_Code::GetInstance();
+
+    for (int c = 0; c < vp_NS.size(); ++c)
+    {
+        std::visit(
+            [&](auto &NS)
+            {
+                NS->Set_ProcessRange(rank_begin[c], nproc[c]);
+                NS->Initialize_NEGF(negf_foldername_str + "/transport_common",
+                                    rCode.use_electrostatic);
+            },
+            vp_NS[c]);
+    }
+}
+
 void c_TransportSolver::Sum_ChargeDepositedByAllNS()
 {
     auto &rCode = c_Code::GetInstance();
@@ -459,10 +759,15 @@ void c_TransportSolver::Solve(const int step, const amrex::Real time)
     total_intg_pts_in_all_iter = 0;
     m_step = step;
 
-    for (int c = 0; c < vp_CNT.size(); ++c)
+    for (auto &NS_var : vp_NS)
     {
-        vp_CNT[c]->Set_StepFilenameString(step);
-        Set_CommonStepFolder(step);
+        std::visit(
+            [&](auto &NS)
+            {
+                NS->Set_StepFilenameString(step);
+                Set_CommonStepFolder(step);
+            },
+            NS_var);
     }
 
     amrex::Real time_counter[7] = {0., 0., 0., 0., 0., 0., 0.};
@@ -472,12 +777,21 @@ void c_TransportSolver::Solve(const int step, const amrex::Real time)
     {
         BL_PROFILE_VAR("Part1_to_6_sum", part1_to_6_sum_counter);
 
+        /*only broyden_second stores a column per step, up to
+         *Broyden_Threshold_MaxStep unless the history window rolls over*/
+        const bool limit_broyden_steps =
+            map_AlgorithmType.at(Algorithm_Type) ==
+                s_Algorithm_Type::broyden_second and
+            Broyden_HistoryWindow == 0;
+
         bool update_surface_soln_flag = true;
         do
         {
             amrex::Print() << "\n\n##### Self-Consistent Iteration: "
                            << max_iter << " #####\n";
-            if (Broyden_Step > Broyden_Threshold_MaxStep)
+            if (limit_broyden_steps and
+                Broyden_Step + Broyden_NumCarriedColumns >
+                    Broyden_Threshold_MaxStep)
             {
                 amrex::Abort(
                     "Broyden_Step has exceeded the Broyden_Threshold_MaxStep!");
@@ -486,49 +800,120 @@ void c_TransportSolver::Solve(const int step, const amrex::Real time)
             // Part 1: Electrostatics
             time_counter[0] = amrex::second();
 
-            rMprop.ReInitializeMacroparam(NS_gather_field_str);
-            rMLMG.UpdateBoundaryConditions(update_surface_soln_flag);
+            /*Within a bias step, the response matrix gives the potential at
+             *the sites and neither Poisson nor the gather are needed*/
+            const bool use_site_response =
+                flag_site_response_matrix and !update_surface_soln_flag;
 
-            auto mlmg_solve_time = rMLMG.Solve_PoissonEqn();
+            if (!use_site_response)
+            {
+                rMprop.ReInitializeMacroparam(NS_gather_field_str);
+                rMLMG.UpdateBoundaryConditions(update_surface_soln_flag);
 
-            rPostPro.Compute();
-            // rOutput.WriteOutput(max_iter+100, time);
+                bool input_charge_deposited = false;
+                if (update_surface_soln_flag and bias_continuation_order > 0)
+                {
+                    input_charge_deposited =
+                        Predict_ChargeFromBiasContinuation();
+                }
+                /*n_base of the response matrix is taken from n_curr_in,
+                 *which Reset_Broyden_Parallel may have reset after the
+                 *last deposit, so the mesh has to carry n_curr_in*/
+                if (flag_site_response_matrix and !input_charge_deposited)
+                {
+                    Deposit_InputChargeToMesh();
+                }
 
-            time_counter[1] = amrex::second();
+                /*From the second iteration on, the charge of the sites is
+                 *linearized around the potential of the last NEGF
+                 *evaluation*/
+                amrex::Real mlmg_solve_time = 0.;
+                if (flag_predictor_corrector_poisson and flag_Cq_available and
+                    max_iter > 0)
+                {
+                    mlmg_solve_time = rMLMG.Solve_LinearizedPoissonEqn(
+                        Cq_kappa_mf, Cq_phi_prev_mf);
+                }
+                else
+                {
+                    mlmg_solve_time = rMLMG.Solve_PoissonEqn();
+                }
+                if (flag_predictor_corrector_poisson)
+                {
+                    amrex::MultiFab::Copy(Cq_phi_prev_mf, *rMLMG.soln, 0, 0,
+                                          1, 0);
+                }
 
-            // Part 2: Gather
-            for (int c = 0; c < vp_CNT.size(); ++c)
-            {
-                if (vp_CNT[c]->get_flag_write_at_iter())
+                if (flag_site_response_matrix)
                 {
-                    vp_CNT[c]->Set_IterationFilenameString(max_iter);
+                    if (!flag_SR_available) Build_SiteResponseMatrix();
+                    Store_SiteResponseBase();
                 }
 
-                vp_CNT[c]->Gather_MeshAttributeAtAtoms();
+                rPostPro.Compute();
+                // rOutput.WriteOutput(max_iter+100, time);
+            }
+
+            time_counter[1] = amrex::second();
+
+            // Part 2: Gather
+            if (use_site_response) Apply_SiteResponseMatrix();
+
+            for (auto &NS_var : vp_NS)
+            {
+                std::visit(
+                    [&](auto &NS)
+                    {
+                        if (NS->get_flag_write_at_iter())
+                        {
+                            NS->Set_IterationFilenameString(max_iter);
+                        }
+
+                        if (!use_site_response)
+                        {
+                            NS->Gather_MeshAttributeAtAtoms();
+                        }
+                    },
+                    NS_var);
             }
             time_counter[2] = amrex::second();
 
             // Part 3: NEGF
             int total_intg_pts_in_this_iter = 0;
-            for (int c = 0; c < vp_CNT.size(); ++c)
+            for (auto &NS_var : vp_NS)
             {
-                if (update_surface_soln_flag)
-                {
-                    Set_TerminalBiasesAndContactPotential(vp_CNT[c]);
-                }
-                amrex::Print()
-                    << " Vds: " << Vds << " V, Vgs: " << Vgs << " V\n";
-
+                std::visit(
+                    [&](auto &NS)
+                    {
+                        if (update_surface_soln_flag)
+                        {
+                            Set_TerminalBiasesAndContactPotential(NS);
+                        }
+                        amrex::Print()
+                            << " Vds: " << Vds << " V, Vgs: " << Vgs << " V\n";
+
+                        if (!NS->is_NS_member()) return;
 #ifdef AMREX_USE_GPU
-                vp_CNT[c]->Solve_NEGF(d_n_curr_out_data, max_iter);
+                        NS->Solve_NEGF(d_n_curr_out_data, max_iter);
 #else
-                vp_CNT[c]->Solve_NEGF(h_n_curr_out_data, max_iter);
+                        NS->Solve_NEGF(h_n_curr_out_data, max_iter);
 #endif
-                total_intg_pts_in_this_iter +=
-                    vp_CNT[c]->get_Total_Integration_Pts();
-                // CopyFromNS_ChargeComputedFromNEGF(vp_CNT[c]);
+                        if (NS->is_NS_root())
+                        {
+                            total_intg_pts_in_this_iter +=
+                                NS->get_Total_Integration_Pts();
+                        }
+                        // CopyFromNS_ChargeComputedFromNEGF(NS);
+                    },
+                    NS_var);
             }
+            /*sums the points of nanostructures solved on other processes*/
+            ParallelAllReduce::Sum(total_intg_pts_in_this_iter,
+                                   ParallelContext::CommunicatorSub());
             total_intg_pts_in_all_iter += total_intg_pts_in_this_iter;
+
+            if (flag_predictor_corrector_poisson) Update_QuantumCapacitance();
+
             time_counter[3] = amrex::second();
 
             // Part 4: Self-consistency
@@ -537,54 +922,74 @@ void c_TransportSolver::Solve(const int step, const amrex::Real time)
             time_counter[4] = amrex::second();
 
             // Part 5: Deposit
+            if (flag_predictor_corrector_poisson and flag_Cq_available)
+            {
+                Deposit_QuantumCapacitanceToMesh();
+            }
             rMprop.ReInitializeMacroparam(NS_deposit_field_str);
             rMprop.Deposit_AllExternalChargeDensitySources();
 
-            for (int c = 0; c < vp_CNT.size(); ++c)
+            for (auto &NS_var : vp_NS)
             {
-                CopyToNS_ChargeComputedUsingSelfConsistencyAlgorithm(vp_CNT[c]);
-
-                vp_CNT[c]->Deposit_AtomAttributeToMesh();
-
-                if (vp_CNT[c]->get_flag_write_at_iter())
-                {
-                    vp_CNT[c]->Write_InputInducedCharge(
-                        vp_CNT[c]->get_iter_filename(), n_curr_in_glo_data);
-                }
-                if (ParallelDescriptor::IOProcessor())
-                {
-                    n_curr_in_glo_data.clear();
-                }
+                std::visit(
+                    [&](auto &NS)
+                    {
+                        CopyToNS_ChargeComputedUsingSelfConsistencyAlgorithm(
+                            NS);
+
+                        NS->Deposit_AtomAttributeToMesh();
+
+                        if (NS->get_flag_write_at_iter())
+                        {
+                            NS->Write_InputInducedCharge(
+                                NS->get_iter_filename(), n_curr_in_glo_data);
+                        }
+                        if (ParallelContext::IOProcessorSub())
+                        {
+                            n_curr_in_glo_data.clear();
+                        }
+                    },
+                    NS_var);
             }
             Sum_ChargeDepositedByAllNS();
 
             time_counter[5] = amrex::second();
 
             // Part 6: Write data
-            for (int c = 0; c < vp_CNT.size(); ++c)
+            for (auto &NS_var : vp_NS)
             {
-                if (vp_CNT[c]->get_flag_write_at_iter())
-                {
-                    bool compute_current = false;
-                    Write_MoreDataAndComputeCurrent(
-                        vp_CNT[c], vp_CNT[c]->get_iter_filename(),
-                        compute_current);
-                }
-
-                if (flag_write_LDOS_iter and
-                    (max_iter + 1) % write_LDOS_iter_period == 0)
-                {
-                    std::string iter_dos_foldername_str =
-                        amrex::Concatenate(vp_CNT[c]->get_iter_foldername() +
-                                               "/DOS_iter",
-                                           max_iter, negf_plt_name_digits);
-
-                    CreateDirectory(iter_dos_foldername_str);
-                    // e.g.: /negf/cnt/step0001_iter/LDOS_iter0002/
-
-                    vp_CNT[c]->Compute_DensityOfStates(iter_dos_foldername_str,
-                                                       flag_write_LDOS_iter);
-                }
+                std::visit(
+                    [&](auto &NS)
+                    {
+                        if (NS->get_flag_write_at_iter())
+                        {
+                            bool compute_current = false;
+                            Write_MoreDataAndComputeCurrent(
+                                NS, NS->get_iter_filename(), compute_current);
+                        }
+
+                        if (flag_write_LDOS_iter and
+                            (max_iter + 1) % write_LDOS_iter_period == 0)
+                        {
+                            std::string iter_dos_foldername_str =
+                                amrex::Concatenate(
+                                    NS->get_iter_foldername() + "/DOS_iter",
+                                    max_iter, negf_plt_name_digits);
+
+                            CreateDirectory(iter_dos_foldername_str);
+                            ParallelDescriptor::Barrier(
+                                ParallelContext::CommunicatorSub());
+                            // e.g.: /negf/cnt/step0001_iter/LDOS_iter0002/
+
+                            if (NS->is_NS_member())
+                            {
+                                NS->Compute_DensityOfStates(
+                                    iter_dos_foldername_str,
+                                    flag_write_LDOS_iter);
+                            }
+                        }
+                    },
+                    NS_var);
             }
             time_counter[6] = amrex::second();
 
@@ -624,6 +1029,14 @@ void c_TransportSolver::Solve(const int step, const amrex::Real time)
 
         BL_PROFILE_VAR_STOP(part1_to_6_sum_counter);
 
+        if (flag_site_response_matrix and max_iter > 1)
+        {
+            /*the fields on the mesh are those of the first iteration, they
+             *are solved once for the charge deposited last*/
+            rMLMG.Solve_PoissonEqn();
+            rPostPro.Compute();
+        }
+
         Obtain_maximum_time(total_time_counter_diff);
 
         /* LDOS computation is before current computation because
@@ -632,29 +1045,47 @@ void c_TransportSolver::Solve(const int step, const amrex::Real time)
          * after current computation.*/
         if (flag_compute_DOS)
         {
-            for (int c = 0; c < vp_CNT.size(); ++c)
+            for (auto &NS_var : vp_NS)
             {
-                std::string dos_step_foldername_str =
-                    amrex::Concatenate(vp_CNT[c]->get_step_foldername() +
-                                           "/DOS_step",
-                                       step, negf_plt_name_digits);
-
-                CreateDirectory(dos_step_foldername_str);
-                // e.g.: /negf/cnt/DOS_step0001/
-
-                vp_CNT[c]->Compute_DensityOfStates(dos_step_foldername_str,
-                                                   flag_write_LDOS);
+                std::visit(
+                    [&](auto &NS)
+                    {
+                        std::string dos_step_foldername_str =
+                            amrex::Concatenate(NS->get_step_foldername() +
+                                                   "/DOS_step",
+                                               step, negf_plt_name_digits);
+
+                        CreateDirectory(dos_step_foldername_str);
+                        ParallelDescriptor::Barrier(
+                            ParallelContext::CommunicatorSub());
+                        // e.g.: /negf/cnt/DOS_step0001/
+
+                        if (NS->is_NS_member())
+                        {
+                            NS->Compute_DensityOfStates(
+                                dos_step_foldername_str, flag_write_LDOS);
+                        }
+                    },
+                    NS_var);
             }
         }
 
         // Part 7: current computation & writing data
+        /* With flag_fuse_current_with_charge, the NEGF pass of the last
+         * iteration, i.e. the one for which Broyden_Norm dropped below
+         * Broyden_max_norm, already accumulated current and transmission,
+         * and Compute_Current only reduces them.*/
         amrex::Real time_for_current = amrex::second();
-        for (int c = 0; c < vp_CNT.size(); ++c)
+        for (auto &NS_var : vp_NS)
         {
-            bool compute_current = true;
-            Write_MoreDataAndComputeCurrent(vp_CNT[c],
-                                            vp_CNT[c]->get_step_filename(),
-                                            compute_current);
+            std::visit(
+                [&](auto &NS)
+                {
+                    bool compute_current = true;
+                    Write_MoreDataAndComputeCurrent(
+                        NS, NS->get_step_filename(), compute_current);
+                },
+                NS_var);
         }
 
         amrex::Print() << "Time for current computation & writing data:   "
@@ -665,17 +1096,21 @@ void c_TransportSolver::Solve(const int step, const amrex::Real time)
     }  // if use electrostatics
     else
     {
-        for (int c = 0; c < vp_CNT.size(); ++c)
+        for (auto &NS_var : vp_NS)
         {
-            RealTable1D RhoInduced; /*this is not correct but added just so
-                                       Solve_NEGF compiles*/
-            vp_CNT[c]->Solve_NEGF(RhoInduced, 0);
+            std::visit(
+                [&](auto &NS)
+                {
+                    RealTable1D RhoInduced; /*this is not correct but added
+                                               just so Solve_NEGF compiles*/
+                    if (NS->is_NS_member()) NS->Solve_NEGF(RhoInduced, 0);
 
-            bool compute_current = true;
+                    bool compute_current = true;
 
-            Write_MoreDataAndComputeCurrent(vp_CNT[c],
-                                            vp_CNT[c]->get_step_filename(),
-                                            compute_current);
+                    Write_MoreDataAndComputeCurrent(
+                        NS, NS->get_step_filename(), compute_current);
+                },
+                NS_var);
         }
     }
 }
@@ -774,7 +1209,7 @@ void c_TransportSolver::CopyToNS_ChargeComputedUsingSelfConsistencyAlgorithm(
     amrex::Gpu::streamSynchronize();
 #endif
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         const int Hsize = NS->get_num_field_sites();
         n_curr_in_glo_data.resize({0}, {Hsize}, The_Pinned_Arena());
@@ -785,8 +1220,8 @@ void c_TransportSolver::CopyToNS_ChargeComputedUsingSelfConsistencyAlgorithm(
     MPI_Gatherv(&h_n_curr_in(0), NS->MPI_recv_count[my_rank], MPI_DOUBLE,
                 &n_curr_in_glo(0), NS->MPI_recv_count.data(),
                 NS->MPI_recv_disp.data(), MPI_DOUBLE,
-                ParallelDescriptor::IOProcessorNumber(),
-                ParallelDescriptor::Communicator());
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
 
     // amrex::Print() << "n_curr_in_glo in CopyToNS: \n";
     // if (ParallelDescriptor::IOProcessor())
@@ -798,6 +1233,31 @@ void c_TransportSolver::CopyToNS_ChargeComputedUsingSelfConsistencyAlgorithm(
     NS->Scatterv_BroydenComputed_GlobalCharge(n_curr_in_glo_data);
 }
 
+template <typename NSType>
+void c_TransportSolver::CopyToNS_SiteValues(NSType const &NS,
+                                            RealTable1D const &h_values_data)
+{
+    /*as CopyToNS_ChargeComputedUsingSelfConsistencyAlgorithm, for values on
+     *the host in the partition of n_curr_in*/
+    const int begin = site_size_loc_cumulative[NS->get_NS_Id()];
+    auto const &h_values = h_values_data.const_table();
+
+    if (ParallelContext::IOProcessorSub())
+    {
+        const int Hsize = NS->get_num_field_sites();
+        n_curr_in_glo_data.resize({0}, {Hsize}, The_Pinned_Arena());
+    }
+    auto const &n_curr_in_glo = n_curr_in_glo_data.table();
+
+    MPI_Gatherv(h_values.p + begin, NS->MPI_recv_count[my_rank], MPI_DOUBLE,
+                n_curr_in_glo.p, NS->MPI_recv_count.data(),
+                NS->MPI_recv_disp.data(), MPI_DOUBLE,
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
+
+    NS->Scatterv_BroydenComputed_GlobalCharge(n_curr_in_glo_data);
+}
+
 template <typename NSType>
 void c_TransportSolver::Write_MoreDataAndComputeCurrent(
     NSType const &NS, std::string const &write_filename,
@@ -809,13 +1269,13 @@ void c_TransportSolver::Write_MoreDataAndComputeCurrent(
     Create_Global_Output_Data(NS);
     NS->Write_Data(write_filename, n_curr_out_glo_data, Norm_glo_data);
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         n_curr_out_glo_data.clear();
         Norm_glo_data.clear();
     }
 
-    if (compute_current_flag)
+    if (compute_current_flag and NS->is_NS_member())
     {
         NS->Compute_Current();
         NS->Write_Current(m_step, Vds, Vgs, total_intg_pts_in_all_iter,
@@ -860,7 +1320,7 @@ void c_TransportSolver::Create_Global_Output_Data(NSType const &NS)
     amrex::Print() << "h_Norm(0): " << h_Norm(0) << "\n";
 #endif
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         const int Hsize = NS->get_num_field_sites();
         n_curr_out_glo_data.resize({0}, {Hsize}, The_Pinned_Arena());
@@ -874,15 +1334,15 @@ void c_TransportSolver::Create_Global_Output_Data(NSType const &NS)
     MPI_Gatherv(&h_n_curr_out(0), NS->MPI_recv_count[my_rank], MPI_DOUBLE,
                 &n_curr_out_glo(0), NS->MPI_recv_count.data(),
                 NS->MPI_recv_disp.data(), MPI_DOUBLE,
-                ParallelDescriptor::IOProcessorNumber(),
-                ParallelDescriptor::Communicator());
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
 
     /*offset necessary for multiple NS*/
     MPI_Gatherv(&h_Norm(0), NS->MPI_recv_count[my_rank], MPI_DOUBLE,
                 &Norm_glo(0), NS->MPI_recv_count.data(),
                 NS->MPI_recv_disp.data(), MPI_DOUBLE,
-                ParallelDescriptor::IOProcessorNumber(),
-                ParallelDescriptor::Communicator());
+                ParallelContext::IOProcessorNumberSub(),
+                ParallelContext::CommunicatorSub());
 
     // if (ParallelDescriptor::IOProcessor())
     //{
@@ -929,6 +1389,16 @@ void c_TransportSolver::Perform_SelfConsistencyAlgorithm()
                          serial implementation (BROYDEN_PARALLEL=FALSE).");
             break;
         }
+        case s_Algorithm_Type::anderson:
+        {
+            Execute_Anderson_Mixing_Parallel();
+            break;
+        }
+        case s_Algorithm_Type::newton_krylov:
+        {
+            Execute_NewtonKrylov_Parallel();
+            break;
+        }
         default:
         {
             amrex::Abort("selfconsistency_algorithm, " + Algorithm_Type +
@@ -946,10 +1416,10 @@ void c_TransportSolver::Obtain_maximum_time(
 
     MPI_Reduce(total_time_counter_diff, total_max_time_for_current_step,
                num_var, MPI_DOUBLE, MPI_MAX,
-               ParallelDescriptor::IOProcessorNumber(),
-               ParallelDescriptor::Communicator());
+               ParallelContext::IOProcessorNumberSub(),
+               ParallelContext::CommunicatorSub());
 
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         amrex::Real avg_curr[num_var] = {
             total_max_time_for_current_step[0] / max_iter,
@@ -1028,10 +1498,556 @@ void c_TransportSolver::Obtain_maximum_time(
 
 void c_TransportSolver::Reset_ForNextBiasStep()
 {
+    Store_ConvergedChargeForContinuation();
+
     Reset_Broyden_Parallel();
 
     // rMprop.ReInitializeMacroparam(NS_deposit_field_str);
-    MPI_Barrier(ParallelDescriptor::Communicator());
+    MPI_Barrier(ParallelContext::CommunicatorSub());
+}
+
+void c_TransportSolver::Store_ConvergedChargeForContinuation()
+{
+    if (bias_continuation_order == 0) return;
+
+    int slot = 0;
+    if (num_continuation_points < max_continuation_points)
+    {
+        slot = (continuation_head + num_continuation_points) %
+               max_continuation_points;
+        ++num_continuation_points;
+    }
+    else
+    {
+        /*overwrite the oldest point*/
+        slot = continuation_head;
+        continuation_head = (continuation_head + 1) % max_continuation_points;
+    }
+
+    auto &h_n_conv_data = h_n_converged_data[slot];
+    h_n_conv_data.resize({0}, {site_size_loc_all_NS}, The_Pinned_Arena());
+    auto const &h_n_conv = h_n_conv_data.table();
+
+#ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
+    auto const &h_n_curr_in = h_n_curr_in_data.const_table();
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        h_n_conv(site) = h_n_curr_in(site);
+    }
+#else
+    auto const &d_n_curr_in = d_n_curr_in_data.const_table();
+    amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, d_n_curr_in.p,
+                          d_n_curr_in.p + site_size_loc_all_NS, h_n_conv.p);
+    amrex::Gpu::streamSynchronize();
+#endif
+
+    converged_bias[slot] = {Vds, Vgs};
+}
+
+bool c_TransportSolver::Compute_ContinuationWeights(
+    const int num_points, amrex::Vector<amrex::Real> &weights)
+{
+    /*The newest num_points points are parametrized by their projection
+     *s_k onto the sweep direction, from the oldest to the newest of them,
+     *and the charge at (Vds, Vgs) is the Lagrange polynomial through them,
+     *i.e. the secant for two points. Returns false if the points do not
+     *span the sweep, e.g. for repeated biases, if a point or the new bias
+     *lies off the sweep line by more than a tenth of its length, or if the
+     *new bias is more than one spacing of the newest points beyond them,
+     *where the polynomial is no longer a reliable predictor.*/
+    const int first = num_continuation_points - num_points;
+    auto slot = [&](int k)
+    { return (continuation_head + first + k) % max_continuation_points; };
+
+    auto const &V_0 = converged_bias[slot(0)];
+    auto const &V_last = converged_bias[slot(num_points - 1)];
+    const amrex::Real dir[2] = {V_last[0] - V_0[0], V_last[1] - V_0[1]};
+    const amrex::Real dir_sq = dir[0] * dir[0] + dir[1] * dir[1];
+    if (dir_sq < 1.e-24) return false;
+
+    auto project = [&](amrex::Real vds, amrex::Real vgs)
+    { return ((vds - V_0[0]) * dir[0] + (vgs - V_0[1]) * dir[1]) / dir_sq; };
+
+    /*squared distance from the sweep line relative to dir_sq*/
+    auto off_line = [&](amrex::Real vds, amrex::Real vgs, amrex::Real s_k)
+    {
+        const amrex::Real r0 = vds - V_0[0] - s_k * dir[0];
+        const amrex::Real r1 = vgs - V_0[1] - s_k * dir[1];
+        return (r0 * r0 + r1 * r1) / dir_sq;
+    };
+    const amrex::Real max_off_line = 1.e-2;
+
+    amrex::Vector<amrex::Real> s(num_points);
+    for (int k = 0; k < num_points; ++k)
+    {
+        auto const &V_k = converged_bias[slot(k)];
+        s[k] = project(V_k[0], V_k[1]);
+        if (off_line(V_k[0], V_k[1], s[k]) > max_off_line) return false;
+    }
+    const amrex::Real s_new = project(Vds, Vgs);
+    if (off_line(Vds, Vgs, s_new) > max_off_line) return false;
+
+    /*s runs from 0 for the oldest to 1 for the newest point*/
+    const amrex::Real spacing =
+        std::abs(s[num_points - 1] - s[num_points - 2]);
+    if (s_new > 1. + spacing + 1.e-6 or s_new < -spacing - 1.e-6)
+    {
+        return false;
+    }
+
+    weights.resize(num_points);
+    for (int k = 0; k < num_points; ++k)
+    {
+        weights[k] = 1.;
+        for (int j = 0; j < num_points; ++j)
+        {
+            if (j == k) continue;
+            if (std::abs(s[k] - s[j]) < 1.e-6) return false;
+            weights[k] *= (s_new - s[j]) / (s[k] - s[j]);
+        }
+    }
+    return true;
+}
+
+bool c_TransportSolver::Predict_ChargeFromBiasContinuation()
+{
+    int num_points =
+        amrex::min(bias_continuation_order + 1, num_continuation_points);
+    if (num_points < 2) return false;
+
+    /*biases of the new step, the boundary conditions are already updated*/
+    for (auto &NS_var : vp_NS)
+    {
+        std::visit([&](auto &NS) { Set_TerminalBiasesAndContactPotential(NS); },
+                   NS_var);
+    }
+
+    amrex::Vector<amrex::Real> weights;
+    while (num_points >= 2 and
+           !Compute_ContinuationWeights(num_points, weights))
+    {
+        --num_points;
+    }
+    if (num_points < 2) return false;
+
+    amrex::Print() << "\nPredicting the input charge at Vds: " << Vds
+                   << " V, Vgs: " << Vgs << " V from " << num_points
+                   << " converged bias steps, weights:";
+    for (auto w : weights) amrex::Print() << " " << w;
+    amrex::Print() << "\n";
+
+    /*h_n_curr_in_data is allocated by Set_Broyden_Parallel*/
+    auto const &h_n_curr_in = h_n_curr_in_data.table();
+
+    const int first = num_continuation_points - num_points;
+    for (int site = 0; site < site_size_loc_all_NS; ++site)
+    {
+        h_n_curr_in(site) = 0.;
+    }
+    for (int k = 0; k < num_points; ++k)
+    {
+        const int slot =
+            (continuation_head + first + k) % max_continuation_points;
+        auto const &h_n_conv = h_n_converged_data[slot].const_table();
+        for (int site = 0; site < site_size_loc_all_NS; ++site)
+        {
+            h_n_curr_in(site) += weights[k] * h_n_conv(site);
+        }
+    }
+#ifndef BROYDEN_SKIP_GPU_OPTIMIZATION
+    d_n_curr_in_data.copy(h_n_curr_in_data);
+#endif
+
+    /*the first Poisson solve of this step sees the predicted charge*/
+    Deposit_InputChargeToMesh();
+
+    return true;
+}
+
+void c_TransportSolver::Deposit_InputChargeToMesh()
+{
+    /*deposits n_curr_in with the external sources, as in Part 5 of Solve*/
+    auto &rMprop = c_Code::GetInstance().get_MacroscopicProperties();
+    rMprop.ReInitializeMacroparam(NS_deposit_field_str);
+    rMprop.Deposit_AllExternalChargeDensitySources();
+
+    for (auto &NS_var : vp_NS)
+    {
+        std::visit(
+            [&](auto &NS)
+            {
+                CopyToNS_ChargeComputedUsingSelfConsistencyAlgorithm(NS);
+
+                NS->Deposit_AtomAttributeToMesh();
+
+                if (ParallelContext::IOProcessorSub())
+                {
+                    n_curr_in_glo_data.clear();
+                }
+            },
+            NS_var);
+    }
+    Sum_ChargeDepositedByAllNS();
+}
+
+void c_TransportSolver::Set_PredictorCorrectorPoisson()
+{
+    /*kappa is added to the alpha term of the operator as is, see
+     *c_MLMGSolver::Solve_LinearizedPoissonEqn*/
+    auto &rMLMG = c_Code::GetInstance().get_MLMGSolver();
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        rMLMG.bscalar == 1.,
+        "transport.predictor_corrector_poisson requires mlmg.bscalar = 1, "
+        "with mlmg.rhs the charge density.");
+
+    const int SSL = site_size_loc_all_NS;
+
+    h_Cq_U_prev_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Cq_n_prev_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Cq_num_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Cq_den_data.resize({0}, {SSL}, The_Pinned_Arena());
+    h_Cq_data.resize({0}, {SSL}, The_Pinned_Arena());
+
+    SetVal_RealTable1D(h_Cq_num_data, 0.);
+    SetVal_RealTable1D(h_Cq_den_data, 0.);
+    SetVal_RealTable1D(h_Cq_data, 0.);
+
+    Cq_kappa_mf.define(*_ba, *_dm, 1, 0);
+    Cq_phi_prev_mf.define(*_ba, *_dm, 1, 0);
+    Cq_kappa_mf.setVal(0.);
+    Cq_phi_prev_mf.setVal(0.);
+
+    flag_Cq_prev_valid = false;
+    flag_Cq_available = false;
+}
+
+void c_TransportSolver::Update_QuantumCapacitance()
+{
+    /*Gummel-type predictor-corrector: the next Poisson solve sees the charge
+     * n(U) = n_curr_in + C_q (U - U_prev)
+     *of each site, where U_prev is the potential of this NEGF evaluation,
+     *such that the potential anticipates the response of the charge and
+     *the charge sloshing between Poisson and NEGF is damped. The fixed
+     *point is unchanged, U = U_prev there.
+     *
+     *C_q = dn/dU is the secant of the NEGF charge between consecutive
+     *evaluations, by least squares over the pairs, where older pairs count
+     *half. It is clipped to C_q >= 0, for which the linearized Poisson
+     *equation stays positive definite, and needs |dU| above about 1e-6 eV
+     *to be estimated.*/
+    const int SSL = site_size_loc_all_NS;
+
+    RealTable1D h_U_data;
+    h_U_data.resize({0}, {SSL}, The_Pinned_Arena());
+    for (int c = 0; c < vp_NS.size(); ++c)
+    {
+        std::visit(
+            [&](auto &NS)
+            {
+                NS->Fetch_PotentialAtSites(h_U_data,
+                                           site_size_loc_cumulative[c],
+                                           NS->MPI_recv_count[my_rank]);
+            },
+            vp_NS[c]);
+    }
+
+#ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
+    auto const &n_curr_out = h_n_curr_out_data.const_table();
+#else
+    RealTable1D h_n_out_data;
+    h_n_out_data.resize({0}, {SSL}, The_Pinned_Arena());
+    auto const &d_n_curr_out = d_n_curr_out_data.const_table();
+    amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, d_n_curr_out.p,
+                          d_n_curr_out.p + SSL, h_n_out_data.table().p);
+    amrex::Gpu::streamSynchronize();
+    auto const &n_curr_out = h_n_out_data.const_table();
+#endif
+
+    auto const &U = h_U_data.const_table();
+    auto const &U_prev = h_Cq_U_prev_data.table();
+    auto const &n_prev = h_Cq_n_prev_data.table();
+    auto const &num = h_Cq_num_data.table();
+    auto const &den = h_Cq_den_data.table();
+    auto const &Cq = h_Cq_data.table();
+
+    amrex::Real max_Cq = 0.;
+    for (int site = 0; site < SSL; ++site)
+    {
+        if (flag_Cq_prev_valid)
+        {
+            const amrex::Real dU = U(site) - U_prev(site);
+            const amrex::Real dn = n_curr_out(site) - n_prev(site);
+            num(site) = 0.5 * num(site) + dn * dU;
+            den(site) = 0.5 * den(site) + dU * dU;
+        }
+        U_prev(site) = U(site);
+        n_prev(site) = n_curr_out(site);
+
+        Cq(site) = (den(site) > 1.e-12)
+                       ? amrex::max(num(site) / den(site), amrex::Real(0.))
+                       : 0.;
+        max_Cq = amrex::max(max_Cq, Cq(site));
+    }
+    ParallelAllReduce::Max(max_Cq, ParallelContext::CommunicatorSub());
+
+    if (flag_Cq_prev_valid) flag_Cq_available = true;
+    flag_Cq_prev_valid = true;
+
+    amrex::Print() << " Quantum capacitance, max C_q (e/eV): " << max_Cq
+                   << "\n";
+}
+
+void c_TransportSolver::Deposit_QuantumCapacitanceToMesh()
+{
+    /*C_q takes the path of the charge, such that kappa is C_q q_e / vol
+     *spread onto the mesh like the charge of the sites. The charge held by
+     *the nanostructures is restored by the deposit of n_curr_in that
+     *follows in Part 5 of Solve.*/
+    auto &rMprop = c_Code::GetInstance().get_MacroscopicProperties();
+    amrex::MultiFab &mf_deposit = rMprop.get_mf(NS_deposit_field_str);
+    mf_deposit.setVal(0.);
+
+    for (auto &NS_var : vp_NS)
+    {
+        std::visit(
+            [&](auto &NS)
+            {
+                CopyToNS_SiteValues(NS, h_Cq_data);
+                NS->Deposit_AtomAttributeToMesh();
+            },
+            NS_var);
+    }
+    Sum_ChargeDepositedByAllNS();
+
+    amrex::MultiFab::Copy(Cq_kappa_mf, mf_deposit, 0, 0, 1, 0);
+}
+
+void c_TransportSolver::Set_SiteResponseMatrix()
+{
+    const int N = num_field_sites_all_NS;
+    if (N > site_response_max_sites)
+    {
+        amrex::Abort("use_site_response_matrix: the " + std::to_string(N) +
+                     " field sites exceed site_response_max_sites = " +
+                     std::to_string(site_response_max_sites) + ".");
+    }
+
+    SR_NS_offset.resize(vp_NS.size() + 1);
+    SR_NS_offset[0] = 0;
+    for (int c = 0; c < vp_NS.size(); ++c)
+    {
+        std::visit(
+            [&](auto &NS)
+            {
+                SR_NS_offset[c + 1] =
+                    SR_NS_offset[c] + NS->get_num_field_sites();
+            },
+            vp_NS[c]);
+    }
+
+    /*rows in contiguous blocks over the processes*/
+    const int rows_per_proc = (N + total_proc - 1) / total_proc;
+    SR_recv_count.resize(total_proc);
+    SR_recv_disp.resize(total_proc);
+    for (int p = 0; p < total_proc; ++p)
+    {
+        const int begin = amrex::min(p * rows_per_proc, N);
+        const int end = amrex::min(begin + rows_per_proc, N);
+        SR_recv_count[p] = end - begin;
+        SR_recv_disp[p] = begin;
+    }
+    SR_row_begin = SR_recv_disp[my_rank];
+    SR_row_end = SR_row_begin + SR_recv_count[my_rank];
+
+    h_SR_data.resize({0, 0}, {N, SR_row_end - SR_row_begin},
+                     The_Pinned_Arena());
+    h_SR_V_base_data.resize({0}, {N}, The_Pinned_Arena());
+    h_SR_n_base_data.resize({0}, {N}, The_Pinned_Arena());
+
+    amrex::Print() << "Site response matrix: " << N << " x " << N
+                   << ", at most " << rows_per_proc << " rows per process\n";
+
+    flag_SR_available = false;
+}
+
+void c_TransportSolver::Gather_FieldAtAllSites(RealTable1D &h_V_data)
+{
+    auto const &h_V = h_V_data.table();
+    for (int c = 0; c < vp_NS.size(); ++c)
+    {
+        std::visit([&](auto &NS)
+                   { NS->Gather_FieldAtSites(h_V.p + SR_NS_offset[c]); },
+                   vp_NS[c]);
+    }
+}
+
+void c_TransportSolver::Assemble_GlobalInputCharge(RealTable1D &h_n_data)
+{
+    /*n_curr_in of all sites on all processes, from the partition of the
+     *self-consistency algorithm*/
+    const int N = num_field_sites_all_NS;
+    const int SSL = site_size_loc_all_NS;
+
+#ifdef BROYDEN_SKIP_GPU_OPTIMIZATION
+    auto const &n_curr_in = h_n_curr_in_data.const_table();
+#else
+    RealTable1D h_n_in_data;
+    h_n_in_data.resize({0}, {SSL}, The_Pinned_Arena());
+    auto const &d_n_curr_in = d_n_curr_in_data.const_table();
+    amrex::Gpu::copyAsync(amrex::Gpu::deviceToHost, d_n_curr_in.p,
+                          d_n_curr_in.p + SSL, h_n_in_data.table().p);
+    amrex::Gpu::streamSynchronize();
+    auto const &n_curr_in = h_n_in_data.const_table();
+#endif
+
+    auto const &h_n = h_n_data.table();
+    for (int s = 0; s < N; ++s) h_n(s) = 0.;
+
+    for (int c = 0; c < vp_NS.size(); ++c)
+    {
+        std::visit(
+            [&](auto &NS)
+            {
+                const int begin = site_size_loc_cumulative[c];
+                const int disp = SR_NS_offset[c] + NS->MPI_recv_disp[my_rank];
+                for (int i = 0; i < NS->MPI_recv_count[my_rank]; ++i)
+                {
+                    h_n(disp + i) = n_curr_in(begin + i);
+                }
+            },
+            vp_NS[c]);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, h_n.p, N, MPI_DOUBLE, MPI_SUM,
+                  ParallelContext::CommunicatorSub());
+}
+
+void c_TransportSolver::Build_SiteResponseMatrix()
+{
+    /*Poisson is linear, so the field at the sites is
+     * V = V_base + SR (n - n_base),
+     *with V_base and n_base of the solve that starts a bias step, which
+     *carries the boundary values and the external charge of that step.
+     *Column j of SR is the response of V to a unit charge at site j. It is
+     *the difference between a solve with this charge added to the base
+     *charge density and the base solve, at the same boundary values, so SR
+     *depends on the geometry only and is built once. Each of the N solves
+     *starts from the base solution, whose residual is then the unit charge
+     *only.*/
+    auto &rCode = c_Code::GetInstance();
+    auto &rMprop = rCode.get_MacroscopicProperties();
+    auto &rMLMG = rCode.get_MLMGSolver();
+
+    const int N = num_field_sites_all_NS;
+    const int rows = SR_row_end - SR_row_begin;
+
+    amrex::MultiFab &rho = rMprop.get_mf(NS_deposit_field_str);
+    amrex::MultiFab &phi = rMprop.get_mf(NS_gather_field_str);
+
+    amrex::MultiFab rho_base(rho.boxArray(), rho.DistributionMap(), 1,
+                             rho.nGrowVect());
+    amrex::MultiFab phi_base(phi.boxArray(), phi.DistributionMap(), 1,
+                             phi.nGrowVect());
+    amrex::MultiFab::Copy(rho_base, rho, 0, 0, 1, rho.nGrowVect());
+    amrex::MultiFab::Copy(phi_base, phi, 0, 0, 1, phi.nGrowVect());
+
+    RealTable1D h_V_base_data;
+    RealTable1D h_V_data;
+    h_V_base_data.resize({0}, {N}, The_Pinned_Arena());
+    h_V_data.resize({0}, {N}, The_Pinned_Arena());
+
+    Gather_FieldAtAllSites(h_V_base_data);
+
+    auto const &V_base = h_V_base_data.const_table();
+    auto const &V = h_V_data.const_table();
+    auto const &SR = h_SR_data.table();
+
+    amrex::Print() << "\nBuilding the site response matrix with " << N
+                   << " Poisson solves.\n";
+    amrex::Real time_beg = amrex::second();
+
+    int c = 0;
+    for (int j = 0; j < N; ++j)
+    {
+        while (j >= SR_NS_offset[c + 1]) ++c;
+
+        amrex::MultiFab::Copy(rho, rho_base, 0, 0, 1, rho.nGrowVect());
+        std::visit([&](auto &NS)
+                   { NS->Deposit_UnitChargeAtSite(j - SR_NS_offset[c]); },
+                   vp_NS[c]);
+        Sum_ChargeDepositedByAllNS();
+
+        amrex::MultiFab::Copy(phi, phi_base, 0, 0, 1, phi.nGrowVect());
+        rMLMG.Solve_PoissonEqn();
+
+        Gather_FieldAtAllSites(h_V_data);
+
+        for (int r = 0; r < rows; ++r)
+        {
+            SR(j, r) = V(SR_row_begin + r) - V_base(SR_row_begin + r);
+        }
+    }
+
+    amrex::MultiFab::Copy(rho, rho_base, 0, 0, 1, rho.nGrowVect());
+    amrex::MultiFab::Copy(phi, phi_base, 0, 0, 1, phi.nGrowVect());
+
+    flag_SR_available = true;
+
+    amrex::Print() << "Time for the site response matrix: "
+                   << amrex::second() - time_beg << "\n";
+}
+
+void c_TransportSolver::Store_SiteResponseBase()
+{
+    /*V_base is taken from the full Poisson solve of the first iteration of
+     *a bias step, not composed as sum_k V_k phi_k from Laplace solutions
+     *phi_k precomputed per electrode. The boundary values come from
+     *UpdateBoundaryConditions, which may evaluate arbitrary expressions of
+     *the bias, and rho also carries the fixed charge of the step, so that a
+     *per-electrode basis would not cover all inputs. The cost is one
+     *Poisson solve per bias step instead of one per iteration.*/
+    Gather_FieldAtAllSites(h_SR_V_base_data);
+    Assemble_GlobalInputCharge(h_SR_n_base_data);
+}
+
+void c_TransportSolver::Apply_SiteResponseMatrix()
+{
+    /*V = V_base + SR (n - n_base) for the rows of this process, gathered
+     *on all processes for the nanostructures*/
+    const int N = num_field_sites_all_NS;
+    const int rows = SR_row_end - SR_row_begin;
+
+    RealTable1D h_n_data;
+    RealTable1D h_V_data;
+    h_n_data.resize({0}, {N}, The_Pinned_Arena());
+    h_V_data.resize({0}, {N}, The_Pinned_Arena());
+
+    Assemble_GlobalInputCharge(h_n_data);
+
+    auto const &n = h_n_data.table();
+    auto const &n_base = h_SR_n_base_data.const_table();
+    auto const &V_base = h_SR_V_base_data.const_table();
+    auto const &V = h_V_data.table();
+    auto const &SR = h_SR_data.const_table();
+
+    for (int j = 0; j < N; ++j) n(j) -= n_base(j);
+
+    for (int r = 0; r < rows; ++r)
+    {
+        amrex::Real sum = 0.;
+        for (int j = 0; j < N; ++j) sum += SR(j, r) * n(j);
+        V(SR_row_begin + r) = V_base(SR_row_begin + r) + sum;
+    }
+
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, V.p,
+                   SR_recv_count.data(), SR_recv_disp.data(), MPI_DOUBLE,
+                   ParallelContext::CommunicatorSub());
+
+    for (int c = 0; c < vp_NS.size(); ++c)
+    {
+        std::visit([&](auto &NS)
+                   { NS->Set_PotentialAtSites(V.p + SR_NS_offset[c]); },
+                   vp_NS[c]);
+    }
 }
 
 void c_TransportSolver::SetVal_RealTable1D(RealTable1D &Tab1D_data,
@@ -441,7 +441,7 @@ amrex::Real Multifab_Manipulation::GetTotalNumberOfCutcells(amrex::MultiFab &mf)
         }
     }
     amrex::Real sum = amrex::get<0>(reduce_data.value());
-    ParallelDescriptor::ReduceRealSum(sum);
+    ParallelAllReduce::Sum(sum, ParallelContext::CommunicatorSub());
 
     return sum;
 #ifdef PRINT_NAME
@@ -683,9 +683,100 @@ void Quadrature::Gauss_Legendre(amrex::Vector<amrex::Real> &x,
     }
 }
 
+void Quadrature::Fermi_PoleExpansion(amrex::Vector<amrex::Real> &z,
+                                     amrex::Vector<amrex::Real> &R,
+                                     const int n)
+{
+    /*given n, function returns poles z and residues R, of size n, of the
+      continued-fraction expansion of the Fermi function (T. Ozaki, Phys.
+      Rev. B 75, 035123 (2007)),
+        1/(1+exp(x)) = 1/2 - sum_p R_p [1/(x - i z_p) + 1/(x + i z_p)].
+      z_p are the inverses of the positive eigenvalues b_p of the symmetric
+      tridiagonal matrix of size 2n with zero diagonal and off-diagonal
+      1/(2 sqrt((2m-1)(2m+1))), and R_p = v_p(0)^2/(4 b_p^2), where v_p is
+      the normalized eigenvector. Eigenvalues are found by the QL method with
+      implicit shifts, tracking only the first component of eigenvectors.*/
+
+    const int m = 2 * n;
+    amrex::Vector<amrex::Real> d(m, 0.); /*diagonal, becomes eigenvalues*/
+    amrex::Vector<amrex::Real> e(m, 0.); /*off-diagonal*/
+    amrex::Vector<amrex::Real> v(m, 0.); /*first components of eigenvectors*/
+
+    for (int i = 0; i < m - 1; ++i)
+    {
+        e[i] = 1. / (2. * std::sqrt((2. * i + 1.) * (2. * i + 3.)));
+    }
+    v[0] = 1.;
+
+    for (int l = 0; l < m; ++l)
+    {
+        int k = l;
+        do
+        {
+            /*look for a small off-diagonal element to split the matrix*/
+            for (k = l; k < m - 1; ++k)
+            {
+                amrex::Real dd = std::fabs(d[k]) + std::fabs(d[k + 1]);
+                if (std::fabs(e[k]) <= 1.e-15 * dd) break;
+            }
+            if (k != l)
+            {
+                amrex::Real g = (d[l + 1] - d[l]) / (2. * e[l]);
+                amrex::Real r = std::hypot(g, 1.);
+                g = d[k] - d[l] + e[l] / (g + std::copysign(r, g));
+                amrex::Real s = 1.;
+                amrex::Real c = 1.;
+                amrex::Real p = 0.;
+                int i = k - 1;
+                for (; i >= l; --i)
+                {
+                    amrex::Real f = s * e[i];
+                    amrex::Real b = c * e[i];
+                    r = std::hypot(f, g);
+                    e[i + 1] = r;
+                    if (r == 0.)
+                    {
+                        /*recover from underflow*/
+                        d[i + 1] -= p;
+                        e[k] = 0.;
+                        break;
+                    }
+                    s = f / r;
+                    c = g / r;
+                    g = d[i + 1] - p;
+                    r = (d[i] - g) * s + 2. * c * b;
+                    p = s * r;
+                    d[i + 1] = g + p;
+                    g = c * r - b;
+
+                    f = v[i + 1];
+                    v[i + 1] = s * v[i] + c * f;
+                    v[i] = c * v[i] - s * f;
+                }
+                if (r == 0. && i >= l) continue;
+                d[l] -= p;
+                e[l] = g;
+                e[k] = 0.;
+            }
+        } while (k != l);
+    }
+
+    /*eigenvalues come in pairs of +/- b_p*/
+    z.clear();
+    R.clear();
+    for (int i = 0; i < m; ++i)
+    {
+        if (d[i] > 0.)
+        {
+            z.push_back(1. / d[i]);
+            R.push_back(v[i] * v[i] / (4. * d[i] * d[i]));
+        }
+    }
+}
+
 void CreateDirectory(std::string foldername)
 {
-    if (ParallelDescriptor::IOProcessor())
+    if (ParallelContext::IOProcessorSub())
     {
         const int dir_err =
             mkdir(foldername.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
@@ -0,0 +1,149 @@
+#include "Ensemble.H"
+
+#include <AMReX.H>
+#include <AMReX_ParallelContext.H>
+#include <AMReX_ParmParse.H>
+#include <AMReX_Print.H>
+#include <AMReX_Utility.H>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "../SelectWarpXUtils/TextMsg.H"
+
+int c_Ensemble::num_groups = 1;
+int c_Ensemble::group_id = 0;
+MPI_Comm c_Ensemble::group_comm = MPI_COMM_NULL;
+std::vector<std::string> c_Ensemble::registered_filenames;
+
+void c_Ensemble::Initialize()
+{
+    amrex::ParmParse pp_ens("ensemble");
+    pp_ens.query("num_groups", num_groups);
+    amrex::Print() << "##### ensemble.num_groups: " << num_groups << "\n";
+
+    const int num_proc = amrex::ParallelDescriptor::NProcs();
+    WARPX_ALWAYS_ASSERT_WITH_MESSAGE(
+        num_groups >= 1 and num_groups <= num_proc,
+        "ensemble.num_groups = " + std::to_string(num_groups) +
+            " must be between 1 and the number of processes, " +
+            std::to_string(num_proc) + ".");
+
+    if (num_groups == 1) return;
+
+    /*contiguous ranks, group sizes differ by at most one process*/
+    const int my_rank = amrex::ParallelDescriptor::MyProc();
+    group_id = static_cast<int>(static_cast<long>(my_rank) * num_groups /
+                                num_proc);
+
+    MPI_Comm_split(amrex::ParallelDescriptor::Communicator(), group_id,
+                   my_rank, &group_comm);
+    amrex::ParallelContext::push(group_comm);
+
+    amrex::AllPrint() << "Rank " << my_rank << " is rank "
+                      << amrex::ParallelContext::MyProcSub() << " of "
+                      << amrex::ParallelContext::NProcsSub()
+                      << " in ensemble group " << group_id << "\n";
+}
+
+void c_Ensemble::Finalize()
+{
+    if (num_groups == 1) return;
+
+    amrex::ParallelContext::pop();
+    MPI_Comm_free(&group_comm);
+
+    /*the groups finish their steps at different times*/
+    amrex::ParallelDescriptor::Barrier();
+
+    if (amrex::ParallelDescriptor::IOProcessor())
+    {
+        for (auto const &filename : registered_filenames)
+        {
+            Merge_GroupFiles(filename);
+        }
+    }
+    registered_filenames.clear();
+}
+
+std::string c_Ensemble::Append_GroupID(const std::string &filename,
+                                       const int g)
+{
+    /*eg. output/negf/cnt/I_group0001.dat for I.dat of group 1*/
+    std::string stem = filename;
+    std::string extension;
+    const auto dot = filename.find_last_of('.');
+    const auto slash = filename.find_last_of('/');
+    if (dot != std::string::npos and
+        (slash == std::string::npos or dot > slash))
+    {
+        stem = filename.substr(0, dot);
+        extension = filename.substr(dot);
+    }
+    return amrex::Concatenate(stem + "_group", g, 4) + extension;
+}
+
+std::string c_Ensemble::Get_GroupFilename(const std::string &filename)
+{
+    if (num_groups == 1) return filename;
+
+    if (std::find(registered_filenames.begin(), registered_filenames.end(),
+                  filename) == registered_filenames.end())
+    {
+        registered_filenames.push_back(filename);
+    }
+
+    return Append_GroupID(filename, group_id);
+}
+
+void c_Ensemble::Merge_GroupFiles(const std::string &filename)
+{
+    /*Header lines start with a quote, e.g. 'step', 'Vds', ..., and are
+     *taken from group 0. Data lines start with the step and are sorted by
+     *it, keeping the order of lines with the same step.*/
+    std::vector<std::string> header;
+    std::vector<std::pair<int, std::string>> data;
+
+    for (int g = 0; g < num_groups; ++g)
+    {
+        const std::string group_filename = Append_GroupID(filename, g);
+
+        std::ifstream infile(group_filename);
+        if (!infile) continue;
+
+        std::string line;
+        while (std::getline(infile, line))
+        {
+            const auto first = line.find_first_not_of(" \t");
+            if (first == std::string::npos) continue;
+
+            int step = 0;
+            std::istringstream iss(line);
+            if (line[first] != '\'' and (iss >> step))
+            {
+                data.emplace_back(step, line);
+            }
+            else if (g == 0)
+            {
+                header.push_back(line);
+            }
+        }
+        infile.close();
+        std::remove(group_filename.c_str());
+    }
+
+    std::stable_sort(data.begin(), data.end(),
+                     [](auto const &a, auto const &b)
+                     { return a.first < b.first; });
+
+    std::ofstream outfile(filename, std::ios::app);
+    for (auto const &line : header) outfile << line << "\n";
+    for (auto const &d : data) outfile << d.second << "\n";
+    outfile.close();
+
+    amrex::Print() << "Merged the output of " << num_groups
+                   << " ensemble groups into: " << filename << "\n";
+}
@@ -1,6 +1,7 @@
 
 #include "Code.H"
 #include "CodeUtil.H"
+#include "Ensemble.H"
 #include "Utils/SelectWarpXUtils/WarpXProfilerWrapper.H"
 #include "Utils/SelectWarpXUtils/WarpXUtil.H"
 
@@ -12,10 +13,14 @@ int main(int argc, char *argv[])
 
     amrex::Real initial_time = ParallelDescriptor::second();
 
+    c_Ensemble::Initialize();
+
     {
         WARPX_PROFILE_VAR("main()", pmain);
 
         c_Code pCode;
+        pCode.Set_StepStride(c_Ensemble::get_group_id(),
+                             c_Ensemble::get_num_groups());
         amrex::ParmParse pp;
 
         pCode.InitData();
@@ -31,6 +36,8 @@ int main(int argc, char *argv[])
         WARPX_PROFILE_VAR_STOP(pmain);
     }
 
+    c_Ensemble::Finalize();
+
     PrintRunDiagnostics(initial_time);
 
     amrex::Finalize();
@@ -0,0 +1,191 @@
+#include <AMReX.H>
+#include <AMReX_ParmParse.H>
+#include <AMReX_Print.H>
+#include <AMReX_REAL.H>
+#include <AMReX_Vector.H>
+
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <utility>
+
+#include "Matrix_Block_Util.H"
+
+/*Micro-benchmark of the dense MatrixBlock kernels, [B]*[C] and [B]/[C],
+ *against reference kernels that loop directly over the interleaved
+ *GpuComplex elements, for block sizes N = 1, 2, 4, 8 and 16.*/
+
+template <int N>
+using DenseBlock = MatrixBlock<ComplexType[N][N]>;
+
+/*reference: R = B*C, interleaved storage*/
+template <int N>
+void Reference_Multiply(const DenseBlock<N> &B, const DenseBlock<N> &C,
+                        DenseBlock<N> &R)
+{
+    for (int i = 0; i < N; ++i)
+    {
+        for (int j = 0; j < N; ++j)
+        {
+            ComplexType sum(0., 0.);
+            for (int k = 0; k < N; ++k)
+            {
+                sum += B.block[i][k] * C.block[k][j];
+            }
+            R.block[i][j] = sum;
+        }
+    }
+}
+
+/*reference: R = B*inverse(C), Gauss-Jordan with partial pivoting on
+ *interleaved storage*/
+template <int N>
+void Reference_Divide(const DenseBlock<N> &B, const DenseBlock<N> &C,
+                      DenseBlock<N> &R)
+{
+    DenseBlock<N> A = C;
+    DenseBlock<N> Inv;
+    Inv = 1.;
+
+    for (int p = 0; p < N; ++p)
+    {
+        int r_max = p;
+        for (int r = p + 1; r < N; ++r)
+        {
+            if (amrex::abs(A.block[r][p]) > amrex::abs(A.block[r_max][p]))
+                r_max = r;
+        }
+        for (int j = 0; j < N; ++j)
+        {
+            std::swap(A.block[p][j], A.block[r_max][j]);
+            std::swap(Inv.block[p][j], Inv.block[r_max][j]);
+        }
+        ComplexType d = ComplexType(1., 0.) / A.block[p][p];
+        for (int j = 0; j < N; ++j)
+        {
+            A.block[p][j] = A.block[p][j] * d;
+            Inv.block[p][j] = Inv.block[p][j] * d;
+        }
+        for (int i = 0; i < N; ++i)
+        {
+            if (i == p) continue;
+            ComplexType f = A.block[i][p];
+            for (int j = 0; j < N; ++j)
+            {
+                A.block[i][j] = A.block[i][j] - f * A.block[p][j];
+                Inv.block[i][j] = Inv.block[i][j] - f * Inv.block[p][j];
+            }
+        }
+    }
+    Reference_Multiply(B, Inv, R);
+}
+
+template <int N>
+amrex::Real Max_Difference(const amrex::Vector<DenseBlock<N>> &X,
+                           const amrex::Vector<DenseBlock<N>> &Y)
+{
+    amrex::Real max_diff = 0.;
+    for (int b = 0; b < X.size(); ++b)
+    {
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < N; ++j)
+            {
+                max_diff = std::max(
+                    max_diff, amrex::abs(X[b].block[i][j] - Y[b].block[i][j]));
+            }
+        }
+    }
+    return max_diff;
+}
+
+template <int N>
+void Benchmark_BlockSize(const int num_blocks, const int num_repeat)
+{
+    std::mt19937 gen(N);
+    std::uniform_real_distribution<amrex::Real> dist(-1., 1.);
+
+    amrex::Vector<DenseBlock<N>> B(num_blocks), C(num_blocks);
+    amrex::Vector<DenseBlock<N>> R_ref(num_blocks), R(num_blocks);
+    for (int b = 0; b < num_blocks; ++b)
+    {
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < N; ++j)
+            {
+                B[b].block[i][j] = ComplexType(dist(gen), dist(gen));
+                C[b].block[i][j] = ComplexType(dist(gen), dist(gen));
+            }
+            /*diagonally dominant, such that C is well conditioned*/
+            C[b].block[i][i] += ComplexType(2. * N, 0.);
+        }
+    }
+
+    amrex::Real t0 = amrex::second();
+    for (int n = 0; n < num_repeat; ++n)
+        for (int b = 0; b < num_blocks; ++b)
+            Reference_Multiply(B[b], C[b], R_ref[b]);
+    amrex::Real t_ref_mul = amrex::second() - t0;
+
+    t0 = amrex::second();
+    for (int n = 0; n < num_repeat; ++n)
+        for (int b = 0; b < num_blocks; ++b) R[b] = B[b] * C[b];
+    amrex::Real t_mul = amrex::second() - t0;
+    amrex::Real err_mul = Max_Difference(R_ref, R);
+
+    t0 = amrex::second();
+    for (int n = 0; n < num_repeat; ++n)
+        for (int b = 0; b < num_blocks; ++b)
+            Reference_Divide(B[b], C[b], R_ref[b]);
+    amrex::Real t_ref_div = amrex::second() - t0;
+
+    t0 = amrex::second();
+    for (int n = 0; n < num_repeat; ++n)
+        for (int b = 0; b < num_blocks; ++b) R[b] = B[b] / C[b];
+    amrex::Real t_div = amrex::second() - t0;
+    amrex::Real err_div = Max_Difference(R_ref, R);
+
+    const amrex::Real ns_per_op = 1.e9 / (num_blocks * num_repeat);
+
+    amrex::Print() << std::setw(4) << N << std::setw(14)
+                   << t_ref_mul * ns_per_op << std::setw(14)
+                   << t_mul * ns_per_op << std::setw(10)
+                   << t_ref_mul / t_mul << std::setw(14)
+                   << t_ref_div * ns_per_op << std::setw(14)
+                   << t_div * ns_per_op << std::setw(10)
+                   << t_ref_div / t_div << std::setw(14)
+                   << std::max(err_mul, err_div) << "\n";
+}
+
+template <int... N>
+void Benchmark_AllBlockSizes(std::integer_sequence<int, N...>,
+                             const int num_blocks, const int num_repeat)
+{
+    (Benchmark_BlockSize<N>(num_blocks, num_repeat), ...);
+}
+
+int main(int argc, char *argv[])
+{
+    amrex::Initialize(argc, argv);
+    {
+        int num_blocks = 4096;
+        int num_repeat = 20;
+        amrex::ParmParse pp;
+        pp.query("num_blocks", num_blocks);
+        pp.query("num_repeat", num_repeat);
+
+        amrex::Print() << "num_blocks: " << num_blocks
+                       << ", num_repeat: " << num_repeat << "\n";
+        amrex::Print() << "times in ns per block operation\n";
+        amrex::Print() << std::setw(4) << "N" << std::setw(14) << "mul_ref"
+                       << std::setw(14) << "mul" << std::setw(10) << "speedup"
+                       << std::setw(14) << "div_ref" << std::setw(14) << "div"
+                       << std::setw(10) << "speedup" << std::setw(14)
+                       << "max_diff"
+                       << "\n";
+
+        Benchmark_AllBlockSizes(std::integer_sequence<int, 1, 2, 4, 8, 16>{},
+                                num_blocks, num_repeat);
+    }
+    amrex::Finalize();
+}